@@ -0,0 +1,373 @@
+@   cfbench.s - CompactFlash throughput benchmark, run as the boot ROM.
+@
+@   This program is free software; you can redistribute it and/or modify
+@   it under the terms of the GNU General Public License as published by
+@   the Free Software Foundation; either version 2 of the License, or
+@   (at your option) any later version.
+@
+@   This program is distributed in the hope that it will be useful,
+@   but WITHOUT ANY WARRANTY; without even the implied warranty of
+@   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+@   GNU General Public License for more details.
+@
+@   You should have received a copy of the GNU General Public License
+@   along with this program; if not, write to the Free Software
+@   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+@
+@ A bare-metal guest program that measures sequential and random sector
+@ reads from the card, by PIO through DATA32 and by READ DMA, timing
+@ each run with TC2 at 2 kHz and reporting on the UART.  Guest time
+@ only depends on the CPU clock, so the numbers are repeatable; run
+@ with -r as well to see what the host achieves in real time.
+@
+@   llvm-mc -triple=armv4-none-eabi -filetype=obj cfbench.s -o cfbench.o
+@   ld.lld -Ttext=0 -e 0 cfbench.o -o cfbench.elf
+@   llvm-objcopy -O binary cfbench.elf bootsim.rom
+@   dd if=/dev/zero of=card.img bs=1M count=16
+@   psimulator -n -C card.img	(in the directory holding bootsim.rom)
+@
+@ Only ARMv3 instructions are used.  The card needs at least 2 MB.
+
+	.syntax unified
+	.arm
+	.text
+
+	.equ	IO,		0x80000000
+	.equ	SYSCON,		0x0100
+	.equ	SYSFLG,		0x0140
+	.equ	TC2D,		0x0340
+	.equ	UARTDR,		0x0480
+	.equ	UBRLCR,		0x04c0
+	.equ	UARTEN,		0x00000100
+	.equ	UTXFF,		0x00800000
+	.equ	FIFOEN,		0x00010000
+	.equ	WL_8,		0x00060000
+
+	.equ	CF,		0x40000000
+	.equ	CF_DATA,	0x00
+	.equ	CF_COUNT,	0x08
+	.equ	CF_LBA0,	0x0c
+	.equ	CF_LBA1,	0x10
+	.equ	CF_LBA2,	0x14
+	.equ	CF_DEVICE,	0x18
+	.equ	CF_STATUS,	0x1c
+	.equ	CF_DATA32,	0x20
+	.equ	CF_DMA,		0x24
+	.equ	ST_DRQ,		0x08
+	.equ	ST_ERR,		0x01
+	.equ	CMD_READ,	0x20
+	.equ	CMD_READ_DMA,	0xc8
+	.equ	CMD_IDENTIFY,	0xec
+
+	.equ	STACK,		0xc0200000
+	.equ	BUF,		0xc0100000	@ DMA target, clear of the LCD
+	.equ	SEQ_SECTORS,	4096		@ 2 MB in runs of 256
+	.equ	RND_SECTORS,	1024		@ one at a time
+
+@ r8 timer start, r9 card sectors, r10 CF, r11 IO, r12 random LBA mask
+
+vectors:
+	b	reset
+	b	.			@ undefined
+	b	.			@ swi
+	b	.			@ prefetch abort
+	b	.			@ data abort
+	b	.			@ address exception
+	b	.			@ irq
+	b	.			@ fiq
+
+reset:
+	ldr	sp, =STACK
+	ldr	r11, =IO
+	ldr	r10, =CF
+	ldr	r0, =UARTEN		@ TC2 free-running at 2 kHz
+	str	r0, [r11, #SYSCON]
+	ldr	r0, =(FIFOEN | WL_8 | 1)	@ 115200 8N1
+	str	r0, [r11, #UBRLCR]
+	ldr	r0, =0xffff
+	str	r0, [r11, #TC2D]
+
+	ldr	r0, =msg_banner
+	bl	puts
+
+	@ IDENTIFY: words 60-61 hold the capacity in sectors
+	ldr	r0, [r10, #CF_STATUS]
+	cmp	r0, #0xff
+	beq	no_card
+	mov	r0, #CMD_IDENTIFY
+	str	r0, [r10, #CF_STATUS]
+	bl	wait_drq
+	mov	r4, #0
+	mov	r9, #0
+1:	ldr	r0, [r10, #CF_DATA]
+	cmp	r4, #60
+	orreq	r9, r9, r0
+	cmp	r4, #61
+	orreq	r9, r9, r0, lsl #16
+	add	r4, r4, #1
+	cmp	r4, #256
+	blo	1b
+
+	ldr	r0, =msg_card
+	bl	puts
+	mov	r0, r9
+	bl	print_dec
+	ldr	r0, =msg_sectors
+	bl	puts
+	cmp	r9, #SEQ_SECTORS
+	blo	too_small
+
+	@ r12 = largest power of two within the card, less one
+	mov	r12, #1
+1:	mov	r0, r12, lsl #1
+	cmp	r0, r9
+	movls	r12, r0
+	bls	1b
+	sub	r12, r12, #1
+
+	@ sequential PIO
+	ldr	r0, =msg_seq_pio
+	bl	puts
+	ldr	r8, [r11, #TC2D]
+	mov	r4, #0
+seq_pio:
+	mov	r0, r4
+	mov	r1, #0			@ 256 sectors
+	mov	r2, #CMD_READ
+	bl	command
+	mov	r5, #256
+1:	bl	wait_drq
+	mov	r6, #16
+2:	ldr	r0, [r10, #CF_DATA32]	@ 8 words a pass
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	subs	r6, r6, #1
+	bne	2b
+	subs	r5, r5, #1
+	bne	1b
+	add	r4, r4, #256
+	cmp	r4, #SEQ_SECTORS
+	blo	seq_pio
+	mov	r0, #SEQ_SECTORS
+	bl	report
+
+	@ sequential DMA
+	ldr	r0, =msg_seq_dma
+	bl	puts
+	ldr	r8, [r11, #TC2D]
+	mov	r4, #0
+seq_dma:
+	ldr	r0, =BUF
+	str	r0, [r10, #CF_DMA]
+	mov	r0, r4
+	mov	r1, #0
+	mov	r2, #CMD_READ_DMA
+	bl	command
+	bl	check
+	add	r4, r4, #256
+	cmp	r4, #SEQ_SECTORS
+	blo	seq_dma
+	mov	r0, #SEQ_SECTORS
+	bl	report
+
+	@ random PIO
+	ldr	r0, =msg_rnd_pio
+	bl	puts
+	ldr	r7, =12345
+	ldr	r8, [r11, #TC2D]
+	mov	r4, #0
+rnd_pio:
+	bl	random
+	mov	r1, #1
+	mov	r2, #CMD_READ
+	bl	command
+	bl	wait_drq
+	mov	r6, #16
+2:	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	ldr	r0, [r10, #CF_DATA32]
+	subs	r6, r6, #1
+	bne	2b
+	add	r4, r4, #1
+	cmp	r4, #RND_SECTORS
+	blo	rnd_pio
+	mov	r0, #RND_SECTORS
+	bl	report
+
+	@ random DMA
+	ldr	r0, =msg_rnd_dma
+	bl	puts
+	ldr	r7, =12345
+	ldr	r8, [r11, #TC2D]
+	mov	r4, #0
+rnd_dma:
+	ldr	r0, =BUF
+	str	r0, [r10, #CF_DMA]
+	bl	random
+	mov	r1, #1
+	mov	r2, #CMD_READ_DMA
+	bl	command
+	bl	check
+	add	r4, r4, #1
+	cmp	r4, #RND_SECTORS
+	blo	rnd_dma
+	mov	r0, #RND_SECTORS
+	bl	report
+
+	ldr	r0, =msg_done
+	b	stop
+no_card:
+	ldr	r0, =msg_no_card
+	b	stop
+too_small:
+	ldr	r0, =msg_too_small
+	b	stop
+error:
+	ldr	r0, =msg_error
+stop:
+	bl	puts
+	b	.
+
+
+@ r0 = LBA, r1 = sector count, r2 = command
+command:
+	str	r1, [r10, #CF_COUNT]
+	and	r3, r0, #0xff
+	str	r3, [r10, #CF_LBA0]
+	mov	r3, r0, lsr #8
+	and	r3, r3, #0xff
+	str	r3, [r10, #CF_LBA1]
+	mov	r3, r0, lsr #16
+	and	r3, r3, #0xff
+	str	r3, [r10, #CF_LBA2]
+	mov	r3, r0, lsr #24
+	and	r3, r3, #0x0f
+	orr	r3, r3, #0xe0		@ LBA mode
+	str	r3, [r10, #CF_DEVICE]
+	str	r2, [r10, #CF_STATUS]
+	mov	pc, lr
+
+wait_drq:
+	ldr	r0, [r10, #CF_STATUS]
+	tst	r0, #ST_ERR
+	bne	error
+	tst	r0, #ST_DRQ
+	beq	wait_drq
+	mov	pc, lr
+
+check:
+	ldr	r0, [r10, #CF_STATUS]
+	tst	r0, #ST_ERR
+	bne	error
+	mov	pc, lr
+
+@ next LBA in r0, from the generator in r7
+random:
+	ldr	r1, =1103515245
+	mul	r0, r7, r1
+	ldr	r1, =12345
+	add	r7, r0, r1
+	and	r0, r12, r7, lsr #4
+	mov	pc, lr
+
+@ r0 = sectors read since r8 was sampled: print KB/s and time
+report:
+	stmfd	sp!, {r4, r5, lr}
+	ldr	r1, [r11, #TC2D]
+	sub	r5, r8, r1
+	mov	r5, r5, lsl #16		@ the counter is 16 bits
+	mov	r5, r5, lsr #16
+	cmp	r5, #0
+	moveq	r5, #1
+	ldr	r1, =1000		@ KB/s = sectors / 2 * 2000 / ticks
+	mul	r4, r0, r1
+	mov	r0, r4
+	mov	r1, r5
+	bl	udiv
+	bl	print_dec
+	ldr	r0, =msg_kbs
+	bl	puts
+	mov	r0, r5, lsr #1
+	bl	print_dec
+	ldr	r0, =msg_ms
+	bl	puts
+	ldmfd	sp!, {r4, r5, pc}
+
+@ r0 = r0 / r1, r1 = remainder; r1 must not be 0
+udiv:
+	mov	r2, r1
+	mov	r3, #1
+1:	cmp	r2, r0, lsr #1
+	movls	r2, r2, lsl #1
+	movls	r3, r3, lsl #1
+	bls	1b
+	mov	r1, r0
+	mov	r0, #0
+2:	cmp	r1, r2
+	subhs	r1, r1, r2
+	addhs	r0, r0, r3
+	mov	r2, r2, lsr #1
+	movs	r3, r3, lsr #1
+	bne	2b
+	mov	pc, lr
+
+print_dec:
+	stmfd	sp!, {r4, r5, lr}
+	sub	sp, sp, #12
+	mov	r5, #0
+1:	mov	r1, #10
+	bl	udiv
+	add	r1, r1, #'0'
+	strb	r1, [sp, r5]
+	add	r5, r5, #1
+	cmp	r0, #0
+	bne	1b
+2:	sub	r5, r5, #1
+	ldrb	r0, [sp, r5]
+	bl	putc
+	cmp	r5, #0
+	bne	2b
+	add	sp, sp, #12
+	ldmfd	sp!, {r4, r5, pc}
+
+puts:
+	stmfd	sp!, {r4, lr}
+	mov	r4, r0
+1:	ldrb	r0, [r4], #1
+	cmp	r0, #0
+	ldmfdeq	sp!, {r4, pc}
+	bl	putc
+	b	1b
+
+putc:
+	ldr	r2, [r11, #SYSFLG]
+	tst	r2, #UTXFF
+	bne	putc
+	str	r0, [r11, #UARTDR]
+	mov	pc, lr
+
+	.ltorg
+
+msg_banner:	.asciz	"CF benchmark\n"
+msg_card:	.asciz	"card: "
+msg_sectors:	.asciz	" sectors\n"
+msg_seq_pio:	.asciz	"sequential PIO: "
+msg_seq_dma:	.asciz	"sequential DMA: "
+msg_rnd_pio:	.asciz	"random PIO:     "
+msg_rnd_dma:	.asciz	"random DMA:     "
+msg_kbs:	.asciz	" KB/s, "
+msg_ms:		.asciz	" ms\n"
+msg_done:	.asciz	"done\n"
+msg_no_card:	.asciz	"no card\n"
+msg_too_small:	.asciz	"card too small\n"
+msg_error:	.asciz	"card error\n"
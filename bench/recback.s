@@ -0,0 +1,78 @@
+@   recback.s - LCD recording check across a rewind, run as the boot ROM.
+@
+@   This program is free software; you can redistribute it and/or modify
+@   it under the terms of the GNU General Public License as published by
+@   the Free Software Foundation; either version 2 of the License, or
+@   (at your option) any later version.
+@
+@   This program is distributed in the hope that it will be useful,
+@   but WITHOUT ANY WARRANTY; without even the implied warranty of
+@   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+@   GNU General Public License for more details.
+@
+@   You should have received a copy of the GNU General Public License
+@   along with this program; if not, write to the Free Software
+@   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+@
+@ A bare-metal guest program that turns on a 256x64 monochrome LCD
+@ and keeps writing a counter into the frame buffer, so every frame
+@ of a recording (see armrec.h) has lines that changed.  Recorded
+@ while the script goes back in history:
+@
+@   llvm-mc -triple=armv4-none-eabi -filetype=obj recback.s -o recback.o
+@   ld.lld -Ttext=0 -e 0 recback.o -o recback.elf
+@   llvm-objcopy -O binary recback.elf bootsim.rom
+@   printf 'at 200ms\nback 1000000\nat 400ms\nquit 0\n' > back.scr
+@   psimulator -n -b -R rec.bin -s back.scr
+@
+@ the frames up to 200 ms are followed by one stamped with the cycle
+@ the rewind stopped at, then on from there.  The replay up to that
+@ point was recorded the first time round, so no frame comes from it.
+@
+@ Only ARMv3 instructions are used.
+
+	.syntax unified
+	.arm
+	.text
+
+	.equ	IO,		0x80000000
+	.equ	SYSCON,		0x0100
+	.equ	LCDCON,		0x02c0
+	.equ	LCDEN,		0x00001000
+	.equ	LINELEN_SHIFT,	13
+	.equ	FB,		0xc0000000
+
+	.equ	WIDTH,		256
+	.equ	HEIGHT,		64
+
+@ r4 counter, r10 FB, r11 IO
+
+vectors:
+	b	reset
+	b	.			@ undefined
+	b	.			@ swi
+	b	.			@ prefetch abort
+	b	.			@ data abort
+	b	.			@ address exception
+	b	.			@ irq
+	b	.			@ fiq
+
+reset:
+	ldr	r11, =IO
+	ldr	r0, =(((WIDTH / 16 - 1) << LINELEN_SHIFT) | (WIDTH * HEIGHT / 128 - 1))
+	str	r0, [r11, #LCDCON]
+	ldr	r0, =LCDEN
+	str	r0, [r11, #SYSCON]
+
+	@ the word at counter / 256, wrapping within the 2 KB buffer
+	ldr	r10, =FB
+	mov	r4, #0
+1:	add	r4, r4, #1
+	mov	r1, r4, lsr #8
+	bic	r1, r1, #3
+	bic	r1, r1, #0xf800
+	bic	r1, r1, #0xff0000
+	str	r4, [r10, r1]
+	b	1b
+
+	.ltorg
@@ -0,0 +1,98 @@
+@   rtcreplay.s - Input log check across RTC seconds, run as the boot ROM.
+@
+@   This program is free software; you can redistribute it and/or modify
+@   it under the terms of the GNU General Public License as published by
+@   the Free Software Foundation; either version 2 of the License, or
+@   (at your option) any later version.
+@
+@   This program is distributed in the hope that it will be useful,
+@   but WITHOUT ANY WARRANTY; without even the implied warranty of
+@   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+@   GNU General Public License for more details.
+@
+@   You should have received a copy of the GNU General Public License
+@   along with this program; if not, write to the Free Software
+@   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+@
+@ A bare-metal guest program that waits on the RTC match interrupt
+@ for each of the next few seconds and reports RTCDR on the UART.
+@ Without -d the RTC follows the host clock, which only reaches the
+@ guest through the input log, so a recording played back with -P
+@ has to print the same seconds and end with status 0:
+@
+@   llvm-mc -triple=armv4-none-eabi -filetype=obj rtcreplay.s -o rtcreplay.o
+@   ld.lld -Ttext=0 -e 0 rtcreplay.o -o rtcreplay.elf
+@   llvm-objcopy -O binary rtcreplay.elf bootsim.rom
+@   printf 'at 4s\nquit 0\n' > stop.scr
+@   psimulator -n -r -u file:rec.out -I rtc.log -s stop.scr
+@   psimulator -n -u file:play.out -P rtc.log && cmp rec.out play.out
+@
+@ Only ARMv3 instructions are used.
+
+	.syntax unified
+	.arm
+	.text
+
+	.equ	IO,		0x80000000
+	.equ	SYSCON,		0x0100
+	.equ	SYSFLG,		0x0140
+	.equ	INTSR,		0x0240
+	.equ	RTCDR,		0x0380
+	.equ	RTCMR,		0x03c0
+	.equ	UARTDR,		0x0480
+	.equ	UBRLCR,		0x04c0
+	.equ	RTCEOI,		0x0740
+	.equ	UARTEN,		0x00000100
+	.equ	UTXFF,		0x00800000
+	.equ	FIFOEN,		0x00010000
+	.equ	WL_8,		0x00060000
+	.equ	RTCMI,		0x00000400
+
+	.equ	SECONDS,	3
+
+@ r4 seconds to go, r5 RTCDR, r11 IO
+
+vectors:
+	b	reset
+	b	.			@ undefined
+	b	.			@ swi
+	b	.			@ prefetch abort
+	b	.			@ data abort
+	b	.			@ address exception
+	b	.			@ irq
+	b	.			@ fiq
+
+reset:
+	ldr	r11, =IO
+	ldr	r0, =UARTEN
+	str	r0, [r11, #SYSCON]
+	ldr	r0, =(FIFOEN | WL_8 | 1)	@ 115200 8N1
+	str	r0, [r11, #UBRLCR]
+
+	@ polled, with the interrupt masked: the match sets INTSR anyway
+	mov	r4, #SECONDS
+	ldr	r5, [r11, #RTCDR]
+1:	add	r0, r5, #1
+	str	r0, [r11, #RTCMR]
+2:	ldr	r0, [r11, #INTSR]
+	tst	r0, #RTCMI
+	beq	2b
+	str	r0, [r11, #RTCEOI]
+	ldr	r5, [r11, #RTCDR]
+	and	r0, r5, #7		@ the last octal digit is enough
+	add	r0, r0, #'0'
+	bl	putc
+	subs	r4, r4, #1
+	bne	1b
+	mov	r0, #'\n'
+	bl	putc
+	b	.
+
+putc:
+	ldr	r2, [r11, #SYSFLG]
+	tst	r2, #UTXFF
+	bne	putc
+	str	r0, [r11, #UARTDR]
+	mov	pc, lr
+
+	.ltorg
@@ -0,0 +1,417 @@
+/*
+    armcf.c - CompactFlash card on an expansion chip select.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "armdefs.h"
+
+/* status */
+#define ST_BSY		0x80
+#define ST_DRDY		0x40
+#define ST_DSC		0x10
+#define ST_DRQ		0x08
+#define ST_ERR		0x01
+/* error */
+#define ER_IDNF		0x10
+#define ER_ABRT		0x04
+
+/* commands */
+#define CMD_READ	0x20
+#define CMD_READ_NR	0x21
+#define CMD_WRITE	0x30
+#define CMD_WRITE_NR	0x31
+#define CMD_VERIFY	0x40
+#define CMD_VERIFY_NR	0x41
+#define CMD_INIT_PARAMS	0x91
+#define CMD_READ_DMA	0xc8
+#define CMD_WRITE_DMA	0xca
+#define CMD_IDLE	0xe3
+#define CMD_FLUSH	0xe7
+#define CMD_IDENTIFY	0xec
+#define CMD_SET_FEATURES 0xef
+
+#define CF_HEADS	16
+#define CF_SPT		63
+#define CF_MAX_CYLS	16383
+
+#define REG(addr)	(((addr) & 0xfff) >> 2)
+#define R_DATA		0
+#define R_FEATURE	1
+#define R_COUNT		2
+#define R_LBA0		3
+#define R_LBA1		4
+#define R_LBA2		5
+#define R_DEVICE	6
+#define R_STATUS	7
+#define R_DATA32	8
+#define R_DMA_ADDR	9
+
+#define DRAM_BANK(addr)	(((addr) >> 28) == 0xc || ((addr) >> 28) == 0xd)
+
+
+/* ATA strings are space padded, two characters to a word, first
+   character in the high byte. */
+static void
+id_string(unsigned char *id, int word, int words, const char *s)
+{
+	int i, len = strlen(s);
+
+	for (i = 0; i < words * 2; i++)
+		id[word * 2 + (i ^ 1)] = i < len ? s[i] : ' ';
+}
+
+static void
+id_word(unsigned char *id, int word, unsigned v)
+{
+	id[word * 2] = v;
+	id[word * 2 + 1] = v >> 8;
+}
+
+static void
+build_identify(cf_state_t *cf)
+{
+	unsigned char *id = cf->identify;
+	unsigned long long cyls = cf->sectors / (CF_HEADS * CF_SPT);
+	unsigned long lba28 = cf->sectors > 0x0fffffff ? 0x0fffffff : cf->sectors;
+	unsigned long chs;
+
+	if (cyls > CF_MAX_CYLS)
+		cyls = CF_MAX_CYLS;
+	chs = cyls * CF_HEADS * CF_SPT;
+	memset(id, 0, CF_SECTOR);
+	id_word(id, 0, 0x848a);			/* CompactFlash */
+	id_word(id, 1, cyls);
+	id_word(id, 3, CF_HEADS);
+	id_word(id, 6, CF_SPT);
+	id_word(id, 7, lba28 >> 16);		/* sectors per card */
+	id_word(id, 8, lba28);
+	id_string(id, 10, 10, "PSIM0001");
+	id_string(id, 23, 4, "1.0");
+	id_string(id, 27, 20, "PSIMULATOR CF");
+	id_word(id, 49, 0x0300);		/* LBA and DMA */
+	id_word(id, 53, 0x0001);		/* words 54-58 valid */
+	id_word(id, 54, cyls);
+	id_word(id, 55, CF_HEADS);
+	id_word(id, 56, CF_SPT);
+	id_word(id, 57, chs);
+	id_word(id, 58, chs >> 16);
+	id_word(id, 60, lba28);
+	id_word(id, 61, lba28 >> 16);
+}
+
+int
+cf_open(ARMul_State *state, const char *filename)
+{
+	cf_state_t *cf = &state->cf;
+	struct stat st;
+	int fd;
+
+	cf->readonly = 0;
+	fd = open(filename, cf->scratch ? O_RDONLY : O_RDWR);
+	if (fd < 0 && !cf->scratch) {
+		cf->readonly = 1;
+		fd = open(filename, O_RDONLY);
+	}
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(filename);
+		return -1;
+	}
+	cf->sectors = st.st_size / CF_SECTOR;
+	if (!cf->sectors) {
+		fprintf(stderr, "%s: card image is smaller than a sector\n", filename);
+		close(fd);
+		return -1;
+	}
+	cf->image = mmap(NULL, cf->sectors * CF_SECTOR,
+			 PROT_READ | (cf->readonly ? 0 : PROT_WRITE),
+			 cf->scratch ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+	close(fd);
+	if (cf->image == MAP_FAILED) {
+		perror(filename);
+		cf->image = NULL;
+		return -1;
+	}
+	build_identify(cf);
+	cf_reset(state);
+	return 0;
+}
+
+/* Take the card out, unmapping its image. */
+void
+cf_close(ARMul_State *state)
+{
+	cf_state_t *cf = &state->cf;
+
+	if (!cf->image)
+		return;
+	munmap(cf->image, cf->sectors * CF_SECTOR);
+	cf->image = NULL;
+	cf->sectors = 0;
+	cf_reset(state);
+}
+
+void
+cf_reset(ARMul_State *state)
+{
+	cf_state_t *cf = &state->cf;
+
+	cf->feature = 0;
+	cf->count = 1;
+	cf->lba[0] = 1;
+	cf->lba[1] = cf->lba[2] = cf->lba[3] = 0;
+	cf->error = 0x01;			/* diagnostics passed */
+	cf->status = cf->image ? ST_DRDY | ST_DSC : 0;
+	cf->dma_addr = 0;
+	cf->xfer_left = 0;
+	cf->sectors_left = 0;
+}
+
+
+static unsigned long long
+get_lba(cf_state_t *cf)
+{
+	if (cf->lba[3] & 0x40) {
+		return cf->lba[0] | (cf->lba[1] << 8) | (cf->lba[2] << 16) |
+		       ((cf->lba[3] & 0x0f) << 24);
+	}
+	if (!cf->lba[0]) {
+		return ~0ULL;			/* sectors count from 1 */
+	}
+	return ((unsigned long long)(cf->lba[1] | (cf->lba[2] << 8)) * CF_HEADS +
+		(cf->lba[3] & 0x0f)) * CF_SPT + cf->lba[0] - 1;
+}
+
+/* After a command the registers address the last sector it touched. */
+static void
+set_lba(cf_state_t *cf, unsigned long long lba)
+{
+	if (cf->lba[3] & 0x40) {
+		cf->lba[0] = lba & 0xff;
+		cf->lba[1] = (lba >> 8) & 0xff;
+		cf->lba[2] = (lba >> 16) & 0xff;
+		cf->lba[3] = (cf->lba[3] & 0xf0) | ((lba >> 24) & 0x0f);
+	} else {
+		unsigned long long cyl = lba / (CF_HEADS * CF_SPT);
+
+		cf->lba[0] = lba % CF_SPT + 1;
+		cf->lba[1] = cyl & 0xff;
+		cf->lba[2] = (cyl >> 8) & 0xff;
+		cf->lba[3] = (cf->lba[3] & 0xf0) | ((lba / CF_SPT) % CF_HEADS);
+	}
+}
+
+static void
+fail(cf_state_t *cf, ARMword error)
+{
+	cf->error = error;
+	cf->status = ST_DRDY | ST_DSC | ST_ERR;
+	cf->xfer_left = 0;
+	cf->sectors_left = 0;
+}
+
+/* Check the sector range of a command.  Returns the first LBA and
+   the number of sectors, or 0 after flagging an error. */
+static unsigned long
+get_range(cf_state_t *cf, unsigned long long *lba)
+{
+	unsigned long n = cf->count ? cf->count : 256;
+
+	*lba = get_lba(cf);
+	if (*lba >= cf->sectors || n > cf->sectors - *lba) {
+		fail(cf, ER_IDNF);
+		return 0;
+	}
+	return n;
+}
+
+static void
+command(ARMul_State *state, ARMword cmd)
+{
+	cf_state_t *cf = &state->cf;
+	unsigned long long lba;
+	unsigned long n;
+
+	cf->error = 0;
+	cf->status = ST_DRDY | ST_DSC;
+	switch (cmd) {
+	case CMD_IDENTIFY:
+		cf->xfer = cf->identify;
+		cf->xfer_left = CF_SECTOR;
+		cf->sectors_left = 0;
+		cf->writing = 0;
+		cf->status |= ST_DRQ;
+		break;
+	case CMD_WRITE:
+	case CMD_WRITE_NR:
+	case CMD_WRITE_DMA:
+		if (cf->readonly) {
+			fail(cf, ER_ABRT);
+			break;
+		}
+		/* fall through */
+	case CMD_READ:
+	case CMD_READ_NR:
+	case CMD_READ_DMA:
+		if (!(n = get_range(cf, &lba)))
+			break;
+		if (cmd == CMD_WRITE || cmd == CMD_WRITE_NR || cmd == CMD_WRITE_DMA)
+			reverse_card(state, lba, n);
+		if (cmd == CMD_READ_DMA || cmd == CMD_WRITE_DMA) {
+			if (!DRAM_BANK(cf->dma_addr) || (cf->dma_addr & 3)) {
+				fail(cf, ER_ABRT);
+				break;
+			}
+			if (cmd == CMD_READ_DMA)
+				dram_copy_in(state, cf->dma_addr,
+					     cf->image + lba * CF_SECTOR, n * CF_SECTOR);
+			else
+				dram_copy_out(state, cf->dma_addr,
+					      cf->image + lba * CF_SECTOR, n * CF_SECTOR);
+			set_lba(cf, lba + n - 1);
+			cf->count = 0;
+			break;
+		}
+		/* PIO: the data register walks straight through the image */
+		cf->xfer = cf->image + lba * CF_SECTOR;
+		cf->xfer_left = CF_SECTOR;
+		cf->sectors_left = n - 1;
+		cf->writing = (cmd == CMD_WRITE || cmd == CMD_WRITE_NR);
+		set_lba(cf, lba);
+		cf->status |= ST_DRQ;
+		break;
+	case CMD_VERIFY:
+	case CMD_VERIFY_NR:
+		if ((n = get_range(cf, &lba)))
+			set_lba(cf, lba + n - 1);
+		break;
+	case CMD_FLUSH:
+		if (!cf->readonly)
+			msync(cf->image, cf->sectors * CF_SECTOR, MS_SYNC);
+		break;
+	case CMD_INIT_PARAMS:
+	case CMD_IDLE:
+	case CMD_SET_FEATURES:
+		break;
+	default:
+		fail(cf, ER_ABRT);
+		break;
+	}
+}
+
+/* One 16-bit step of a PIO transfer. */
+static ARMword
+pio(cf_state_t *cf, ARMword data)
+{
+	if (!cf->xfer_left) {
+		return 0xffff;
+	}
+	if (cf->writing) {
+		cf->xfer[0] = data;
+		cf->xfer[1] = data >> 8;
+	} else {
+		data = cf->xfer[0] | (cf->xfer[1] << 8);
+	}
+	cf->xfer += 2;
+	cf->xfer_left -= 2;
+	if (!cf->xfer_left) {
+		if (cf->sectors_left) {
+			cf->sectors_left--;
+			cf->xfer_left = CF_SECTOR;
+			set_lba(cf, (cf->xfer - cf->image) / CF_SECTOR);
+		} else {
+			cf->status &= ~ST_DRQ;
+		}
+	}
+	return data;
+}
+
+ARMword
+cf_read_word(ARMul_State *state, ARMword addr)
+{
+	cf_state_t *cf = &state->cf;
+
+	if (!cf->image) {
+		return 0xFFFFFFFF;		/* empty slot */
+	}
+	switch (REG(addr)) {
+	case R_DATA:
+		return pio(cf, 0);
+	case R_DATA32:
+	{
+		ARMword lo = pio(cf, 0);
+
+		return lo | (pio(cf, 0) << 16);
+	}
+	case R_FEATURE:
+		return cf->error;
+	case R_COUNT:
+		return cf->count;
+	case R_LBA0:
+	case R_LBA1:
+	case R_LBA2:
+	case R_DEVICE:
+		return cf->lba[REG(addr) - R_LBA0];
+	case R_STATUS:
+		return cf->status;
+	case R_DMA_ADDR:
+		return cf->dma_addr;
+	}
+	return 0xFFFFFFFF;
+}
+
+void
+cf_write_word(ARMul_State *state, ARMword addr, ARMword data)
+{
+	cf_state_t *cf = &state->cf;
+
+	if (!cf->image) {
+		return;
+	}
+	switch (REG(addr)) {
+	case R_DATA:
+		pio(cf, data & 0xffff);
+		break;
+	case R_DATA32:
+		pio(cf, data & 0xffff);
+		pio(cf, (data >> 16) & 0xffff);
+		break;
+	case R_FEATURE:
+		cf->feature = data & 0xff;
+		break;
+	case R_COUNT:
+		cf->count = data & 0xff;
+		break;
+	case R_LBA0:
+	case R_LBA1:
+	case R_LBA2:
+	case R_DEVICE:
+		cf->lba[REG(addr) - R_LBA0] = data & 0xff;
+		break;
+	case R_STATUS:
+		command(state, data & 0xff);
+		break;
+	case R_DMA_ADDR:
+		cf->dma_addr = data;
+		break;
+	}
+}
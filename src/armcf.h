@@ -0,0 +1,69 @@
+/*
+    armcf.h - CompactFlash card on an expansion chip select.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMCF_H_
+#define _ARMCF_H_
+
+
+/* A CompactFlash card in True IDE mode, backed by an mmap()ed host
+   image.  The memory system only makes word accesses, and a byte or
+   halfword store reads the word first, so each task file register has
+   a word of its own:
+
+	CF_BASE + 0x00	DATA		16 bits per access
+	CF_BASE + 0x04	ERROR/FEATURE
+	CF_BASE + 0x08	SECTOR COUNT
+	CF_BASE + 0x0c	SECTOR / LBA 0-7
+	CF_BASE + 0x10	CYL LOW / LBA 8-15
+	CF_BASE + 0x14	CYL HIGH / LBA 16-23
+	CF_BASE + 0x18	DEVICE/HEAD / LBA 24-27
+	CF_BASE + 0x1c	STATUS/COMMAND
+	CF_BASE + 0x20	DATA32		4 bytes per access (emulator only)
+	CF_BASE + 0x24	DMA ADDRESS	DRAM for READ/WRITE DMA (emulator only)
+
+   Only DATA and DATA32 have side effects on a read.  Commands complete
+   at once, so BSY is never seen.  READ DMA and WRITE DMA copy whole
+   sector runs straight between the image and DRAM. */
+
+#define CF_BASE		0x40000000
+#define CF_SECTOR	512
+
+typedef struct cf_state_t {
+	unsigned char *	image;			/* NULL: slot empty */
+	unsigned long long sectors;
+	int		readonly;
+	int		scratch;		/* writes stay in memory */
+	ARMword		feature, count, lba[4], status, error;
+	ARMword		dma_addr;
+	unsigned char *	xfer;			/* next byte of PIO data */
+	long		xfer_left;		/* bytes left in this sector */
+	unsigned long	sectors_left;		/* after this one */
+	int		writing;
+	unsigned char	identify[CF_SECTOR];
+} cf_state_t;
+
+
+int	cf_open(ARMul_State *state, const char *filename);
+void	cf_close(ARMul_State *state);
+void	cf_reset(ARMul_State *state);
+ARMword	cf_read_word(ARMul_State *state, ARMword addr);
+void	cf_write_word(ARMul_State *state, ARMword addr, ARMword data);
+
+
+#endif	/* _ARMCF_H_ */
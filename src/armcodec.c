@@ -0,0 +1,299 @@
+/*
+    armcodec.c - Codec sound interface, with output to a WAV file.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "armdefs.h"
+#include "clps7110.h"
+
+#define ALAW_SILENCE	0xd5
+#define WAV_HEADER	58	/* RIFF, fmt (18), fact and data headers */
+#define WAV_CHUNK	512
+#define WAV_SLEEP_MS	10	/* writer naps this long when idle */
+#define WAV_CLOSE_MS	2000	/* longest wait for the writer to finish */
+
+
+/* WAV file: runs on the writer thread, except for open and close. */
+
+static void
+put_le(unsigned char *p, unsigned long v, int bytes)
+{
+	while (bytes--) {
+		*p++ = v;
+		v >>= 8;
+	}
+}
+
+/* A-law is WAVE_FORMAT_ALAW (6), which wants the extended fmt chunk
+   and a fact chunk giving the number of samples. */
+static void
+wav_header(unsigned char *h, unsigned long samples)
+{
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, WAV_HEADER - 8 + samples + (samples & 1), 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 18, 4);
+	put_le(h + 20, 6, 2);			/* A-law */
+	put_le(h + 22, 1, 2);			/* mono */
+	put_le(h + 24, CODEC_RATE, 4);
+	put_le(h + 28, CODEC_RATE, 4);		/* bytes per second */
+	put_le(h + 32, 1, 2);			/* block align */
+	put_le(h + 34, 8, 2);			/* bits per sample */
+	put_le(h + 36, 0, 2);			/* no extra format bytes */
+	memcpy(h + 38, "fact", 4);
+	put_le(h + 42, 4, 4);
+	put_le(h + 46, samples, 4);
+	memcpy(h + 50, "data", 4);
+	put_le(h + 54, samples, 4);
+}
+
+static void *
+codec_thread(void *arg)
+{
+	codec_state_t *codec = arg;
+	unsigned char buf[WAV_CHUNK];
+	struct timespec ts = { 0, WAV_SLEEP_MS * 1000000 };
+	int n;
+
+	for (;;) {
+		for (n = 0; n < WAV_CHUNK && ring_get(&codec->ring, &buf[n]); n++)
+			;
+		if (n) {
+			codec->written += fwrite(buf, 1, n, codec->wav);
+			continue;
+		}
+		if (__atomic_load_n(&codec->stop, __ATOMIC_ACQUIRE))
+			break;
+		nanosleep(&ts, NULL);
+	}
+	__atomic_store_n(&codec->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* Send the guest's sound to a WAV file and start the writer thread. */
+int
+codec_open(ARMul_State *state, const char *filename)
+{
+	codec_state_t *codec = &state->codec;
+	unsigned char h[WAV_HEADER];
+	pthread_t thread;
+
+	codec->wav = fopen(filename, "wb");
+	if (!codec->wav) {
+		perror(filename);
+		return -1;
+	}
+	wav_header(h, 0);
+	fwrite(h, 1, WAV_HEADER, codec->wav);
+	codec->stop = codec->done = 0;
+	codec->written = codec->dropped = 0;
+	if (!ring_init(&codec->ring, CODEC_RING_SLOTS, 1)) {
+		fprintf( stderr, "Armulator: can't set up the codec\n");
+		exit( -1 );
+	}
+	if (pthread_create(&thread, NULL, codec_thread, codec)) {
+		fprintf( stderr, "Armulator: can't start codec thread\n");
+		exit( -1 );
+	}
+	pthread_detach(thread);
+	codec->started = 1;
+	return 0;
+}
+
+/* Let the writer finish what is on the ring, then fill in the sizes. */
+void
+codec_close(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+	struct timespec ts = { 0, 1000000 };
+	unsigned char h[WAV_HEADER];
+	int tries = WAV_CLOSE_MS;
+
+	if (!codec->started) {
+		return;
+	}
+	__atomic_store_n(&codec->stop, 1, __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&codec->done, __ATOMIC_ACQUIRE) && tries--)
+		nanosleep(&ts, NULL);
+	codec->started = 0;
+	if (!codec->done) {
+		fprintf(stderr, "Codec writer didn't finish; WAV file is incomplete\n");
+		return;
+	}
+	if (codec->written & 1)
+		putc(0, codec->wav);		/* chunks are word aligned */
+	wav_header(h, codec->written);
+	fseek(codec->wav, 0, SEEK_SET);
+	fwrite(h, 1, WAV_HEADER, codec->wav);
+	fclose(codec->wav);
+	codec->wav = NULL;
+	ring_free(&codec->ring);
+	if (codec->dropped)
+		fprintf(stderr, "Codec: %lu samples lost, the disk fell behind\n",
+			codec->dropped);
+}
+
+
+/* Guest side: CPU thread only. */
+
+static unsigned codec_frame(ARMul_State *state);
+
+/* Derive the FIFO flags in SYSFLG.  CSINT is only raised by a frame. */
+static void
+codec_update(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+
+	state->io.sysflg &= ~(CRXFE | CTXFF);
+	if (!codec->rx_count)
+		state->io.sysflg |= CRXFE;
+	if (codec->tx_count == CODEC_FIFO)
+		state->io.sysflg |= CTXFF;
+}
+
+/* Frames are counted from frame_base so the rate doesn't drift when
+   cpu_clock isn't a multiple of CODEC_RATE. */
+static void
+codec_schedule(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+	unsigned long long due = codec->frame_base +
+		(codec->frames + 1) * state->cpu_clock / CODEC_RATE;
+	unsigned long long now = ARMul_Time(state);
+
+	ARMul_ScheduleEvent(state, due > now ? due - now : 0, codec_frame);
+}
+
+/* One codec frame: a sample goes out and one comes in. */
+static unsigned
+codec_frame(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+	ARMword syscon = state->io.syscon;
+	unsigned char c = ALAW_SILENCE;
+	int irq = 0;
+
+	if (syscon & CDENTX) {
+		/* an underrun plays silence */
+		if (codec->tx_count) {
+			c = codec->tx_fifo[codec->tx_head];
+			codec->tx_head = (codec->tx_head + 1) % CODEC_FIFO;
+			codec->tx_count--;
+		}
+		if (codec->started && !REVERSE_REPLAYING(state) &&
+		    !ring_put(&codec->ring, &c))
+			codec->dropped++;
+		if (codec->tx_count <= CODEC_FIFO / 2)
+			irq = 1;
+	}
+	if (syscon & CDENRX) {
+		if (codec->rx_count < CODEC_FIFO) {
+			codec->rx_fifo[(codec->rx_head + codec->rx_count) % CODEC_FIFO] =
+				ALAW_SILENCE;
+			codec->rx_count++;
+		}
+		if (codec->rx_count >= CODEC_FIFO / 2)
+			irq = 1;
+	}
+	codec_update(state);
+	if (irq) {
+		state->io.intsr |= CSINT;
+		io_update_int(state);
+	}
+	codec->frames++;
+	codec_schedule(state);
+	return 0;
+}
+
+/* SYSCON CDENTX or CDENRX changed. */
+void
+codec_enable(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+	int on = (state->io.syscon & (CDENTX | CDENRX)) != 0;
+
+	if (on && !codec->running) {
+		codec->running = 1;
+		codec->frame_base = ARMul_Time(state);
+		codec->frames = 0;
+		codec_schedule(state);
+	} else if (!on && codec->running) {
+		codec->running = 0;
+		ARMul_CancelEvent(state, codec_frame);
+	}
+}
+
+const snap_event_t codec_events[] = {
+	{ "codec", codec_frame },
+	{ NULL, NULL }
+};
+
+void
+codec_reset(ARMul_State *state)
+{
+	codec_state_t *codec = &state->codec;
+
+	ARMul_CancelEvent(state, codec_frame);
+	codec->running = 0;
+	codec->tx_head = codec->tx_count = 0;
+	codec->rx_head = codec->rx_count = 0;
+	codec_update(state);
+}
+
+ARMword
+codec_read_word(ARMul_State *state, ARMword reg)
+{
+	codec_state_t *codec = &state->codec;
+	ARMword data = 0;
+
+	switch (reg) {
+	case CODR:
+		if (codec->rx_count) {
+			data = codec->rx_fifo[codec->rx_head];
+			codec->rx_head = (codec->rx_head + 1) % CODEC_FIFO;
+			codec->rx_count--;
+		}
+		codec_update(state);
+		break;
+	}
+	return data;
+}
+
+void
+codec_write_word(ARMul_State *state, ARMword reg, ARMword data)
+{
+	codec_state_t *codec = &state->codec;
+
+	switch (reg) {
+	case CODR:
+		if (codec->tx_count < CODEC_FIFO) {
+			codec->tx_fifo[(codec->tx_head + codec->tx_count) % CODEC_FIFO] =
+				data;
+			codec->tx_count++;
+		}
+		codec_update(state);
+		break;
+	case COEOI:
+		state->io.intsr &= ~CSINT;
+		io_update_int(state);
+		break;
+	}
+}
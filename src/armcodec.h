@@ -0,0 +1,68 @@
+/*
+    armcodec.h - Codec sound interface, with output to a WAV file.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMCODEC_H_
+#define _ARMCODEC_H_
+
+
+/* The codec interface moves one 8-bit A-law sample each way per frame
+   at a fixed CODEC_RATE, through 16-byte FIFOs read and written at
+   CODR.  SYSCON CDENTX and CDENRX start and stop each direction.  On a
+   frame where the Tx FIFO is half empty or the Rx FIFO half full CSINT
+   is raised, and it stays up until a write to COEOI.
+
+   Samples sent while a WAV file is open are put on a ring, and a
+   writer thread takes them from there to the file, so the CPU thread
+   never waits for the disk.  Nothing is connected to the input: the
+   guest receives silence. */
+
+#define CODEC_RATE	8000		/* frames per second */
+#define CODEC_FIFO	16
+#define CODEC_RING_SLOTS 16384		/* two seconds of sound */
+
+typedef struct codec_state_t {
+	/* guest side, CPU thread only */
+	unsigned char	tx_fifo[CODEC_FIFO];
+	int		tx_head, tx_count;
+	unsigned char	rx_fifo[CODEC_FIFO];
+	int		rx_head, rx_count;
+	int		running;		/* frame event pending */
+	unsigned long long frame_base;		/* ARMul_Time of frame 0 */
+	unsigned long long frames;		/* since frame_base */
+
+	/* WAV writer */
+	FILE *		wav;
+	int		started;
+	int		stop;			/* writer should finish */
+	int		done;			/* writer has finished */
+	unsigned long	written;		/* samples in the file */
+	unsigned long	dropped;		/* ring was full */
+	ring_t		ring;			/* guest -> file samples */
+} codec_state_t;
+
+
+int	codec_open(ARMul_State *state, const char *filename);
+void	codec_close(ARMul_State *state);
+void	codec_reset(ARMul_State *state);
+void	codec_enable(ARMul_State *state);
+ARMword	codec_read_word(ARMul_State *state, ARMword reg);
+void	codec_write_word(ARMul_State *state, ARMword reg, ARMword data);
+
+
+#endif	/* _ARMCODEC_H_ */
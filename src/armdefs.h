@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #ifndef FALSE
 #define FALSE 0
@@ -42,6 +43,18 @@ typedef struct ARMul_State ARMul_State ;
 #include "armmem.h"
 #include "armio.h"
 #include "armlcd.h"
+#include "armring.h"
+#include "armuart.h"
+#include "armcf.h"
+#include "armcodec.h"
+#include "armssi.h"
+#include "armscript.h"
+#include "armshot.h"
+#include "armsnap.h"
+#include "armfork.h"
+#include "armreplay.h"
+#include "armreverse.h"
+#include "armrun.h"
 
 typedef unsigned ARMul_CPInits(ARMul_State *state) ;
 typedef unsigned ARMul_CPExits(ARMul_State *state) ;
@@ -53,6 +66,14 @@ typedef unsigned ARMul_CDPs(ARMul_State *state,unsigned type,ARMword instr) ;
 typedef unsigned ARMul_CPReads(ARMul_State *state,unsigned reg,ARMword *value) ;
 typedef unsigned ARMul_CPWrites(ARMul_State *state,unsigned reg,ARMword value) ;
 
+#define EVENT_POOL 64 /* room for pending events to start with */
+
+struct EventNode { /* a scheduled call */
+   unsigned long long when ; /* ARMul_Time at which it is due */
+   unsigned long seq ; /* order among events due together */
+   unsigned (*func)() ; /* the function to call */
+   } ;
+
 struct ARMul_State {
    ARMword Emulate ; /* to start and stop emulation */
    unsigned EndCondition ; /* reason for stopping */
@@ -69,12 +90,15 @@ struct ARMul_State {
    ARMword Mode ; /* the current mode */
    ARMword instr, pc, temp ; /* saved register state */
    ARMword loaded, decoded ; /* saved pipeline state */
-   unsigned long NumScycles,
+   unsigned long long Cycles ; /* emulated cycles since the state was made */
+#ifdef CYCLE_STATS
+   unsigned long long NumScycles,
                  NumNcycles,
                  NumIcycles,
                  NumCcycles,
-                 NumFcycles ; /* emulated cycles used */
-   unsigned long NumInstrs ; /* the number of instructions executed */
+                 NumFcycles ; /* the same by kind, since reset */
+#endif
+   unsigned long long NumInstrs ; /* the number of instructions executed */
    unsigned NextInstr ;
    unsigned VectorCatch ; /* caught exception mask */
    unsigned CallDebug ; /* set to call the debugger */
@@ -105,10 +129,13 @@ struct ARMul_State {
    unsigned char const *CPRegWords[16] ;  /* map of coprocessor register sizes */
 
    unsigned EventSet ; /* the number of events in the queue */
-   unsigned long Now ; /* time to the nearest cycle */
-   struct EventNode **EventPtr ; /* the event list */
+   unsigned EventPool ; /* room in Events, which grows */
+   unsigned long long Now ; /* when the first event is due */
+   unsigned long EventSeq ; /* keeps events due together in order */
+   struct EventNode *Events ; /* pending events, a min-heap */
 
    unsigned Exception ; /* enable the next four values */
+   unsigned IntPend ; /* reset, or an unmasked FIQ or IRQ, is waiting */
    unsigned Debug ; /* show instructions as they are executed */
    unsigned NresetSig ; /* reset the processor */
    unsigned NfiqSig ;
@@ -130,10 +157,24 @@ struct ARMul_State {
    const struct Dbg_HostosInterface *hostif;
 
    int verbose; /* non-zero means print various messages like the banner */
+   int headless; /* non-zero means never open an X display */
+   unsigned long cpu_clock; /* guest core clock in Hz; all device timing follows it */
+   int realtime; /* non-zero means throttle guest time to the wall clock */
+   int deterministic; /* non-zero means nothing the guest sees depends on the host clock */
    
    mmu_state_t	mmu;
    mem_state_t	mem;
    io_state_t	io;
+   lcd_state_t	lcd;
+   uart_state_t	uart;
+   cf_state_t	cf;
+   codec_state_t	codec;
+   ssi_state_t	ssi;
+   script_state_t	script;
+   snap_state_t	snap;
+   replay_state_t	replay;
+   reverse_state_t	reverse;
+   run_state_t	run;
  } ;
 
 #define ResetPin NresetSig
@@ -251,9 +292,13 @@ extern ARMword ARMul_DoInstr(ARMul_State *state) ;
 *                Definitons of things for event handling                    *
 \***************************************************************************/
 
-extern void ARMul_ScheduleEvent(ARMul_State *state, unsigned long delay, unsigned (*func)() ) ;
+extern int ARMul_EventRoom(ARMul_State *state, unsigned n) ;
+extern int ARMul_ScheduleEvent(ARMul_State *state, unsigned long long delay, unsigned (*func)() ) ;
+extern int ARMul_RescheduleEvent(ARMul_State *state, unsigned long long delay, unsigned (*func)() ) ;
+extern void ARMul_UpdateInt(ARMul_State *state) ;
+extern void ARMul_CancelEvent(ARMul_State *state, unsigned (*func)() ) ;
 extern void ARMul_EnvokeEvent(ARMul_State *state) ;
-extern unsigned long ARMul_Time(ARMul_State *state) ;
+extern unsigned long long ARMul_Time(ARMul_State *state) ;
 
 /***************************************************************************\
 *                          Useful support routines                          *
@@ -363,6 +408,15 @@ extern ARMword ARMul_Debug(ARMul_State *state, ARMword pc, ARMword instr) ;
 *                            Host-dependent stuff                           *
 \***************************************************************************/
 
+/* Every memory, internal and coprocessor cycle goes through here.  The
+   per-kind counts are only kept with -DCYCLE_STATS. */
+#ifdef CYCLE_STATS
+# define COUNT_CYCLES(state, kind, n) \
+   ((state)->Cycles += (n), (state)->Num##kind##cycles += (n))
+#else
+# define COUNT_CYCLES(state, kind, n) ((state)->Cycles += (n))
+#endif
+
 #ifdef macintosh
 pascal void SpinCursor(short increment);        /* copied from CursorCtl.h */
 # define HOURGLASS           SpinCursor( 1 )
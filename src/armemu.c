@@ -2887,9 +2887,11 @@ ARMword ARMul_Emulate26(register ARMul_State *state)
           decoded = ARMul_LoadInstrS(state,pc + (isize),isize) ;
           loaded = ARMul_LoadInstrS(state,pc + (isize * 2),isize) ;
           NORMALCYCLE ;
+          if (state->run.until) /* a block starts: see armrun.h */
+             run_block(state,pc) ;
           break ;
        }
-    if (state->EventSet)
+    if (EVENTDUE)
        ARMul_EnvokeEvent(state) ;
     
 #if 0
@@ -2898,7 +2900,7 @@ ARMword ARMul_Emulate26(register ARMul_State *state)
     if (instr == 0) abort ();
 #endif
 
-    if (state->Exception) { /* Any exceptions */
+    if (state->IntPend) { /* Any exceptions */
        if (state->NresetSig == LOW) {
            ARMul_Abort(state,ARMul_ResetV) ;
            break ;
@@ -2929,8 +2931,6 @@ ARMword ARMul_Emulate26(register ARMul_State *state)
           state->NextInstr = RESUME ;
           break ;
           }
-          
-    io_do_cycle(state);
 
     state->NumInstrs++ ;
 
@@ -381,7 +381,9 @@ extern ARMword ARMul_MRC(ARMul_State *state,ARMword instr) ;
 extern void ARMul_CDP(ARMul_State *state,ARMword instr) ;
 extern unsigned IntPending(ARMul_State *state) ;
 extern ARMword ARMul_Align(ARMul_State *state, ARMword address, ARMword data) ;
-#define EVENTLISTSIZE 1024L
+
+/* true when the first scheduled event is due */
+#define EVENTDUE (state->Cycles >= state->Now)
 
 /* Thumb support: */
 
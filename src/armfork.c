@@ -0,0 +1,236 @@
+/*
+    armfork.c - Running many tests from one booted machine.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "armdefs.h"
+
+#define REPORT_MAX	64		/* "status hash\n" from a child */
+
+typedef struct fork_result_t {
+	pid_t		pid;		/* 0: not started, -1: done */
+	int		fd;		/* read end of the report pipe, or -1 */
+	int		status;		/* from wait() */
+	int		reported;
+	int		exit_status;	/* as reported */
+	unsigned long long hash;
+	time_t		deadline;	/* killed if still running then */
+	int		timed_out;
+} fork_result_t;
+
+static int	report_fd = -1;		/* in a child: write end */
+
+
+/* In the child: let go of the parent's other children, connect the
+   UART and start the test. */
+static void
+child_start(ARMul_State *state, const char *test, int fd,
+	    fork_result_t *res, int ntests)
+{
+	char *spec = malloc(strlen(test) + 16);
+	int i;
+
+	for (i = 0; i < ntests; i++)
+		if (res[i].fd >= 0)
+			close(res[i].fd);
+	free(res);
+	signal(SIGALRM, SIG_DFL);
+	report_fd = fd;
+	if (!spec) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	sprintf(spec, "file:%s.uart", test);
+	if (uart_reconnect(state, spec) || script_open(state, test))
+		exit(1);
+	state->script.at_end = SCRIPT_END_QUIT;
+}
+
+static void
+collect(fork_result_t *res, int status)
+{
+	char buf[REPORT_MAX];
+	int n = read(res->fd, buf, sizeof(buf) - 1);
+
+	close(res->fd);
+	res->fd = -1;
+	res->pid = -1;
+	res->status = status;
+	buf[n > 0 ? n : 0] = 0;
+	res->reported =
+		sscanf(buf, "%d %llx", &res->exit_status, &res->hash) == 2;
+}
+
+static time_t
+now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Only there to interrupt wait(), and again a second later in case
+   this one came while the parent was doing something else. */
+static void
+alarm_handler(int sig)
+{
+	alarm(1);
+}
+
+/* Kill the tests that are past their deadline, and set the alarm for
+   the next one due. */
+static void
+kill_late(fork_result_t *res, int next)
+{
+	time_t now = now_secs(), first = 0;
+	int i;
+
+	for (i = 0; i < next; i++) {
+		if (res[i].pid <= 0 || res[i].timed_out)
+			continue;
+		if (res[i].deadline <= now) {
+			kill(res[i].pid, SIGKILL);
+			res[i].timed_out = 1;
+		} else if (!first || res[i].deadline < first)
+			first = res[i].deadline;
+	}
+	alarm(first ? first - now : 0);
+}
+
+/* Fork a child for each test, at most jobs at a time.  Returns 0 in
+   each child, which should carry on running the machine.  The parent
+   waits for them all, killing any still running after timeout seconds
+   unless that is 0, prints the results and exits: with status 0 if
+   every test quit with 0, otherwise 1. */
+int
+fork_tests(ARMul_State *state, char **tests, int ntests, int jobs,
+	   int timeout)
+{
+	fork_result_t *res = calloc(ntests, sizeof(*res));
+	int next = 0, running = 0, failed = 0, status, fds[2], i;
+	struct sigaction act;
+	pid_t pid;
+
+	if (!res) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	for (i = 0; i < ntests; i++)
+		res[i].fd = -1;
+	if (jobs < 1)
+		jobs = 1;
+	/* no SA_RESTART: the alarm has to stop wait() */
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = alarm_handler;
+	sigaction(SIGALRM, &act, NULL);
+	while (next < ntests || running) {
+		if (next < ntests && running < jobs) {
+			/* or the child prints the parent's buffered output again */
+			fflush(NULL);
+			if (pipe(fds) || (pid = fork()) < 0) {
+				perror("fork");
+				exit(1);
+			}
+			if (!pid) {
+				close(fds[0]);
+				child_start(state, tests[next], fds[1], res, ntests);
+				return 0;
+			}
+			close(fds[1]);
+			res[next].pid = pid;
+			res[next].fd = fds[0];
+			if (timeout > 0) {
+				res[next].deadline = now_secs() + timeout;
+				kill_late(res, next + 1);
+			}
+			next++;
+			running++;
+			continue;
+		}
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				kill_late(res, next);
+				continue;
+			}
+			perror("wait");
+			exit(1);
+		}
+		for (i = 0; i < next; i++)
+			if (res[i].pid == pid) {
+				collect(&res[i], status);
+				running--;
+				break;
+			}
+	}
+	alarm(0);
+
+	for (i = 0; i < ntests; i++) {
+		if (res[i].timed_out) {
+			printf("%s: timed out after %d s\n", tests[i],
+			       timeout);
+			failed++;
+		} else if (res[i].reported && WIFEXITED(res[i].status)) {
+			printf("%s: exit %d, frame hash %016llx\n", tests[i],
+			       res[i].exit_status, res[i].hash);
+			if (res[i].exit_status)
+				failed++;
+		} else if (WIFSIGNALED(res[i].status)) {
+			printf("%s: killed by signal %d\n", tests[i],
+			       WTERMSIG(res[i].status));
+			failed++;
+		} else {
+			printf("%s: exit %d, no result\n", tests[i],
+			       WEXITSTATUS(res[i].status));
+			failed++;
+		}
+	}
+	printf("%d of %d tests passed\n", ntests - failed, ntests);
+	fflush(stdout);
+	exit(failed ? 1 : 0);
+}
+
+int
+fork_child(void)
+{
+	return report_fd >= 0;
+}
+
+/* In a child that is about to exit: tell the parent how it went. */
+void
+fork_report(ARMul_State *state)
+{
+	char buf[REPORT_MAX];
+	int n;
+
+	if (report_fd < 0)
+		return;
+	n = snprintf(buf, sizeof(buf), "%d %016llx\n", state->script.status,
+		     shot_hash(state));
+	if (write(report_fd, buf, n) != n)
+		perror("Fork: can't report to the parent");
+	close(report_fd);
+	report_fd = -1;
+}
@@ -0,0 +1,43 @@
+/*
+    armfork.h - Running many tests from one booted machine.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMFORK_H_
+#define _ARMFORK_H_
+
+
+/* The machine is booted once, by a script or from a snapshot, and then
+   fork()ed once per test, so the children share DRAM, ROM and the card
+   copy-on-write and start in no time.  Each child runs its test script
+   from the booted state, with its UART written to TEST.uart, and quits
+   with status 0 when the script runs out.  The parent prints each
+   test's exit status and final frame hash.  Given a timeout, it kills
+   a test still running after that many seconds, as a failure, so one
+   that hangs doesn't hold up the rest.
+
+   The children have no threads but the CPU and the UART's, so there is
+   no display, sound or recording: the machine must be headless and the
+   card opened with cf.scratch, or they would all write the one image. */
+
+int	fork_tests(ARMul_State *state, char **tests, int ntests, int jobs,
+		   int timeout);
+int	fork_child(void);
+void	fork_report(ARMul_State *state);
+
+
+#endif	/* _ARMFORK_H_ */
@@ -47,6 +47,7 @@ unsigned ARMul_MultTable[32] = {1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,
                                 10,10,11,11,12,12,13,13,14,14,15,15,16,16,16} ;
 ARMword ARMul_ImmedTable[4096] ; /* immediate DP LHS values */
 char ARMul_BitList[256] ; /* number of bits in a byte table */
+int stop_simulator = 0 ; /* leave the emulator loop for good */
 
 /***************************************************************************\
 *         Call this routine once to set up the emulator's tables.           *
@@ -79,6 +80,8 @@ ARMul_State *ARMul_NewState(void)
  unsigned i, j ;
 
  state = (ARMul_State *)malloc(sizeof(ARMul_State)) ;
+ if (state == NULL)
+    return(NULL) ;
  memset (state, 0, sizeof (ARMul_State));
 
  state->Emulate = RUN ;
@@ -108,11 +111,10 @@ ARMul_State *ARMul_NewState(void)
  state->CommandLine = NULL ;
 
  state->EventSet = 0 ;
- state->Now = 0 ;
- state->EventPtr = (struct EventNode **)malloc((unsigned)EVENTLISTSIZE *
-                                               sizeof(struct EventNode *)) ;
- for (i = 0 ; i < EVENTLISTSIZE ; i++)
-    *(state->EventPtr + i) = NULL ;
+ state->Now = ~0ULL ;
+ state->EventSeq = 0 ;
+ state->Cycles = 0 ;
+ state->cpu_clock = CPU_CLOCK ;
 
 #ifdef ARM61
  state->prog32Sig = LOW ;
@@ -175,11 +177,13 @@ void ARMul_Reset(ARMul_State *state)
  state->AbortAddr = 1 ;
 
  state->NumInstrs = 0 ;
+#ifdef CYCLE_STATS
  state->NumNcycles = 0 ;
  state->NumScycles = 0 ;
  state->NumIcycles = 0 ;
  state->NumCcycles = 0 ;
  state->NumFcycles = 0 ;
+#endif
 #ifdef ASIM    
   (void)ARMul_MemoryInit() ;
 //  ARMul_OSInit(state) ;
@@ -188,6 +192,7 @@ void ARMul_Reset(ARMul_State *state)
  mem_reset(state);
  io_reset(state);
  lcd_disable(state);
+ ARMul_UpdateInt(state) ;
 }
 
 
@@ -298,7 +303,7 @@ void ARMul_Abort(ARMul_State *state, ARMword vector)
        state->Reg[14] = temp - 4 ;
        break ;
     case ARMul_IRQV : /* IRQ */
-       {int i;
+       if (state->Debug) {int i;
         ARMword intsr = state->io.intsr;
           fprintf(stderr,"IRQ: ");
 	  for(i = 15; i >= 0; i--, intsr <<= 1)
@@ -18,21 +18,25 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
-#include <unistd.h>
+#include <time.h>
 
 #include "armdefs.h"
+#include "armrec.h"
 #include "clps7110.h"
 
-#define TC_DIVISOR	(9000)	/* Set your BogoMips here :) */
+#define TC_FAST		512000	/* timer clocks, Hz */
+#define TC_SLOW		2000
 
 unsigned char keyboard[8];
 
-static void update_int(ARMul_State *state)
+void
+io_update_int(ARMul_State *state)
 {
 	ARMword	requests = state->io.intsr & state->io.intmr;
 	
 	state->NfiqSig = (requests & 0x000f) ? LOW : HIGH;
 	state->NirqSig = (requests & 0xfff0) ? LOW : HIGH;
+	ARMul_UpdateInt(state);
 }
 
 
@@ -63,6 +67,277 @@ static void update_lcd(ARMul_State *state)
 }
 
 
+/* The timers are not stepped; each one remembers the count it was loaded
+   with and when, so the current count can be worked out on a read, and
+   an event is scheduled for the moment it will underflow.  Periods after
+   the first are counted on from the same base, as codec frames are, so
+   the timers don't drift when cpu_clock isn't a multiple of their rate:
+   tcd[t] is then the count there would have been at tc_base[t], past
+   0xffff, until the base can move on by a whole second. */
+
+static unsigned tc1_underflow(ARMul_State *state);
+static unsigned tc2_underflow(ARMul_State *state);
+
+static unsigned (*tc_event[2])() = { tc1_underflow, tc2_underflow };
+
+static ARMword
+tc_value(ARMul_State *state, int t)
+{
+	unsigned long long ticks = (ARMul_Time(state) - state->io.tc_base[t]) *
+		state->io.tc_freq[t] / state->cpu_clock;
+
+	if (ticks > state->io.tcd[t]) {
+		/* underflow is due before the next instruction */
+		return 0;
+	}
+	return state->io.tcd[t] - ticks;
+}
+
+/* Cycle at which timer t underflows: the count goes N, N-1, ... 0 and
+   underflows on the next tick, at the first cycle that tick has begun
+   by, so a read then sees the new count. */
+static unsigned long long
+tc_due(ARMul_State *state, int t)
+{
+	unsigned long long ticks = (unsigned long long)state->io.tcd[t] + 1;
+
+	return state->io.tc_base[t] +
+		(ticks * state->cpu_clock + state->io.tc_freq[t] - 1) /
+		state->io.tc_freq[t];
+}
+
+static void
+tc_schedule(ARMul_State *state, int t)
+{
+	unsigned long long due = tc_due(state, t), now = ARMul_Time(state);
+
+	ARMul_RescheduleEvent(state, due > now ? due - now : 0, tc_event[t]);
+}
+
+/* Start timer t counting down from tcd[t] at time base. */
+static void
+tc_start(ARMul_State *state, int t, unsigned long long base)
+{
+	state->io.tc_base[t] = base;
+	state->io.tc_freq[t] =
+		(state->io.syscon & (t ? TC2S : TC1S)) ? TC_FAST : TC_SLOW;
+	tc_schedule(state, t);
+}
+
+static void
+tc_underflow(ARMul_State *state, int t)
+{
+	io_state_t *io = &state->io;
+	ARMword reload, secs;
+
+	if (io->syscon & (t ? TC2M : TC1M)) {
+		/* prescale */
+		reload = io->tcd_reload[t];
+	} else {
+		reload = 0xffff;
+	}
+	/* the ticks so far, then the new period, from the same base */
+	io->tcd[t] += reload + 1;
+	secs = (io->tcd[t] - reload) / io->tc_freq[t];
+	io->tc_base[t] += (unsigned long long)secs * state->cpu_clock;
+	io->tcd[t] -= secs * io->tc_freq[t];
+	io->intsr |= (t ? TC2OI : TC1OI);
+	io_update_int(state);
+	tc_schedule(state, t);
+}
+
+static unsigned
+tc1_underflow(ARMul_State *state)
+{
+	tc_underflow(state, 0);
+	return 0;
+}
+
+static unsigned
+tc2_underflow(ARMul_State *state)
+{
+	tc_underflow(state, 1);
+	return 0;
+}
+
+
+/* The real-time clock counts seconds.  Normally it is the host's clock
+   plus an offset set by writes to RTCDR.  With state->deterministic it
+   counts guest cycles from RTC_EPOCH instead, so runs are repeatable
+   without an input log.  Either way the match interrupt comes from an
+   event scheduled for the expected time; in host mode that is only an
+   estimate, so the event looks again until the host clock really gets
+   there. */
+
+#define RTC_EPOCH	946684800LL	/* 2000-01-01 00:00:00 UTC */
+#define RTC_CHECK_SECS	60		/* longest gap between rtc_event runs */
+#define RTC_TICKS	64		/* RTCDIV counts these */
+
+/* Seconds, and 64ths since the last second, on the clock in use. */
+static long long
+rtc_now(ARMul_State *state, int *ticks)
+{
+	if (state->deterministic) {
+		unsigned long long cycles =
+			ARMul_Time(state) - state->io.rtc_base;
+
+		if (ticks)
+			*ticks = cycles % state->cpu_clock *
+				 RTC_TICKS / state->cpu_clock;
+		return cycles / state->cpu_clock;
+	} else {
+		/* an input point for armreplay.c, logged when the
+		   clock has moved on since the guest last looked */
+		struct timespec ts;
+		unsigned char buf[8];
+		long long now;
+		int i, n = 0;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		now = ts.tv_sec * RTC_TICKS +
+		      ts.tv_nsec / (1000000000 / RTC_TICKS);
+		if (now != state->io.rtc_host) {
+			for (i = 0; i < 8; i++)
+				buf[i] = now >> (8 * i);
+			n = sizeof(buf);
+		}
+		if (replay_input(state, REPLAY_RTC, buf, n, sizeof(buf)) ==
+		    sizeof(buf)) {
+			for (now = 0, i = 7; i >= 0; i--)
+				now = (now << 8) | buf[i];
+			state->io.rtc_host = now;
+		}
+		if (ticks)
+			*ticks = state->io.rtc_host % RTC_TICKS;
+		return state->io.rtc_host / RTC_TICKS;
+	}
+}
+
+static ARMword
+rtc_value(ARMul_State *state, int *ticks)
+{
+	return (rtc_now(state, ticks) + state->io.rtc_offset) & 0xffffffff;
+}
+
+static unsigned
+rtc_event(ARMul_State *state)
+{
+	int ticks;
+	ARMword value = rtc_value(state, &ticks);
+	/* seconds to the match, as a signed 32-bit difference */
+	int ahead = (int)(unsigned)(state->io.rtcmr - value);
+	unsigned long long secs = RTC_CHECK_SECS, delay;
+
+	if (state->io.rtc_armed && ahead <= 0) {
+		state->io.intsr |= RTCMI;
+		io_update_int(state);
+		state->io.rtc_armed = 0;
+	}
+	if (state->io.rtc_armed && ahead < RTC_CHECK_SECS)
+		secs = ahead;
+	delay = secs * state->cpu_clock - ticks * state->cpu_clock / RTC_TICKS;
+	if (delay < state->cpu_clock / RTC_TICKS)
+		delay = state->cpu_clock / RTC_TICKS;
+	ARMul_ScheduleEvent(state, delay, rtc_event);
+	return 0;
+}
+
+/* Arm the match interrupt if RTCMR is still ahead of the clock. */
+static void
+rtc_rearm(ARMul_State *state)
+{
+	state->io.rtc_armed =
+		(int)(unsigned)(state->io.rtcmr - rtc_value(state, NULL)) > 0;
+	ARMul_CancelEvent(state, rtc_event);
+	rtc_event(state);
+}
+
+static void
+rtc_reset(ARMul_State *state)
+{
+	state->io.rtc_base = ARMul_Time(state);
+	state->io.rtc_offset = state->deterministic ? RTC_EPOCH : 0;
+	state->io.rtc_host = 0;
+	state->io.rtcmr = 0;
+	rtc_rearm(state);
+}
+
+/* An input log starts here (see armreplay.c).  The host clock was read
+   at reset, before there was a log to put it in: read it again at an
+   input point, so that playing starts from the same time as recording
+   did, and the next rtc_event comes at the same cycle. */
+void
+io_replay_open(ARMul_State *state)
+{
+	if (state->deterministic)
+		return;
+	/* no host reading is 0, so this one is logged */
+	state->io.rtc_host = 0;
+	rtc_rearm(state);
+}
+
+
+/* Things that need no exact timing are polled IO_POLL_HZ times a
+   guest second. */
+static unsigned
+io_poll(ARMul_State *state)
+{
+	uart_poll(state);
+	/* keep the UI alive */
+	lcd_cycle(state);
+	rec_frame(state);
+	ARMul_ScheduleEvent(state, state->cpu_clock / IO_POLL_HZ, io_poll);
+	return 0;
+}
+
+
+/* Realtime mode: guest time is cpu_clock cycles per second regardless,
+   but we sleep whenever it gets ahead of the host's monotonic clock.
+   If the host falls well behind (a slow host, or the process was
+   stopped) we start again from here rather than race to catch up. */
+
+#define RT_SLACK_NS	1000000LL	/* don't sleep for less */
+#define RT_BEHIND_NS	100000000LL	/* give up catching up */
+
+static long long
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+rt_restart(ARMul_State *state)
+{
+	state->io.rt_base = ARMul_Time(state);
+	state->io.rt_start = host_ns();
+}
+
+static unsigned
+io_throttle(ARMul_State *state)
+{
+	unsigned long long cycles = ARMul_Time(state) - state->io.rt_base;
+	long long guest, ahead;
+
+	guest = cycles / state->cpu_clock * 1000000000LL +
+		cycles % state->cpu_clock * 1000000000LL / state->cpu_clock;
+	ahead = guest - (host_ns() - state->io.rt_start);
+	if (ahead > RT_SLACK_NS) {
+		struct timespec ts;
+
+		ts.tv_sec = ahead / 1000000000LL;
+		ts.tv_nsec = ahead % 1000000000LL;
+		nanosleep(&ts, NULL);
+	} else if (ahead < -RT_BEHIND_NS) {
+		rt_restart(state);
+	}
+	ARMul_ScheduleEvent(state, state->cpu_clock / THROTTLE_HZ, io_throttle);
+	return 0;
+}
+
+
 void
 io_reset(ARMul_State *state)
 {
@@ -74,58 +349,43 @@ io_reset(ARMul_State *state)
 	state->io.tcd[1] = 0xffff;
 	state->io.tcd_reload[0] = 0xffff;
 	state->io.tcd_reload[1] = 0xffff;
-	state->io.tc_prescale = TC_DIVISOR;
-	state->io.uartdr = 0;
 	state->io.lcdcon = 0;
 	state->io.pallsw = 0x000000F0;
 	state->io.palmsw = 0;
 	state->io.lcd_limit = 0;
-	state->Exception = TRUE;
+	uart_reset(state);
+	codec_reset(state);
+	ssi_reset(state);
+	rtc_reset(state);
+	tc_start(state, 0, ARMul_Time(state));
+	tc_start(state, 1, ARMul_Time(state));
+	ARMul_RescheduleEvent(state, state->cpu_clock / IO_POLL_HZ, io_poll);
+	io_realtime(state);
 }
 
-
+/* Start or stop the throttle to match state->realtime, counting real
+   time from now. */
 void
-io_do_cycle(ARMul_State *state)
+io_realtime(ARMul_State *state)
 {
-	int t;
-
-	/* timer/counters */
-	state->io.tc_prescale--;
-	if (state->io.tc_prescale < 0) {
-		state->io.tc_prescale = TC_DIVISOR;
-		/* decrement the timer/counters, interrupt on underflow */
-		for (t = 0; t < 2; t++) {
-			if (state->io.tcd[t] == 0) {
-				/* underflow */
-				if (state->io.syscon & (t ? TC2M : TC1M)) {
-					/* prescale */
-					state->io.tcd[t] = state->io.tcd_reload[t];
-				} else {
-					state->io.tcd[t] = 0xffff;
-				}
-				state->io.intsr |= (t ? TC2OI : TC1OI);
-				update_int(state);
-			} else {
-				state->io.tcd[t]--;
-			}
-		}
-		/* uart receive - do this at the timers'
-		   prescaled rate for performance reasons */
-		if (state->io.sysflg & URXFE) {
-			char c;
-			
-			if (0 < read(0, &c, 1)) {
-				state->io.uartdr = c;
-				state->io.sysflg &= ~URXFE;
-				state->io.intsr |= URXINT;
-				update_int(state);
-			}
-		}
-		/* keep the UI alive */
-		lcd_cycle(state);
+	ARMul_CancelEvent(state, io_throttle);
+	if (state->realtime) {
+		rt_restart(state);
+		ARMul_ScheduleEvent(state, state->cpu_clock / THROTTLE_HZ,
+				    io_throttle);
 	}
 }
 
+/* The throttle follows the host's clock, so it is never saved. */
+const snap_event_t io_events[] = {
+	{ "tc1", tc1_underflow },
+	{ "tc2", tc2_underflow },
+	{ "rtc", rtc_event },
+	{ "io_poll", io_poll },
+	{ NULL, io_throttle },
+	{ NULL, NULL }
+};
+
 
 /* Internal registers from 0x80000000 to 0x80002000.
    We also define a "debug I/O" register thereafter. */
@@ -153,8 +413,13 @@ io_read_word(ARMul_State *state, ARMword addr)
 		data = state->io.syscon;
 		break;
 	case SYSFLG:
-		data = state->io.sysflg;
+	{
+		int ticks;
+
+		rtc_value(state, &ticks);
+		data = state->io.sysflg | (ticks << RTCDIV_SHIFT);
 		break;
+	}
 //	case MEMCFG1:
 //	case MEMCFG2:
 //	case /* DRFPR */:
@@ -168,26 +433,27 @@ io_read_word(ARMul_State *state, ARMword addr)
 		data = state->io.lcdcon;
 		break;
 	case TC1D:
-		data = state->io.tcd[0];
+		data = tc_value(state, 0);
 		break;
 	case TC2D:
-		data = state->io.tcd[1];
+		data = tc_value(state, 1);
+		break;
+	case RTCDR:
+		data = rtc_value(state, NULL);
+		break;
+	case RTCMR:
+		data = state->io.rtcmr;
 		break;
-//	case RTCDR:
-//	case RTCMR:
 //	case /* PMPCON */:
-//	case CODR:
+	case CODR:
+		data = codec_read_word(state, addr - 0x80000000);
+		break;
 	case UARTDR:
-		data = state->io.uartdr;
-		state->io.sysflg |= URXFE;
-		state->io.intsr &= ~URXINT;
-		update_int(state);
+	case UBRLCR:
+		data = uart_read_word(state, addr - 0x80000000);
 		break;
-//	case UBRLCR:		*
 	case SYNCIO:
-		/* if we return zero here, the battery voltage calculation
-		   results in a divide-by-zero that messes up the kernel */
-		data = 1;
+		data = ssi_read_word(state, addr - 0x80000000);
 		break;
 	case PALLSW:
 		data = state->io.pallsw;
@@ -232,10 +498,26 @@ io_write_word(ARMul_State *state, ARMword addr, ARMword data)
 //	case PEDDR:
 	case SYSCON:
 		tmp = state->io.syscon;
+		/* a new clock source takes effect from the current count */
+		if ((tmp ^ data) & TC1S) {
+			state->io.tcd[0] = tc_value(state, 0);
+		}
+		if ((tmp ^ data) & TC2S) {
+			state->io.tcd[1] = tc_value(state, 1);
+		}
 		state->io.syscon = data;
+		if ((tmp ^ data) & TC1S) {
+			tc_start(state, 0, ARMul_Time(state));
+		}
+		if ((tmp ^ data) & TC2S) {
+			tc_start(state, 1, ARMul_Time(state));
+		}
 		if ((tmp & LCDEN) != (data & LCDEN)) {
 			update_lcd(state);
 		}
+		if ((tmp ^ data) & (CDENTX | CDENRX)) {
+			codec_enable(state);
+		}
 //		printf("SYSCON = 0x%08x\n", data);
 		break;
 	case SYSFLG:
@@ -247,7 +529,7 @@ io_write_word(ARMul_State *state, ARMword addr, ARMword data)
 		break;
 	case INTMR:
 		state->io.intmr = data;
-		update_int(state);
+		io_update_int(state);
 //		printf("INTMR = 0x%08x\n", data);
 		break;
 	case LCDCON:
@@ -259,21 +541,32 @@ io_write_word(ARMul_State *state, ARMword addr, ARMword data)
 		break;
 	case TC1D:
 		state->io.tcd[0] = state->io.tcd_reload[0] = data & 0xffff;
+		tc_start(state, 0, ARMul_Time(state));
 		break;
 	case TC2D:
 		state->io.tcd[1] = state->io.tcd_reload[1] = data & 0xffff;
+		tc_start(state, 1, ARMul_Time(state));
+		break;
+	case RTCDR:
+		state->io.rtc_offset = (long long)data - rtc_now(state, NULL);
+		rtc_rearm(state);
+		break;
+	case RTCMR:
+		state->io.rtcmr = data;
+		rtc_rearm(state);
 		break;
-//	case RTCDR:
-//	case RTCMR:
 //	case /* PMPCON */:
-//	case CODR:
+	case CODR:
+	case COEOI:
+		codec_write_word(state, addr - 0x80000000, data);
+		break;
 	case UARTDR:
-		/* The UART writes chars to console */
-		printf("%c", (char)data);
-		fflush(stdout);
+	case UBRLCR:
+		uart_write_word(state, addr - 0x80000000, data);
+		break;
+	case SYNCIO:
+		ssi_write_word(state, addr - 0x80000000, data);
 		break;
-//	case UBRLCR:		*
-//	case SYNCIO:		*
 	case PALLSW:
 		tmp = state->io.pallsw;
 		state->io.pallsw = data;
@@ -293,19 +586,24 @@ io_write_word(ARMul_State *state, ARMword addr, ARMword data)
 //	case TEOI:
 	case TC1EOI:
 		state->io.intsr &= ~TC1OI;
-		update_int(state);
+		io_update_int(state);
 //		printf("TC1EOI\n");
 		break;
 	case TC2EOI:
 		state->io.intsr &= ~TC2OI;
-		update_int(state);
+		io_update_int(state);
 //		printf("TC2EOI\n");
 		break;
-//	case RTCEOI:
+	case RTCEOI:
+		state->io.intsr &= ~RTCMI;
+		io_update_int(state);
+		break;
 //	case UMSEOI:
-//	case COEOI:
-//	case HALT:
-//	case STDBY:
+	case HALT:
+	case STDBY:
+		/* only noted, for run_until(): the CPU carries on */
+		state->run.idle = 1;
+		break;
 	case 0x2000:
 		/* Not a real register, for debugging only: */
 		printf("io_write_word debug: 0x%08lx\n", data);
@@ -21,25 +21,37 @@
 #ifndef _ARMIO_H_
 #define _ARMIO_H_
 
+#define CPU_CLOCK	18432000	/* default core clock, Hz */
+#define IO_POLL_HZ	1000		/* UART and display polling rate */
+#define THROTTLE_HZ	100		/* realtime mode checks per guest second */
 
 typedef struct io_state_t {
 	ARMword		syscon;			/* System control */
 	ARMword		sysflg;			/* System status flags */
 	ARMword		intmr;			/* Interrupt status reg */
 	ARMword		intsr;			/* Interrupt mask reg */
-	ARMword		tcd[2];			/* Timer/counter data */
+	ARMword		tcd[2];			/* Timer/counter data at tc_base */
 	ARMword		tcd_reload[2];		/* Last value written */
-	int		tc_prescale;
-	ARMword		uartdr;			/* Receive data register */
+	unsigned long long tc_base[2];		/* ARMul_Time when tcd was loaded */
+	unsigned long	tc_freq[2];		/* count rate, Hz */
+	long long	rtc_offset;		/* RTCDR minus the clock */
+	ARMword		rtcmr;			/* RTC match */
+	int		rtc_armed;		/* match still to come */
+	unsigned long long rtc_base;		/* ARMul_Time at deterministic 0 */
+	long long	rtc_host;		/* host clock last seen, in ticks */
 	ARMword		lcdcon;			/* LCD control */
 	ARMword		pallsw;			/* palette LSW */
 	ARMword		palmsw;			/* palette MSW */
 	ARMword		lcd_limit;		/* 0xc0000000 <= LCD buffer < lcd_limit */
+	unsigned long long rt_base;		/* ARMul_Time at rt_start */
+	long long	rt_start;		/* host monotonic ns at rt_base */
 } io_state_t;
 
 
 void		io_reset(ARMul_State *state);
-void		io_do_cycle(ARMul_State *state);
+void		io_realtime(ARMul_State *state);
+void		io_replay_open(ARMul_State *state);
+void		io_update_int(ARMul_State *state);
 ARMword		io_read_word(ARMul_State *state, ARMword addr);
 void		io_write_word(ARMul_State *state, ARMword addr, ARMword data);
 
@@ -22,6 +22,8 @@
 #include <signal.h>
 #include <unistd.h>
 #include <string.h>
+#include <poll.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
@@ -30,34 +32,73 @@
 #include "xkeycodes.h"
 
 #define MAX_DEPTH	4		/* bits per pixel */
-#define GREY_LEVELS	16
-#define LCD_BASE	0xC0000000
-
-
+#define MAX_LINES	1024		/* size of the dirty line map */
+#define FRAME_MS	20		/* display thread refresh period */
+#define EVENT_SLOTS	256		/* X input events in flight */
+
+
+/* The X connection belongs to a display thread.  The CPU thread only
+   publishes the LCD configuration (under config_lock, never held
+   across an X call), marks scanlines dirty as the guest writes the
+   framebuffer, and drains input events from a lock-free ring.  The
+   display thread converts dirty lines straight out of guest DRAM at
+   its own pace, so a slow X server can never stall the emulation. */
+
+typedef struct lcd_config_t {
+	int		width, height, depth;
+	int		enabled;
+	ARMword		pallsw, palmsw;
+	unsigned	gen;			/* bumped on every change */
+} lcd_config_t;
+
+enum {
+	LCD_EV_KEYDOWN,
+	LCD_EV_KEYUP,
+	LCD_EV_PENDOWN,
+	LCD_EV_PENMOVE,
+	LCD_EV_PENUP
+};
+
+typedef struct lcd_event_t {
+	int		type;
+	int		code;			/* keyboard matrix index */
+	int		x, y;			/* pen position */
+} lcd_event_t;
+
+static pthread_mutex_t	config_lock = PTHREAD_MUTEX_INITIALIZER;
+static lcd_config_t	config;
+static unsigned char	dirty[MAX_LINES];
+static ring_t		events;
+static int		thread_started = 0;
+static pthread_t	thread;
+static int		closing;		/* lcd_close() wants it gone */
+static int		shown = 1;		/* window mapped, not obscured:
+						   a flag, as a full ring
+						   could lose an event */
+
+/* Display thread side */
 static Display          *display = 0;
 static Window           win = 0,root = 0;
-static int              screen, sd, lcd_enabled = 0, img_size = 0, pixel_size = 0;
+static int              screen, sd, disp_enabled = 0, disp_visible = 1;
+static int		disp_width, disp_height, disp_depth;
+static unsigned long	pixel_lut[16];		/* palette index -> host pixel */
+static unsigned long	bg_pixel;		/* fill for a disabled LCD */
+static void		(*put_line)(ARMul_State *state, int y);
 static GC               gc;
 static Atom             wmDeleteWindow;
 static XImage           *ximage = 0;
 static Visual		*visual = 0;
-static void             *xdata = 0;
-
-static unsigned long color_32[GREY_LEVELS] = {
- 0x00a7c57f, 0x009bb776, 0x0090aa6e, 0x00859d65,
- 0x007a905d, 0x006f8354, 0x0064764c, 0x00596943,
- 0x004d5b3b, 0x00424e32, 0x0037412a, 0x002c3421,
- 0x00212719, 0x00161a10, 0x000b0d08, 0x00000000};
-    
+
+#define color_32	shot_palette	/* 888, shared with screenshots */
+
 static unsigned long color[GREY_LEVELS] = {
  0x0000a62f, 0x00009dae, 0x0000954d, 0x000084ec,
  0x00007c8b, 0x00006c0a, 0x000063a9, 0x00005b48,
  0x00004ac7, 0x00004266, 0x00003205, 0x000029a4,
  0x00002123, 0x000010c2, 0x00000861, 0x00000000};
 
-static int lcd_width, lcd_height, lcd_depth;
+static unsigned long *grey_lut = color;
 
-extern ARMul_State *state;
 extern unsigned char keyboard[8];
 
 static int keymap[256];
@@ -71,12 +112,287 @@ unsigned long cr2pv(unsigned long c)
   return value;
 }
 
-void
-lcd_cycle(ARMul_State *state)
+/* Depth-specific conversion of one scanline of the guest framebuffer
+   into the XImage.  The right one is picked when the image is created
+   from its bits_per_pixel, so the data we hand to XPutImage is already
+   in the server's native format.  Pixels never straddle a word since
+   the depth always divides 32. */
+
+#define FOR_EACH_PIXEL(state, y, body) {				\
+	unsigned long bitpos = (unsigned long)(y) * disp_width * disp_depth; \
+	ARMword mask = (1 << disp_depth) - 1;				\
+	ARMword data;							\
+	int x;								\
+									\
+	data = dram_read_word(state, LCD_BASE + ((bitpos >> 5) << 2))	\
+		>> (bitpos & 31);					\
+	for (x = 0; x < disp_width; x++) {				\
+		unsigned long pixel = pixel_lut[data & mask];		\
+		body;							\
+		bitpos += disp_depth;					\
+		if (bitpos & 31)					\
+			data >>= disp_depth;				\
+		else							\
+			data = dram_read_word(state,			\
+				LCD_BASE + ((bitpos >> 5) << 2));	\
+	}								\
+}
+
+static void
+put_line_16(ARMul_State *state, int y)
+{
+	unsigned short *p = (unsigned short *)(ximage->data + y * ximage->bytes_per_line);
+
+	FOR_EACH_PIXEL(state, y, *p++ = pixel);
+}
+
+static void
+put_line_32(ARMul_State *state, int y)
+{
+	unsigned int *p = (unsigned int *)(ximage->data + y * ximage->bytes_per_line);
+
+	FOR_EACH_PIXEL(state, y, *p++ = pixel);
+}
+
+static void
+put_line_any(ARMul_State *state, int y)
+{
+	FOR_EACH_PIXEL(state, y, XPutPixel(ximage, x, y, pixel));
+}
+
+/* Rebuild the palette index -> host pixel table from PALLSW/PALMSW. */
+static void
+update_lut(lcd_config_t *cfg)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		ARMword pal = (i & 8) ? cfg->palmsw : cfg->pallsw;
+		pixel_lut[i] = grey_lut[(pal >> ((i & 7) * 4)) & 15];
+	}
+}
+
+static void
+mark_all_dirty(void)
+{
+	int y;
+
+	for (y = 0; y < MAX_LINES; y++)
+		__atomic_store_n(&dirty[y], 1, __ATOMIC_RELEASE);
+}
+
+static void
+x_open(int width, int height)
+{
+	XSetWindowAttributes attr;
+	XGCValues            values;
+
+	if ( (display=XOpenDisplay(NULL)) == NULL ) 
+	{ 
+		fprintf( stderr, "Armulator: cannot connect to X server %s\n", XDisplayName(NULL));
+		exit( -1 ); 
+	} 
+
+	screen     = DefaultScreen( display );
+	root       = RootWindow( display, screen );
+	sd         = DefaultDepth( display, screen );
+	visual     = DefaultVisual( display, screen );
+
+	attr.background_pixmap = None;
+	attr.override_redirect = False;
+	attr.backing_store     = Always;
+	attr.save_under        = False;
+	attr.event_mask        = ExposureMask | 
+				 KeyPressMask | 
+				 KeyReleaseMask |
+				 ButtonPressMask |
+				 ButtonReleaseMask |
+				 FocusChangeMask |
+				 StructureNotifyMask |
+				 VisibilityChangeMask |
+				 PointerMotionMask;
+
+	win = XCreateWindow( display, root, 0, 0, width, height, 0, sd,
+		 InputOutput,
+		 CopyFromParent,
+		 CWBackPixmap |
+		 CWOverrideRedirect |
+		 CWEventMask |
+		 CWSaveUnder |
+		 CWBackingStore,
+		 &attr);
+
+	{char                 *name = "Armulator";
+	 XWMHints             wm_hints;
+	 XSizeHints           size_hints;
+	 XClassHint           class_hints;
+	 XTextProperty        windowName;
+
+		XStringListToTextProperty( &name, 1, &windowName );
+		XSetWMName( display, win, &windowName );
+		size_hints.flags       = PMinSize | USPosition; 
+		size_hints.min_width   = width;
+		size_hints.min_height  = height;
+		XSetWMNormalHints( display, win, &size_hints );
+		wm_hints.initial_state = NormalState;
+		wm_hints.input         = True; 
+		wm_hints.flags         = StateHint | InputHint;
+		XSetWMHints( display, win, &wm_hints );
+		class_hints.res_name   = name; 
+		class_hints.res_class  = name; 
+		XSetClassHint( display, win, &class_hints );
+		wmDeleteWindow = XInternAtom(display, "WM_DELETE_WINDOW", False);
+		XSetWMProtocols(display, win, &wmDeleteWindow, 1);
+	}
+	XMapWindow( display, win );
+	gc = XCreateGC(display,win,0,&values);
+	XSetGraphicsExposures(display, gc, True);
+	XAutoRepeatOff(display);
+
+	memset(keymap, 0, sizeof(keymap));
+
+	keymap[XKC_ESC]  = 23; /* Esc */
+	keymap[XKC_AE01] = 6;  /* 1 */
+	keymap[XKC_AE02] = 5;  /* 2 */
+	keymap[XKC_AE03] = 4;  /* 3 */
+	keymap[XKC_AE04] = 3;  /* 4 */
+	keymap[XKC_AE05] = 2;  /* 5 */
+	keymap[XKC_AE06] = 1;  /* 6 */
+	keymap[XKC_AE07] = 14; /* 7 */
+	keymap[XKC_AE08] = 13; /* 8 */
+	keymap[XKC_AE09] = 12; /* 9 */
+	keymap[XKC_AE10] = 11; /* 0 */
+	keymap[XKC_BKSP] = 10; /* Del */
+
+	keymap[XKC_AD01] = 22; /* q */
+	keymap[XKC_AD02] = 21; /* w */
+	keymap[XKC_AD03] = 20; /* e */
+	keymap[XKC_AD04] = 19; /* r */
+	keymap[XKC_AD05] = 18; /* t */
+	keymap[XKC_AD06] = 17; /* y */
+	keymap[XKC_AD07] = 30; /* u */
+	keymap[XKC_AD08] = 29; /* i */
+	keymap[XKC_AD09] = 28; /* o */
+	keymap[XKC_AD10] = 27; /* p */
+	keymap[XKC_RTRN] = 25; /* Enter */
+
+	keymap[XKC_TAB]  = 38; /* Tab */
+	keymap[XKC_AC01] = 37; /* a */
+	keymap[XKC_AC02] = 36; /* s */
+	keymap[XKC_AC03] = 35; /* d */
+	keymap[XKC_AC04] = 34; /* f */
+	keymap[XKC_AC05] = 33; /* g */
+	keymap[XKC_AC06] = 46; /* h */
+	keymap[XKC_AC07] = 45; /* j */
+	keymap[XKC_AC08] = 44; /* k */
+	keymap[XKC_AC09] = 26; /* l */
+	keymap[XKC_AC10] = 9;  /* : */
+
+	keymap[XKC_LFSH] = 55; /* Left Shift */
+	keymap[XKC_AB01] = 54; /* z */
+	keymap[XKC_AB02] = 53; /* x */
+	keymap[XKC_AB03] = 52; /* c */
+	keymap[XKC_AB04] = 51; /* v */
+	keymap[XKC_AB05] = 50; /* b */
+	keymap[XKC_AB06] = 49; /* n */
+	keymap[XKC_AB07] = 43; /* m */
+	keymap[XKC_AC11] = 42; /* ' */
+	keymap[XKC_UP]   = 60; /* Up */
+	keymap[XKC_RTSH] = 63; /* Right Shift */
+
+	keymap[XKC_LCTL] = 39; /* Ctrl */
+	keymap[XKC_LWIN] = 47; /* Fn */
+	keymap[XKC_LALT] = 31; /* Menu */
+	keymap[XKC_SPCE] = 61; /* space */
+	keymap[XKC_AB10] = 59; /* ? */
+	keymap[XKC_LEFT] = 58; /* Left */
+	keymap[XKC_DOWN] = 41; /* Down */
+	keymap[XKC_RGHT] = 47; /* Right */
+}
+
+/* (Re)create the XImage for the current geometry and pick the
+   conversion path, so the refresh loop never looks at the visual. */
+static void
+x_create_image(int width, int height)
+{
+	char *xdata;
+
+	if (ximage) {
+		XDestroyImage(ximage);		/* frees the data too */
+		XResizeWindow(display, win, width, height);
+	}
+	ximage = XCreateImage(display, visual, sd, ZPixmap, 0, NULL, width, height, 32, 0);
+	if(!ximage)
+	{ 
+		fprintf( stderr, "Armulator: can't create %d bit image\n", sd);
+		exit( -1 ); 
+	} 
+	xdata = malloc(ximage->bytes_per_line * height);
+	if(!xdata)
+	{ 
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 ); 
+	} 
+	ximage->data = xdata;
+
+	if (ximage->bits_per_pixel == 16 && visual->green_mask == 0x07E0) {
+		grey_lut = color;
+		put_line = put_line_16;
+		bg_pixel = cr2pv(0x00808080);
+	} else if (ximage->bits_per_pixel == 32 && visual->green_mask == 0xFF00) {
+		grey_lut = color_32;
+		put_line = put_line_32;
+		bg_pixel = 0x00808080;
+	} else {
+		fprintf( stderr, "Armulator: no fast path for %d bpp visual, using XPutPixel\n",
+			 ximage->bits_per_pixel);
+		grey_lut = (sd > 16) ? color_32 : color;
+		put_line = put_line_any;
+		bg_pixel = (sd > 16) ? 0x00808080 : cr2pv(0x00808080);
+	}
+}
+
+/* Apply a configuration published by the CPU thread. */
+static void
+x_configure(lcd_config_t *cfg)
+{
+	if (!display) {
+		x_open(cfg->width, cfg->height);
+	}
+	if (!ximage || cfg->width != disp_width || cfg->height != disp_height) {
+		x_create_image(cfg->width, cfg->height);
+	}
+	disp_width = cfg->width;
+	disp_height = cfg->height;
+	disp_depth = cfg->depth;
+	disp_enabled = cfg->enabled;
+	update_lut(cfg);
+	if (disp_enabled) {
+		mark_all_dirty();
+	} else {
+		XSetForeground(display, gc, bg_pixel);
+		XFillRectangle(display, win, gc, 0, 0, disp_width, disp_height);
+	}
+}
+
+static void
+x_post(int type, int code, int x, int y)
+{
+	lcd_event_t ev;
+
+	ev.type = type;
+	ev.code = code;
+	ev.x = x;
+	ev.y = y;
+	if (!ring_put(&events, &ev))
+		fprintf(stderr, "Armulator: input event dropped\n");
+}
+
+static void
+x_events(void)
 {XEvent               report;
- int code, fd;
+ int code;
 
-	if(!display || !win) return;
 	while(XPending(display))
 	{
 		XNextEvent( display, &report );
@@ -86,18 +402,23 @@ lcd_cycle(ARMul_State *state)
 			{
 				case ClientMessage:
 					if (report.xclient.format == 32 && report.xclient.data.l[0] == wmDeleteWindow)
+					{
 						XAutoRepeatOn(display);
 						XFlush(display);
 						kill(getpid(), SIGTERM);
+					}
 				break;
 				case ButtonPress:
-					printf("Screen press: %d %d\n", report.xbutton.x, report.xbutton.y);
+					x_post(LCD_EV_PENDOWN, 0, report.xbutton.x, report.xbutton.y);
 				break;
 
 				case ButtonRelease:
+					x_post(LCD_EV_PENUP, 0, report.xbutton.x, report.xbutton.y);
 				break;
 
 				case MotionNotify:
+					if (report.xmotion.state & Button1Mask)
+						x_post(LCD_EV_PENMOVE, 0, report.xmotion.x, report.xmotion.y);
 				break;
 
 				case FocusIn:
@@ -109,21 +430,38 @@ lcd_cycle(ARMul_State *state)
 				case KeyPress:
 					printf("Key press: %#04x\n", report.xkey.keycode);
 					code = keymap[report.xkey.keycode & 0xFF];
-					if(code--) keyboard[code >> 3] |= (1 << (code & 7));
+					if(code--) x_post(LCD_EV_KEYDOWN, code, 0, 0);
 				break;
 
 				case KeyRelease:
 					printf("Key release: %#04x\n", report.xkey.keycode);
 					code = keymap[report.xkey.keycode & 0xFF];
-					if(code--) keyboard[code >> 3] &= ~(1 << (code & 7));
+					if(code--) x_post(LCD_EV_KEYUP, code, 0, 0);
 				break;
 
 				case DestroyNotify:
 				break;
 
+				/* Nobody can see the LCD: tell the CPU thread
+				   to stop tracking framebuffer writes. */
+				case UnmapNotify:
+					disp_visible = 0;
+				break;
+
+				case MapNotify:
+					disp_visible = 1;
+				break;
+
+				case VisibilityNotify:
+					if (report.xvisibility.state == VisibilityFullyObscured)
+						disp_visible = 0;
+					else
+						disp_visible = 1;
+				break;
+
 				case GraphicsExpose:
 				case Expose:
-					if(lcd_enabled)
+					if(disp_enabled)
 					{
 						XPutImage( display, win, gc, ximage,
 							   report.xexpose.x,
@@ -135,7 +473,7 @@ lcd_cycle(ARMul_State *state)
 					}
 					else
 					{
-						XSetForeground(display, gc, cr2pv(0x00808080) );
+						XSetForeground(display, gc, bg_pixel);
 						XFillRectangle(display, win, gc,
 							       report.xexpose.x,
 							       report.xexpose.y,
@@ -148,188 +486,231 @@ lcd_cycle(ARMul_State *state)
 	}
 }
 
-void
-lcd_enable(ARMul_State *state, int width, int height, int depth)
+/* Convert every dirty scanline and push runs of them in one request. */
+static void
+x_refresh(ARMul_State *state)
 {
-	int i;
-	XSetWindowAttributes attr;
-	XGCValues            values;
-	XEvent               event;
+	int y, first = -1;
+	int lines = disp_height < MAX_LINES ? disp_height : MAX_LINES;
+
+	for (y = 0; y <= lines; y++) {
+		if (y < lines && __atomic_exchange_n(&dirty[y], 0, __ATOMIC_ACQUIRE)) {
+			put_line(state, y);
+			if (first < 0)
+				first = y;
+		} else if (first >= 0) {
+			XPutImage(display, win, gc, ximage, 0, first, 0, first,
+				  disp_width, y - first);
+			first = -1;
+		}
+	}
+}
 
-	lcd_width = width;
-	lcd_height = height;
-	lcd_depth = depth;
-	state->io.lcd_limit = LCD_BASE + (width * height * depth / 8);
-	if(!win)
-	{
-		if ( (display=XOpenDisplay(NULL)) == NULL ) 
-		{ 
-			fprintf( stderr, "Armulator: cannot connect to X server %s\n", XDisplayName(NULL));
-			exit( -1 ); 
-		} 
-
-		screen     = DefaultScreen( display );
-		root       = RootWindow( display, screen );
-		sd         = DefaultDepth( display, screen );
-		visual     = DefaultVisual( display, screen );
-		pixel_size = sd / 8;
-		img_size   = width * height;
-		xdata      = malloc(img_size * pixel_size + sizeof(unsigned long));
-		if(!xdata)
-		{ 
-			fprintf( stderr, "Armulator: can't allocate memory\n");
-			exit( -1 ); 
-		} 
-
-
-		attr.background_pixmap = None;
-		attr.override_redirect = False;
-		attr.backing_store     = Always;
-		attr.save_under        = False;
-		attr.event_mask        = ExposureMask | 
-					 KeyPressMask | 
-					 KeyReleaseMask |
-					 ButtonPressMask |
-					 ButtonReleaseMask |
-					 FocusChangeMask |
-					 StructureNotifyMask |
-					 PointerMotionMask;
-
-		win = XCreateWindow( display, root, 0, 0, width, height, 0, sd,
-			 InputOutput,
-			 CopyFromParent,
-			 CWBackPixmap |
-			 CWOverrideRedirect |
-			 CWEventMask |
-			 CWSaveUnder |
-			 CWBackingStore,
-			 &attr);
-
-		{char                 *name = "Armulator";
-		 XWMHints             wm_hints;
-		 XSizeHints           size_hints;
-		 XClassHint           class_hints;
-		 XTextProperty        windowName;
-
-			XStringListToTextProperty( &name, 1, &windowName );
-			XSetWMName( display, win, &windowName );
-			size_hints.flags       = PMinSize | USPosition; 
-			size_hints.min_width   = width;
-			size_hints.min_height  = height;
-			XSetWMNormalHints( display, win, &size_hints );
-			wm_hints.initial_state = NormalState;
-			wm_hints.input         = True; 
-			wm_hints.flags         = StateHint | InputHint;
-			XSetWMHints( display, win, &wm_hints );
-			class_hints.res_name   = name; 
-			class_hints.res_class  = name; 
-			XSetClassHint( display, win, &class_hints );
-			wmDeleteWindow = XInternAtom(display, "WM_DELETE_WINDOW", False);
-			XSetWMProtocols(display, win, &wmDeleteWindow, 1);
+static void *
+lcd_thread(void *arg)
+{
+	ARMul_State *state = arg;
+	lcd_config_t cfg;
+	unsigned gen = 0;
+	struct pollfd pfd;
+
+	while (!__atomic_load_n(&closing, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&config_lock);
+		cfg = config;
+		pthread_mutex_unlock(&config_lock);
+		if (!display || cfg.gen != gen) {
+			gen = cfg.gen;
+			x_configure(&cfg);
 		}
-		XMapWindow( display, win );
-		gc = XCreateGC(display,win,0,&values);
-		XSetGraphicsExposures(display, gc, True);
-		XAutoRepeatOff(display);
-		ximage = XCreateImage(display, visual, sd, ZPixmap, 0, (char*)xdata, width, height, 8, 0);
+		x_events();
+		__atomic_store_n(&shown, disp_visible, __ATOMIC_RELEASE);
+		if (disp_enabled && disp_visible)
+			x_refresh(state);
 		XFlush(display);
 
-		for(i = 0; i < img_size; i++)
-			*(unsigned long *)(((unsigned long)xdata) + i * pixel_size) = color[0];
-
-		memset(keyboard, 0, sizeof(keyboard));
-		memset(keymap, 0, sizeof(keymap));
-
-		keymap[XKC_ESC]  = 23; /* Esc */
-		keymap[XKC_AE01] = 6;  /* 1 */
-		keymap[XKC_AE02] = 5;  /* 2 */
-		keymap[XKC_AE03] = 4;  /* 3 */
-		keymap[XKC_AE04] = 3;  /* 4 */
-		keymap[XKC_AE05] = 2;  /* 5 */
-		keymap[XKC_AE06] = 1;  /* 6 */
-		keymap[XKC_AE07] = 14; /* 7 */
-		keymap[XKC_AE08] = 13; /* 8 */
-		keymap[XKC_AE09] = 12; /* 9 */
-		keymap[XKC_AE10] = 11; /* 0 */
-		keymap[XKC_BKSP] = 10; /* Del */
-
-		keymap[XKC_AD01] = 22; /* q */
-		keymap[XKC_AD02] = 21; /* w */
-		keymap[XKC_AD03] = 20; /* e */
-		keymap[XKC_AD04] = 19; /* r */
-		keymap[XKC_AD05] = 18; /* t */
-		keymap[XKC_AD06] = 17; /* y */
-		keymap[XKC_AD07] = 30; /* u */
-		keymap[XKC_AD08] = 29; /* i */
-		keymap[XKC_AD09] = 28; /* o */
-		keymap[XKC_AD10] = 27; /* p */
-		keymap[XKC_RTRN] = 25; /* Enter */
-
-		keymap[XKC_TAB]  = 38; /* Tab */
-		keymap[XKC_AC01] = 37; /* a */
-		keymap[XKC_AC02] = 36; /* s */
-		keymap[XKC_AC03] = 35; /* d */
-		keymap[XKC_AC04] = 34; /* f */
-		keymap[XKC_AC05] = 33; /* g */
-		keymap[XKC_AC06] = 46; /* h */
-		keymap[XKC_AC07] = 45; /* j */
-		keymap[XKC_AC08] = 44; /* k */
-		keymap[XKC_AC09] = 26; /* l */
-		keymap[XKC_AC10] = 9;  /* : */
-
-		keymap[XKC_LFSH] = 55; /* Left Shift */
-		keymap[XKC_AB01] = 54; /* z */
-		keymap[XKC_AB02] = 53; /* x */
-		keymap[XKC_AB03] = 52; /* c */
-		keymap[XKC_AB04] = 51; /* v */
-		keymap[XKC_AB05] = 50; /* b */
-		keymap[XKC_AB06] = 49; /* n */
-		keymap[XKC_AB07] = 43; /* m */
-		keymap[XKC_AC11] = 42; /* ' */
-		keymap[XKC_UP]   = 60; /* Up */
-		keymap[XKC_RTSH] = 63; /* Right Shift */
-
-		keymap[XKC_LCTL] = 39; /* Ctrl */
-		keymap[XKC_LWIN] = 47; /* Fn */
-		keymap[XKC_LALT] = 31; /* Menu */
-		keymap[XKC_SPCE] = 61; /* space */
-		keymap[XKC_AB10] = 59; /* ? */
-		keymap[XKC_LEFT] = 58; /* Left */
-		keymap[XKC_DOWN] = 41; /* Down */
-		keymap[XKC_RGHT] = 47; /* Right */
+		pfd.fd = ConnectionNumber(display);
+		pfd.events = POLLIN;
+		poll(&pfd, 1, FRAME_MS);
+	}
+	if (ximage)
+		XDestroyImage(ximage);
+	ximage = 0;
+	if (display)
+		XCloseDisplay(display);
+	display = 0;
+	win = 0;
+	disp_enabled = 0;
+	return NULL;
+}
+
+static void
+start_thread(ARMul_State *state)
+{
+	if (!ring_init(&events, EVENT_SLOTS, sizeof(lcd_event_t))) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 ); 
+	}
+	memset(keyboard, 0, sizeof(keyboard));
+	if (pthread_create(&thread, NULL, lcd_thread, state)) {
+		fprintf( stderr, "Armulator: can't start display thread\n");
+		exit( -1 ); 
+	}
+	thread_started = 1;
+}
+
+/* Framebuffer writes below io.lcd_limit are passed to lcd_write().
+   While nothing would be displayed the limit is zero, so
+   dram_write_word() skips the LCD entirely. */
+static void
+update_limit(ARMul_State *state)
+{
+	if (state->lcd.enabled && thread_started && !state->lcd.hidden)
+		state->io.lcd_limit = LCD_BASE + state->lcd.line_bytes * state->lcd.height;
+	else
+		state->io.lcd_limit = 0;
+}
+
+/* Guest input from the display passes through armreplay.c as six
+   bytes an event: type, code, then x and y as 16 bits little-endian. */
+#define EV_BYTES	6
+#define EV_BATCH	64
+
+static void
+apply_event(ARMul_State *state, const unsigned char *p)
+{
+	int code = p[1];
+	int x = (short)(p[2] | (p[3] << 8));
+	int y = (short)(p[4] | (p[5] << 8));
+
+	switch (p[0])
+	{
+		case LCD_EV_KEYDOWN:
+			keyboard[(code >> 3) & 7] |= (1 << (code & 7));
+		break;
+
+		case LCD_EV_KEYUP:
+			keyboard[(code >> 3) & 7] &= ~(1 << (code & 7));
+		break;
+
+		case LCD_EV_PENDOWN:
+		case LCD_EV_PENMOVE:
+			ssi_pen(state, 1, x, y);
+		break;
+
+		case LCD_EV_PENUP:
+			ssi_pen(state, 0, x, y);
+		break;
 	}
-	XPutImage(display, win, gc, ximage, 0, 0, 0, 0, width, height);
-	lcd_enabled = 1;
 }
 
+/* Called on the CPU thread: apply the input the display thread has
+   queued up.  Never touches X.  This is an input point for
+   armreplay.c even without a display, as playing has none. */
 void
-lcd_disable(ARMul_State *state)
+lcd_cycle(ARMul_State *state)
 {
-	if(win)
+	unsigned char buf[EV_BATCH * EV_BYTES];
+	lcd_event_t ev;
+	int n = 0, i;
+
+	if (thread_started && !REPLAY_PLAYING(state) &&
+	    state->lcd.hidden == __atomic_load_n(&shown, __ATOMIC_ACQUIRE))
+	{
+		state->lcd.hidden = !state->lcd.hidden;
+		update_limit(state);
+		/* writes were not tracked while hidden: repaint everything once */
+		if (!state->lcd.hidden)
+			mark_all_dirty();
+	}
+	while (thread_started && !REPLAY_PLAYING(state) &&
+	       n < sizeof(buf) && ring_get(&events, &ev))
 	{
-		XSetForeground(display, gc, cr2pv(0x00808080));
-		XFillRectangle(display, win, gc, 0, 0, lcd_width, lcd_height);
+		/* clipped: the pen position is clamped anyway */
+		ev.x = ev.x < -32768 ? -32768 : ev.x > 32767 ? 32767 : ev.x;
+		ev.y = ev.y < -32768 ? -32768 : ev.y > 32767 ? 32767 : ev.y;
+		buf[n++] = ev.type;
+		buf[n++] = ev.code;
+		buf[n++] = ev.x;
+		buf[n++] = ev.x >> 8;
+		buf[n++] = ev.y;
+		buf[n++] = ev.y >> 8;
+	}
+	n = replay_input(state, REPLAY_LCD, buf, n, sizeof(buf));
+	for (i = 0; i + EV_BYTES <= n; i += EV_BYTES)
+		apply_event(state, buf + i);
+}
+
+void
+lcd_enable(ARMul_State *state, int width, int height, int depth)
+{
+	if (height > MAX_LINES) {
+		fprintf(stderr, "Armulator: LCD height %d clipped to %d\n", height, MAX_LINES);
+		height = MAX_LINES;
 	}
-	lcd_enabled = 0;
+	state->lcd.width = width;
+	state->lcd.height = height;
+	state->lcd.depth = depth;
+	state->lcd.line_bytes = width * depth / 8;
+
+	pthread_mutex_lock(&config_lock);
+	config.width = width;
+	config.height = height;
+	config.depth = depth;
+	config.pallsw = state->io.pallsw;
+	config.palmsw = state->io.palmsw;
+	config.enabled = 1;
+	config.gen++;
+	pthread_mutex_unlock(&config_lock);
+
+	if (!thread_started && !state->headless)
+		start_thread(state);
+	state->lcd.enabled = 1;
+	update_limit(state);
+}
+
+void
+lcd_disable(ARMul_State *state)
+{
+	state->lcd.enabled = 0;
+	update_limit(state);
+	if (!thread_started) return;
+	pthread_mutex_lock(&config_lock);
+	config.enabled = 0;
+	config.gen++;
+	pthread_mutex_unlock(&config_lock);
+}
+
+/* Stop the display thread and close the window, before the machine
+   it reads goes; the next machine to enable the LCD opens another. */
+void
+lcd_close(ARMul_State *state)
+{
+	if (!thread_started)
+		return;
+	__atomic_store_n(&closing, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	closing = 0;
+	thread_started = 0;
+	disp_visible = shown = 1;
+	state->lcd.hidden = 0;
+	ring_free(&events);
+	update_limit(state);
 }
 
 void
 lcd_write(ARMul_State *state, ARMword addr, ARMword data)
 {
-	ARMword offset, pal;
-	int pixnum, x, y, bit;
+	ARMword offset;
+	ARMword line;
 
-	if(!ximage) return;
-	
+	/* only reached below io.lcd_limit, i.e. while displayed */
 	offset = (addr & ~3) - LCD_BASE;
-	pixnum = offset * 8 / lcd_depth;
-	x = pixnum % lcd_width;
-	y = pixnum / lcd_width;
-	
-	for (bit = 0; bit < 32; bit += lcd_depth, pixnum++) {
-		int pix = (data >> bit) % (1 << lcd_depth);
-		pal = (pix & 8) ? state->io.palmsw : state->io.pallsw;
-		*(unsigned short *)(((unsigned long)xdata) + pixnum * 2) = color[(pal >> (pix * 4)) & 15];
+	line = offset / state->lcd.line_bytes;
+	__atomic_store_n(&dirty[line], 1, __ATOMIC_RELEASE);
+	if (state->lcd.line_bytes & 3) {
+		/* narrow monochrome lines: a word can cover two */
+		line = (offset + 3) / state->lcd.line_bytes;
+		if (line < MAX_LINES)
+			__atomic_store_n(&dirty[line], 1, __ATOMIC_RELEASE);
 	}
-	XPutImage(display, win, gc, ximage, x, y, x, y, 32 / lcd_depth, 1);
 }
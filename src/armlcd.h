@@ -22,8 +22,22 @@
 #define _ARMLCD_H_
 
 
+#define LCD_BASE	0xC0000000
+#define GREY_LEVELS	16
+
+/* The CPU-side view of the LCD controller; the display itself lives
+   on its own thread in armlcd.c. */
+
+typedef struct lcd_state_t {
+	int		width, height, depth;	/* last programmed geometry */
+	int		enabled;
+	int		hidden;			/* window unmapped or obscured */
+	ARMword		line_bytes;
+} lcd_state_t;
+
 void	lcd_enable(ARMul_State *state, int width, int height, int depth);
 void	lcd_disable(ARMul_State *state);
+void	lcd_close(ARMul_State *state);
 void	lcd_write(ARMul_State *state, ARMword addr, ARMword data);
 void	lcd_cycle(ARMul_State *state);
 void	lcd_dirty(ARMul_State *state, ARMword addr);
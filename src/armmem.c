@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <string.h>
 #include <fcntl.h>
 #include "armdefs.h"
 
@@ -50,7 +51,7 @@ static mem_bank_t mem_banks[16] = {
 	{ _read_word,		_write_word },		/* 0x10000000 */
 	{ _read_word,		_write_word },		/* 0x20000000 */
 	{ _read_word,		_write_word },		/* 0x30000000 */
-	{ _read_word,		_write_word },		/* 0x40000000 */
+	{ cf_read_word,		cf_write_word },	/* 0x40000000 */
 	{ _read_word,		_write_word },		/* 0x50000000 */
 	{ sram_read_word,	sram_write_word },	/* 0x60000000 */
 	{ boot_read_word,	boot_write_word },	/* 0x70000000 */
@@ -64,59 +65,118 @@ static mem_bank_t mem_banks[16] = {
 	{ _read_word,		_write_word }		/* 0xF0000000 */
 };
 
-const char *rom_filenames[ROM_BANKS] = {"./bootsim.rom"};
-
 
 void
 mem_reset(ARMul_State *state)
 {
-	FILE *f;
-	char *p;
-	long s;
-	int bank;
-
 	free(state->mem.dram);
 	state->mem.dram = calloc(1, 1 << DRAM_BITS);
 	if (!state->mem.dram) {
 		fprintf(stderr, "Couldn't allocate memory for dram\n");
 		exit(1);
 	}
-	for (bank = 0; bank < ROM_BANKS; bank++) {
+	free(state->mem.dirty);
+	state->mem.dirty = malloc(DRAM_PAGES);
+	if (!state->mem.dirty) {
+		fprintf(stderr, "Couldn't allocate memory for dram\n");
+		exit(1);
+	}
+	/* cleared DRAM differs from whatever was saved before */
+	memset(state->mem.dirty, MEM_DIRTY, DRAM_PAGES);
+	state->mem.watch = ~0;
+	cf_reset(state);
+}
+
+static void
+rom_unload(ARMul_State *state, int bank)
+{
+	if (!state->mem.rom_shared[bank])
 		free(state->mem.rom[bank]);
-		state->mem.rom[bank] = NULL;
-		state->mem.rom_size[bank] = 0;
-		f = fopen(rom_filenames[bank], "r");
-		if (!f) {
-			perror(rom_filenames[bank]);
-			fprintf(stderr, "Couldn't open boot ROM %s\n", rom_filenames[bank]);
-			exit(1);
-		}
-		if (fseek(f, 0L, SEEK_END)) {
-			fprintf(stderr, "Couldn't seek to end of rom file\n");
-			exit(1);
-		}
-		state->mem.rom_size[bank] = ftell(f);
-		state->mem.rom[bank] = malloc(state->mem.rom_size[bank]);
-		if (!state->mem.rom[bank]) {
-			fprintf(stderr, "Couldn't allocate memory for rom\n");
-			exit(1);
-		}
-		rewind(f);
-		p = (char *)state->mem.rom[bank];
-		s = state->mem.rom_size[bank];
-		while (!feof(f) && (s > 0)) {
-			size_t r;
-			
-			r = fread(p, 1, s, f);
-			p += r;
-			s -= r;
-			if (ferror(f)) {
-				perror(rom_filenames[bank]);
-				exit(1);
-			}
-		}
+	state->mem.rom[bank] = NULL;
+	state->mem.rom_size[bank] = 0;
+	state->mem.rom_shared[bank] = 0;
+}
+
+/* The ROM survives a reset, so it is loaded on its own: a copy of
+   size bytes from data, in place of whatever bank held before. */
+void
+mem_load_rom(ARMul_State *state, int bank, const void *data, long size)
+{
+	rom_unload(state, bank);
+	/* whole words, as the bank reads them */
+	state->mem.rom[bank] = calloc(1, (size + 3) & ~3L);
+	if (!state->mem.rom[bank]) {
+		fprintf(stderr, "Couldn't allocate memory for rom\n");
+		exit(1);
+	}
+	memcpy(state->mem.rom[bank], data, size);
+	state->mem.rom_size[bank] = size;
+}
+
+int
+mem_load_rom_file(ARMul_State *state, int bank, const char *filename)
+{
+	FILE *f;
+	char *p;
+	long size, s;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		perror(filename);
+		fprintf(stderr, "Couldn't open boot ROM %s\n", filename);
+		return -1;
+	}
+	if (fseek(f, 0L, SEEK_END) || (size = ftell(f)) < 0) {
+		fprintf(stderr, "Couldn't seek to end of rom file\n");
 		fclose(f);
+		return -1;
+	}
+	p = malloc(size ? size : 1);
+	if (!p) {
+		fprintf(stderr, "Couldn't allocate memory for rom\n");
+		exit(1);
+	}
+	rewind(f);
+	for (s = 0; !feof(f) && s < size; ) {
+		s += fread(p + s, 1, size - s, f);
+		if (ferror(f)) {
+			perror(filename);
+			fclose(f);
+			free(p);
+			return -1;
+		}
 	}
+	fclose(f);
+	mem_load_rom(state, bank, p, s);
+	free(p);
+	return 0;
+}
+
+/* The ROM without a copy, for many machines from one image: data is
+   read in whole words, so it must be word aligned and readable up to
+   the next word, and it must outlast the machine.  Nothing writes to
+   it, so a read-only mapping of the file will do. */
+void
+mem_share_rom(ARMul_State *state, int bank, const void *data, long size)
+{
+	rom_unload(state, bank);
+	state->mem.rom[bank] = (ARMword *)data;
+	state->mem.rom_size[bank] = size;
+	state->mem.rom_shared[bank] = 1;
+}
+
+/* Give back DRAM and the ROM, for a machine that is done with. */
+void
+mem_free(ARMul_State *state)
+{
+	int bank;
+
+	free(state->mem.dram);
+	free(state->mem.dirty);
+	state->mem.dram = NULL;
+	state->mem.dirty = NULL;
+	for (bank = 0; bank < ROM_BANKS; bank++)
+		rom_unload(state, bank);
 }
 
 ARMword
@@ -182,7 +242,12 @@ void
 dram_write_word(ARMul_State *state, ARMword addr, ARMword data)
 {
 	if(IS_ADDR_VALID(addr))	{
-		state->mem.dram[__phys_to_virt(addr) >> 2] = data;
+		ARMword virt = __phys_to_virt(addr);
+
+		state->mem.dram[virt >> 2] = data;
+		state->mem.dirty[virt >> DRAM_PAGE_BITS] = MEM_DIRTY;
+		if ((virt >> 2) == state->mem.watch)
+			state->mem.watch_hit = state->NumInstrs;
 		if (addr < state->io.lcd_limit) {
 			lcd_write(state, addr, data);
 		}
@@ -193,6 +258,59 @@ dram_write_word(ARMul_State *state, ARMword addr, ARMword data)
 	}
 }
 
+/* Bulk copies between DRAM and a byte buffer in guest (little-endian)
+   order, for devices that do DMA.  addr must be word aligned. */
+
+void
+dram_copy_in(ARMul_State *state, ARMword addr, const unsigned char *src, long len)
+{
+	for (; len >= 4; len -= 4, addr += 4, src += 4) {
+		ARMword data = src[0] | (src[1] << 8) | (src[2] << 16) |
+			       ((ARMword)src[3] << 24);
+		ARMword virt = __phys_to_virt(addr);
+
+		state->mem.dram[virt >> 2] = data;
+		state->mem.dirty[virt >> DRAM_PAGE_BITS] = MEM_DIRTY;
+		if ((virt >> 2) == state->mem.watch)
+			state->mem.watch_hit = state->NumInstrs;
+		if (addr < state->io.lcd_limit) {
+			lcd_write(state, addr, data);
+		}
+	}
+}
+
+void
+dram_copy_out(ARMul_State *state, ARMword addr, unsigned char *dst, long len)
+{
+	for (; len >= 4; len -= 4, addr += 4, dst += 4) {
+		ARMword data = state->mem.dram[__phys_to_virt(addr) >> 2];
+
+		dst[0] = data;
+		dst[1] = data >> 8;
+		dst[2] = data >> 16;
+		dst[3] = data >> 24;
+	}
+}
+
+/* Forget which pages were written, once DRAM matches a snapshot (bits
+   MEM_DIRTY_SNAP) or a checkpoint (MEM_DIRTY_REVERSE). */
+void
+mem_clean(ARMul_State *state, int bits)
+{
+	long page;
+
+	for (page = 0; page < DRAM_PAGES; page++)
+		state->mem.dirty[page] &= ~bits;
+}
+
+/* A DRAM address as the offset into state->mem.dram it lands on, with
+   the aliasing above. */
+ARMword
+dram_offset(ARMword addr)
+{
+	return __phys_to_virt(addr);
+}
+
 
 ARMword
 rom_read_word(ARMul_State *state, ARMword addr)
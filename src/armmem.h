@@ -23,18 +23,37 @@
 
 
 #define DRAM_BITS       (23)                    /* 8MB of DRAM */
+#define DRAM_PAGE_BITS	(12)			/* 4KB pages for dirty tracking */
+#define DRAM_PAGES	(1 << (DRAM_BITS - DRAM_PAGE_BITS))
+#define MEM_DIRTY_SNAP	(1)			/* for armsnap.c's deltas */
+#define MEM_DIRTY_REVERSE (2)			/* for armreverse.c */
+#define MEM_DIRTY	(MEM_DIRTY_SNAP | MEM_DIRTY_REVERSE)
 #define ROM_BANKS	(1)
 #define ROM_BITS	(28)			/* 0x10000000 each bank */
+#define ROM_FILE	"./bootsim.rom"		/* bank 0 for psion.c */
 
 typedef struct mem_state_t {
 	ARMword *	dram;
+	unsigned char *	dirty;			/* per page: MEM_DIRTY_* not cleaned */
+	ARMword		watch;			/* dram[] index to watch, or ~0 */
+	unsigned long long watch_hit;		/* NumInstrs when last written */
 	ARMword *	rom[ROM_BANKS];
 	long		rom_size[ROM_BANKS];
+	int		rom_shared[ROM_BANKS];	/* rom[] is the caller's */
 } mem_state_t;
 
 void	mem_reset(ARMul_State *state);
+void	mem_load_rom(ARMul_State *state, int bank, const void *data, long size);
+int	mem_load_rom_file(ARMul_State *state, int bank, const char *filename);
+void	mem_share_rom(ARMul_State *state, int bank, const void *data, long size);
+void	mem_free(ARMul_State *state);
 ARMword	mem_read_word(ARMul_State *state, ARMword addr);
 void	mem_write_word(ARMul_State *state, ARMword addr, ARMword data);
+ARMword	dram_read_word(ARMul_State *state, ARMword addr);
+void	dram_copy_in(ARMul_State *state, ARMword addr, const unsigned char *src, long len);
+void	dram_copy_out(ARMul_State *state, ARMword addr, unsigned char *dst, long len);
+void	mem_clean(ARMul_State *state, int bits);
+ARMword	dram_offset(ARMword addr);
 void	dump_dram(ARMul_State *state);
 
 
@@ -40,6 +40,7 @@ mmu_reset(ARMul_State *state)
 	state->mmu.domain_access_control = 0xDEADC0DE;
 	state->mmu.fault_status = 0;
 	state->mmu.fault_address = 0;
+	state->mmu.victim = MMU_VICTIM_SEED;
 	mmu_cache_invalidate(state);
 	mmu_tlb_invalidate_all(state);
 }
@@ -474,6 +475,7 @@ mmu_cache_alloc(ARMul_State *state, ARMword addr)
 {
 	int bank, line;
 	cache_line_t *cache;
+	ARMword victim;
 	
 	line = (addr >> 4) & (CACHE_LINES - 1);
 	cache = state->mmu.cache[line];
@@ -484,7 +486,13 @@ mmu_cache_alloc(ARMul_State *state, ARMword addr)
 		cache++;
 	}
 	cache -= CACHE_BANKS;		/* back to bank 0 */
-	cache += rand() % CACHE_BANKS;	/* choose a random bank */
+	/* choose a random bank, from state so every run chooses alike */
+	victim = state->mmu.victim;
+	victim ^= (victim << 13) & 0xffffffff;
+	victim ^= victim >> 17;
+	victim ^= (victim << 5) & 0xffffffff;
+	state->mmu.victim = victim;
+	cache += victim % CACHE_BANKS;
 	return cache;
 }
 
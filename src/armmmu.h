@@ -62,6 +62,7 @@ typedef enum mmu_regnum_t {
 #define CACHE_SIZE	(8 * 1024)			/* 8 Kbyte cache */
 #define CACHE_BANKS	(4)				/* 4-way set assoc */
 #define CACHE_LINES	(CACHE_SIZE / CACHE_BANKS / 16)	/* 4 words per line */
+#define MMU_VICTIM_SEED	(0x2545F491)			/* any nonzero value */
 #define TLB_ENTRIES	(64)
 
 
@@ -132,6 +133,7 @@ typedef struct mmu_state_t {
 	tlb_entry_t	tlb[TLB_ENTRIES];
 	int		tlb_cycle;
 	ARMword		last_domain;
+	ARMword		victim;			/* xorshift state for cache refills */
 
 } mmu_state_t;
 
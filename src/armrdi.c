@@ -847,16 +847,24 @@ static int RDI_info(unsigned type, ARMword *arg1, ARMword *arg2)
     TracePrint((state, "RDI_Info_Cycles\n"));
     arg1[0] = 0;
     arg1[1] = state->NumInstrs;
-    arg1[2] = 0;
+#ifdef CYCLE_STATS
+    arg1[2] = state->NumScycles >> 32;
     arg1[3] = state->NumScycles;
-    arg1[4] = 0;
+    arg1[4] = state->NumNcycles >> 32;
     arg1[5] = state->NumNcycles;
-    arg1[6] = 0;
+    arg1[6] = state->NumIcycles >> 32;
     arg1[7] = state->NumIcycles;
-    arg1[8] = 0;
+    arg1[8] = state->NumCcycles >> 32;
     arg1[9] = state->NumCcycles;
-    arg1[10] = 0;
+    arg1[10] = state->NumFcycles >> 32;
     arg1[11] = state->NumFcycles;
+#else
+    /* no breakdown: report everything as S cycles */
+    arg1[2] = state->Cycles >> 32;
+    arg1[3] = state->Cycles;
+    arg1[4] = arg1[5] = arg1[6] = arg1[7] = 0;
+    arg1[8] = arg1[9] = arg1[10] = arg1[11] = 0;
+#endif
     return RDIError_NoError;
 
   case RDIErrorP:
@@ -0,0 +1,163 @@
+/*
+    armrec.c - Incremental recording of the LCD.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "armdefs.h"
+#include "armrec.h"
+
+#define REC_FRAME_CYCLES	(state->cpu_clock / REC_FRAME_HZ)
+
+
+static FILE		*rec_file = NULL;
+static unsigned char	*prev = NULL;		/* last frame we emitted */
+static unsigned char	*cur = NULL;
+static long		fb_size;
+static int		width, height, depth;	/* of the frames in prev */
+static int		lcd_on;
+static ARMword		pallsw, palmsw;
+static unsigned long long rec_cycles;		/* guest time since rec_start */
+static unsigned long long rec_start, last_frame;
+
+
+static void
+put_le(unsigned long long v, int bytes)
+{
+	while (bytes--) {
+		putc(v & 0xff, rec_file);
+		v >>= 8;
+	}
+}
+
+int
+rec_open(ARMul_State *state, const char *filename)
+{
+	rec_file = fopen(filename, "wb");
+	if (!rec_file) {
+		perror(filename);
+		return -1;
+	}
+	fwrite(REC_MAGIC, 1, 8, rec_file);
+	width = height = depth = 0;
+	lcd_on = 0;
+	rec_cycles = 0;
+	rec_start = ARMul_Time(state);
+	last_frame = rec_start - REC_FRAME_CYCLES;
+	return 0;
+}
+
+void
+rec_close(ARMul_State *state)
+{
+	if (!rec_file) {
+		return;
+	}
+	fclose(rec_file);
+	rec_file = NULL;
+	free(prev);
+	free(cur);
+	prev = cur = NULL;
+}
+
+/* Called on every display refresh tick; emits at most REC_FRAME_HZ
+   frames per guest second, and only the scanlines that changed. */
+void
+rec_frame(ARMul_State *state)
+{
+	unsigned long long now;
+	long line_bytes;
+	int y, nlines, full = 0;
+
+	/* history being replayed was recorded the first time */
+	if (!rec_file || REVERSE_REPLAYING(state)) {
+		return;
+	}
+	now = ARMul_Time(state);
+	rec_cycles = now - rec_start;
+	if (now - last_frame < REC_FRAME_CYCLES) {
+		return;
+	}
+	last_frame = now;
+
+	if (!state->lcd.enabled) {
+		if (lcd_on) {
+			putc(REC_OFF, rec_file);
+			put_le(rec_cycles, 8);
+			lcd_on = 0;
+		}
+		return;
+	}
+	if (state->lcd.width != width || state->lcd.height != height ||
+	    state->lcd.depth != depth || !prev) {
+		width = state->lcd.width;
+		height = state->lcd.height;
+		depth = state->lcd.depth;
+		fb_size = shot_fb_size(state);
+		free(prev);
+		free(cur);
+		prev = malloc(fb_size);
+		cur = malloc(fb_size);
+		if (!prev || !cur) {
+			fprintf(stderr, "Couldn't allocate memory for recording\n");
+			rec_close(state);
+			return;
+		}
+		putc(REC_GEOMETRY, rec_file);
+		put_le(width, 2);
+		put_le(height, 2);
+		put_le(depth, 1);
+		full = 1;
+	}
+	line_bytes = fb_size / height;
+	shot_read_fb(state, cur);
+
+	nlines = 0;
+	for (y = 0; y < height; y++) {
+		if (full || memcmp(cur + y * line_bytes, prev + y * line_bytes, line_bytes))
+			nlines++;
+	}
+	if (!nlines && lcd_on && pallsw == state->io.pallsw &&
+	    palmsw == state->io.palmsw) {
+		return;
+	}
+	lcd_on = 1;
+	pallsw = state->io.pallsw;
+	palmsw = state->io.palmsw;
+
+	putc(REC_FRAME, rec_file);
+	put_le(rec_cycles, 8);
+	put_le(pallsw, 4);
+	put_le(palmsw, 4);
+	put_le(nlines, 2);
+	for (y = 0; y < height; y++) {
+		unsigned char *line = cur + y * line_bytes;
+
+		if (full || memcmp(line, prev + y * line_bytes, line_bytes)) {
+			put_le(y, 2);
+			fwrite(line, 1, line_bytes, rec_file);
+		}
+	}
+	/* the frame just written becomes the reference */
+	{
+		unsigned char *t = prev;
+
+		prev = cur;
+		cur = t;
+	}
+}
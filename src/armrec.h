@@ -0,0 +1,53 @@
+/*
+    armrec.h - Incremental recording of the LCD.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMREC_H_
+#define _ARMREC_H_
+
+
+/* Stream format, all integers little-endian:
+
+	"PSIMREC" 0x01			file header
+
+   followed by records, each introduced by a type byte:
+
+	REC_GEOMETRY	u16 width, u16 height, u8 depth
+	REC_FRAME	u64 cycles, u32 pallsw, u32 palmsw, u16 nlines,
+			then nlines x { u16 y, width*depth/8 bytes }
+	REC_OFF		u64 cycles
+
+   A frame carries only the scanlines that changed since the previous
+   frame; the first frame after REC_GEOMETRY carries all of them.
+   Scanline bytes are in guest order, pixel 0 in the low bits.  A
+   refresh with no changed lines and the same palette emits nothing. */
+
+#define REC_MAGIC	"PSIMREC\001"
+#define REC_GEOMETRY	1
+#define REC_FRAME	2
+#define REC_OFF		3
+
+#define REC_FRAME_HZ	50		/* maximum frames per guest second */
+
+
+int	rec_open(ARMul_State *state, const char *filename);
+void	rec_frame(ARMul_State *state);
+void	rec_close(ARMul_State *state);
+
+
+#endif	/* _ARMREC_H_ */
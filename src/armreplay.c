@@ -0,0 +1,341 @@
+/*
+    armreplay.c - Recording and replaying the machine's input.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "armdefs.h"
+
+
+static void
+put_le(FILE *f, unsigned long long v, int bytes)
+{
+	while (bytes--) {
+		putc(v & 0xff, f);
+		v >>= 8;
+	}
+}
+
+static void
+put_varint(FILE *f, unsigned long long v)
+{
+	while (v >= 0x80) {
+		putc((v & 0x7f) | 0x80, f);
+		v >>= 7;
+	}
+	putc(v, f);
+}
+
+static int
+get_le(FILE *f, unsigned long long *v, int bytes)
+{
+	int shift, c;
+
+	*v = 0;
+	for (shift = 0; shift < bytes * 8; shift += 8) {
+		if ((c = getc(f)) == EOF)
+			return -1;
+		*v |= (unsigned long long)c << shift;
+	}
+	return 0;
+}
+
+static int
+get_varint(FILE *f, unsigned long long *v)
+{
+	int shift, c;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		if ((c = getc(f)) == EOF)
+			return -1;
+		*v |= (unsigned long long)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+
+/* Recording */
+
+static void
+put_entry(ARMul_State *state, int source, const unsigned char *buf, int len)
+{
+	replay_state_t *r = &state->replay;
+	unsigned long long cycles = ARMul_Time(state);
+
+	putc(source, r->f);
+	put_varint(r->f, r->points - r->last_points);
+	put_varint(r->f, cycles - r->last_cycles);
+	put_varint(r->f, len);
+	if (len)
+		fwrite(buf, 1, len, r->f);
+	r->last_points = r->points;
+	r->last_cycles = cycles;
+	/* the run may not end tidily: that may be why it's recorded */
+	if (fflush(r->f) || ferror(r->f)) {
+		perror("Replay: can't write the log");
+		fclose(r->f);
+		r->f = NULL;
+		r->mode = REPLAY_OFF;
+	}
+}
+
+
+/* Playing */
+
+static unsigned replay_end(ARMul_State *state);
+
+static void
+diverged(ARMul_State *state)
+{
+	fprintf(stderr, "Replay: the run left the log at cycle %llu, "
+		"input point %llu\n", ARMul_Time(state), state->replay.points);
+	state->replay.mode = REPLAY_OFF;
+	script_quit(state, 1);
+}
+
+/* Read the header of the next entry.  Its bytes are left for
+   replay_input() to read once the run gets there. */
+static void
+next_entry(ARMul_State *state)
+{
+	replay_state_t *r = &state->replay;
+	unsigned long long points, cycles, len;
+	int c;
+
+	r->entry_pos = ftell(r->f);
+	c = getc(r->f);
+	if (c == EOF || get_varint(r->f, &points) ||
+	    get_varint(r->f, &cycles) || get_varint(r->f, &len)) {
+		/* recording never finished: no more input, and no end */
+		if (!r->live)
+			fprintf(stderr, "Replay: the log stops short at cycle "
+				"%llu; running on\n", r->last_cycles);
+		r->source = REPLAY_END;
+		r->at_points = ~0ULL;
+		return;
+	}
+	r->source = c;
+	r->at_points = r->last_points + points;
+	r->at_cycles = r->last_cycles + cycles;
+	r->len = len;
+	if (r->source == REPLAY_END)
+		ARMul_ScheduleEvent(state, r->at_cycles > ARMul_Time(state) ?
+				    r->at_cycles - ARMul_Time(state) : 0,
+				    replay_end);
+}
+
+/* The recording stopped here: so does the run, once it has been
+   through the same input points. */
+static unsigned
+replay_end(ARMul_State *state)
+{
+	replay_state_t *r = &state->replay;
+
+	if (r->points != r->at_points) {
+		diverged(state);
+		return 0;
+	}
+	if (state->verbose)
+		fprintf(stderr, "Replay: end of the log at cycle %llu\n",
+			ARMul_Time(state));
+	r->mode = REPLAY_OFF;
+	script_quit(state, 0);
+	return 0;
+}
+
+const snap_event_t replay_events[] = {
+	{ NULL, replay_end },
+	{ NULL, NULL }
+};
+
+
+/* Start recording to, or playing from, filename, from the machine as
+   it is now.  Recording with no filename keeps the log in a temporary
+   file. */
+int
+replay_open(ARMul_State *state, const char *filename, int mode)
+{
+	replay_state_t *r = &state->replay;
+	unsigned long long cycles, clock, det;
+	char magic[8];
+
+	r->points = r->last_points = 0;
+	r->last_cycles = ARMul_Time(state);
+	r->live = 0;
+	if (mode == REPLAY_RECORD) {
+		/* readable too, for armreverse.c */
+		r->f = filename ? fopen(filename, "w+b") : tmpfile();
+		if (!r->f) {
+			perror(filename ? filename : "Replay: temporary log");
+			return -1;
+		}
+		fwrite(REPLAY_MAGIC, 1, 8, r->f);
+		put_le(r->f, REPLAY_VERSION, 4);
+		put_le(r->f, ARMul_Time(state), 8);
+		put_le(r->f, state->cpu_clock, 4);
+		put_le(r->f, state->deterministic, 4);
+		if (fflush(r->f)) {
+			perror(filename ? filename : "Replay: temporary log");
+			fclose(r->f);
+			return -1;
+		}
+		r->mode = mode;
+		io_replay_open(state);
+		return 0;
+	}
+
+	r->f = fopen(filename, "rb");
+	if (!r->f) {
+		perror(filename);
+		return -1;
+	}
+	if (fread(magic, 1, 8, r->f) != 8 || memcmp(magic, REPLAY_MAGIC, 8) ||
+	    get_le(r->f, &det, 4) || det != REPLAY_VERSION) {
+		fprintf(stderr, "%s: not an input log of this version\n",
+			filename);
+		fclose(r->f);
+		return -1;
+	}
+	if (get_le(r->f, &cycles, 8) || get_le(r->f, &clock, 4) ||
+	    get_le(r->f, &det, 4)) {
+		fprintf(stderr, "%s: input log is truncated\n", filename);
+		fclose(r->f);
+		return -1;
+	}
+	if (cycles != ARMul_Time(state) || clock != state->cpu_clock ||
+	    !det != !state->deterministic) {
+		fprintf(stderr, "%s: recorded from cycle %llu at %llu Hz%s, "
+			"not cycle %llu at %lu Hz%s\n", filename,
+			cycles, clock, det ? " with -d" : "",
+			ARMul_Time(state), state->cpu_clock,
+			state->deterministic ? " with -d" : "");
+		fclose(r->f);
+		return -1;
+	}
+	r->mode = mode;
+	next_entry(state);
+	io_replay_open(state);
+	return 0;
+}
+
+/* An input point.  buf holds the len bytes that came in from the host
+   for source, and has room for size.  Recording logs them; playing
+   puts what was logged at this point in their place.  Returns how many
+   bytes the guest gets. */
+int
+replay_input(ARMul_State *state, int source, unsigned char *buf,
+	     int len, int size)
+{
+	replay_state_t *r = &state->replay;
+
+	if (r->mode == REPLAY_OFF)
+		return len;
+	r->points++;
+	if (r->mode == REPLAY_RECORD) {
+		if (len)
+			put_entry(state, source, buf, len);
+		return len;
+	}
+
+	if (r->source == REPLAY_END || r->at_points > r->points)
+		return 0;
+	if (r->source != source || r->at_cycles != ARMul_Time(state) ||
+	    r->len > size) {
+		diverged(state);
+		return 0;
+	}
+	len = r->len;
+	if (fread(buf, 1, len, r->f) != len) {
+		fprintf(stderr, "Replay: the log is truncated\n");
+		diverged(state);
+		return 0;
+	}
+	r->last_points = r->at_points;
+	r->last_cycles = r->at_cycles;
+	next_entry(state);
+	return len;
+}
+
+void
+replay_close(ARMul_State *state)
+{
+	replay_state_t *r = &state->replay;
+
+	if (!r->f)
+		return;
+	if (r->mode == REPLAY_RECORD)
+		put_entry(state, REPLAY_END, NULL, 0);
+	if (r->f)
+		fclose(r->f);
+	r->f = NULL;
+	r->mode = REPLAY_OFF;
+}
+
+
+/* Where a recording is now, or how far playing has got, for
+   replay_rewind() to come back to. */
+void
+replay_mark(ARMul_State *state, replay_mark_t *mark)
+{
+	replay_state_t *r = &state->replay;
+
+	mark->points = r->points;
+	mark->last_points = r->last_points;
+	mark->last_cycles = r->last_cycles;
+	mark->pos = r->mode == REPLAY_PLAY ? r->entry_pos : ftell(r->f);
+}
+
+/* Take a log that is being recorded back to mark, and play it from
+   there, the machine having been taken back to the same point. */
+void
+replay_rewind(ARMul_State *state, const replay_mark_t *mark)
+{
+	replay_state_t *r = &state->replay;
+
+	if (!r->f)
+		return;
+	fflush(r->f);
+	fseek(r->f, mark->pos, SEEK_SET);
+	r->points = mark->points;
+	r->last_points = mark->last_points;
+	r->last_cycles = mark->last_cycles;
+	r->mode = REPLAY_PLAY;
+	r->live = 1;
+	ARMul_CancelEvent(state, replay_end);
+	next_entry(state);
+}
+
+/* Record again from here, after replay_rewind(), forgetting whatever
+   the log went on to say. */
+void
+replay_resume(ARMul_State *state)
+{
+	replay_state_t *r = &state->replay;
+
+	if (r->mode != REPLAY_PLAY || !r->live)
+		return;
+	fseek(r->f, r->entry_pos, SEEK_SET);
+	if (ftruncate(fileno(r->f), r->entry_pos))
+		perror("Replay: can't cut the log short");
+	r->mode = REPLAY_RECORD;
+	r->live = 0;
+}
@@ -0,0 +1,100 @@
+/*
+    armreplay.h - Recording and replaying the machine's input.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMREPLAY_H_
+#define _ARMREPLAY_H_
+
+
+/* Given the same start, the emulator only behaves differently from
+   one run to the next because of what the host hands it: bytes on the
+   UART, keys and the pen from the display, and the host's clock for
+   the RTC (without state->deterministic).  Each of these reaches the
+   guest at an input point, a call to replay_input() made at a time
+   that depends on the guest alone.  Recording logs what came in at
+   each point that had any; playing hands the guest the logged input
+   at the same points, ignoring the host, so the run repeats exactly
+   without a display or terminal, and as fast as it can go.
+
+   The log, integers little-endian, varints 7 bits a byte low first:
+
+	"PSIMRPLY", u32 REPLAY_VERSION
+	u64 cycles, u32 cpu_clock, u32 deterministic	the start
+	entries: u8 source, varint points and varint cycles since
+		 the entry before (or the start), varint length, bytes
+	a REPLAY_END entry, with no bytes, where recording stopped
+
+   Playing must start where recording did, from a reset or the same
+   snapshot.  Opening the log reads the host clock at an input point
+   first, so the RTC starts from the recorded time.  If the run reaches an input point at another cycle
+   than the log says, or leaves out one the log has, it has gone its
+   own way: playing says so and quits with status 1.  At the end of
+   the log it quits with status 0.
+
+   armreverse.c keeps a log of its own, without a file name, and
+   takes it back to a replay_mark() to replay history: playing until
+   the run is where it wants, then recording again from there with
+   replay_resume(), which drops what the log had after that point. */
+
+#define REPLAY_MAGIC	"PSIMRPLY"
+#define REPLAY_VERSION	2
+
+#define REPLAY_OFF	0
+#define REPLAY_RECORD	1
+#define REPLAY_PLAY	2
+
+/* Input sources */
+#define REPLAY_UART	1		/* received bytes */
+#define REPLAY_LCD	2		/* display events, see armlcd.c */
+#define REPLAY_RTC	3		/* i64 host clock in RTC ticks, when changed */
+#define REPLAY_END	255
+
+#define REPLAY_PLAYING(state)	((state)->replay.mode == REPLAY_PLAY)
+
+typedef struct replay_state_t {
+	int		mode;
+	FILE *		f;
+	unsigned long long points;		/* input points so far */
+	unsigned long long last_points, last_cycles;	/* last entry */
+	/* playing: the next entry, whose bytes are still to be read */
+	int		source;
+	unsigned long long at_points, at_cycles;
+	unsigned long	len;
+	long		entry_pos;		/* where the next entry starts */
+	int		live;			/* still recording: no END */
+} replay_state_t;
+
+/* A place in the log to take it back to */
+typedef struct replay_mark_t {
+	unsigned long long points, last_points, last_cycles;
+	long		pos;
+} replay_mark_t;
+
+extern const snap_event_t replay_events[];
+
+
+int	replay_open(ARMul_State *state, const char *filename, int mode);
+int	replay_input(ARMul_State *state, int source, unsigned char *buf,
+		     int len, int size);
+void	replay_close(ARMul_State *state);
+void	replay_mark(ARMul_State *state, replay_mark_t *mark);
+void	replay_rewind(ARMul_State *state, const replay_mark_t *mark);
+void	replay_resume(ARMul_State *state);
+
+
+#endif	/* _ARMREPLAY_H_ */
@@ -0,0 +1,695 @@
+/*
+    armreverse.c - Running the machine backwards.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "armdefs.h"
+#include "armemu.h"
+
+#define PAGE_WORDS	(SNAP_PAGE / 4)
+#define PAGE_BYTES	(PAGE_WORDS * (long)sizeof(ARMword))
+
+typedef struct reverse_ckpt_t {
+	unsigned long long instrs, cycles;
+	int		pinned;			/* a history starts here */
+	unsigned char *	devices;		/* from snap_freeze() */
+	long		devices_len;
+	struct EventNode *events;
+	unsigned	nevents;
+	unsigned long	event_seq;
+	script_state_t	script;
+	replay_mark_t	replay;
+	long long	rtc_host;
+	/* DRAM pages written since the checkpoint before, as they were
+	   here: all of them in the oldest */
+	int		npages;
+	unsigned short *pages;			/* ascending */
+	ARMword *	data;
+	/* card sectors first written after this one, as they were here */
+	long		nsectors;
+	unsigned long long *sectors;
+	unsigned char *	sector_data;
+} reverse_ckpt_t;
+
+/* The script, and whether to throttle, as they were before a trip
+   into the past. */
+typedef struct reverse_trip_t {
+	script_state_t	script;
+	int		realtime;
+} reverse_trip_t;
+
+/* The machine as it was before a search of the past, to come back to
+   without replaying: the CPU and devices in a checkpoint with no
+   pages, all of DRAM, and what the card now holds in every sector the
+   checkpoints have kept. */
+typedef struct reverse_home_t {
+	reverse_ckpt_t	ck;
+	ARMword *	dram;
+	unsigned char	dirty[DRAM_PAGES];
+	long		nsectors;
+	unsigned long long *sectors;
+	unsigned char *	sector_data;
+} reverse_home_t;
+
+
+static void *
+alloc(long size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if (!p) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	return p;
+}
+
+static void
+free_ckpt(ARMul_State *state, reverse_ckpt_t *ck)
+{
+	state->reverse.memory -= ck->npages * PAGE_BYTES +
+				 ck->nsectors * CF_SECTOR;
+	free(ck->devices);
+	free(ck->events);
+	free(ck->pages);
+	free(ck->data);
+	free(ck->sectors);
+	free(ck->sector_data);
+	memset(ck, 0, sizeof(*ck));
+}
+
+static void
+forget_sectors(ARMul_State *state)
+{
+	if (state->reverse.card_saved)
+		memset(state->reverse.card_saved, 0,
+		       (state->cf.sectors + 7) / 8);
+}
+
+/* The checkpoint's copy of page, or NULL. */
+static ARMword *
+find_page(reverse_ckpt_t *ck, int page)
+{
+	int lo = 0, hi = ck->npages - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (ck->pages[mid] == page)
+			return ck->data + (long)mid * PAGE_WORDS;
+		if (ck->pages[mid] < page)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+
+/* Dropping checkpoints */
+
+/* Checkpoint i goes; the one after it takes the pages it had that
+   weren't written in between, and the one before takes its card
+   sectors, to be put back after its own. */
+static void
+drop(ARMul_State *state, int i)
+{
+	reverse_state_t *rev = &state->reverse;
+	reverse_ckpt_t *from = &rev->ckpts[i], *to = &rev->ckpts[i + 1];
+	reverse_ckpt_t *before = i ? &rev->ckpts[i - 1] : NULL;
+	int max = from->npages + to->npages, a = 0, b = 0, n = 0;
+	unsigned short *pages = alloc(max * sizeof(*pages));
+	ARMword *data = alloc(max * PAGE_BYTES), *src;
+
+	while (a < from->npages || b < to->npages) {
+		if (b < to->npages &&
+		    (a == from->npages || to->pages[b] <= from->pages[a])) {
+			if (a < from->npages && to->pages[b] == from->pages[a])
+				a++;
+			pages[n] = to->pages[b];
+			src = to->data + (long)b++ * PAGE_WORDS;
+		} else {
+			pages[n] = from->pages[a];
+			src = from->data + (long)a++ * PAGE_WORDS;
+		}
+		memcpy(data + (long)n++ * PAGE_WORDS, src, PAGE_BYTES);
+	}
+	rev->memory += (n - to->npages) * PAGE_BYTES;
+	free(to->pages);
+	free(to->data);
+	to->pages = pages;
+	to->data = data;
+	to->npages = n;
+
+	if (before && from->nsectors) {
+		long total = before->nsectors + from->nsectors;
+
+		before->sectors = realloc(before->sectors,
+					  total * sizeof(*before->sectors));
+		before->sector_data = realloc(before->sector_data,
+					      total * CF_SECTOR);
+		if (!before->sectors || !before->sector_data) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		memcpy(before->sectors + before->nsectors, from->sectors,
+		       from->nsectors * sizeof(*from->sectors));
+		memcpy(before->sector_data + before->nsectors * CF_SECTOR,
+		       from->sector_data, from->nsectors * CF_SECTOR);
+		before->nsectors = total;
+		rev->memory += from->nsectors * CF_SECTOR;
+	}
+	free_ckpt(state, from);
+	memmove(from, from + 1, (rev->nckpts - i - 1) * sizeof(*from));
+	rev->nckpts--;
+	memset(&rev->ckpts[rev->nckpts], 0, sizeof(*from));
+}
+
+/* The checkpoint that can go with least harm: the gap it leaves,
+   over how long ago that was, is smallest.  The oldest and newest
+   stay, and so does one a history starts from, unless there is
+   nothing else. */
+static int
+victim(ARMul_State *state)
+{
+	reverse_state_t *rev = &state->reverse;
+	unsigned long long now = ARMul_Time(state);
+	double cost, best_cost = 0;
+	int i, best = 0;
+
+	for (i = 1; i < rev->nckpts - 1; i++) {
+		if (rev->ckpts[i].pinned)
+			continue;
+		cost = (double)(rev->ckpts[i + 1].cycles - rev->ckpts[i - 1].cycles) /
+			(now - rev->ckpts[i + 1].cycles + rev->cycles);
+		if (!best || cost < best_cost) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+	return best;
+}
+
+
+/* Taking and going back to checkpoints, with the CPU stopped */
+
+/* Everything but DRAM and the card, both ways */
+static void
+freeze(ARMul_State *state, reverse_ckpt_t *ck)
+{
+	ck->instrs = state->NumInstrs;
+	ck->cycles = ARMul_Time(state);
+	ck->devices = snap_freeze(state, &ck->devices_len);
+	ck->nevents = state->EventSet;
+	ck->events = malloc((ck->nevents ? ck->nevents : 1) *
+			    sizeof(*ck->events));
+	if (!ck->events) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	memcpy(ck->events, state->Events, ck->nevents * sizeof(*ck->events));
+	ck->event_seq = state->EventSeq;
+	ck->script = state->script;
+	replay_mark(state, &ck->replay);
+	ck->rtc_host = state->io.rtc_host;
+}
+
+static void
+thaw(ARMul_State *state, const reverse_ckpt_t *ck)
+{
+	if (snap_thaw(state, ck->devices, ck->devices_len) ||
+	    ARMul_EventRoom(state, ck->nevents)) {
+		fprintf(stderr, "Reverse: can't go back to a checkpoint\n");
+		exit(1);
+	}
+	memcpy(state->Events, ck->events, ck->nevents * sizeof(*ck->events));
+	state->EventSet = ck->nevents;
+	state->EventSeq = ck->event_seq;
+	state->Now = state->EventSet ? state->Events[0].when : ~0ULL;
+	state->script = ck->script;
+	state->io.rtc_host = ck->rtc_host;
+	replay_rewind(state, &ck->replay);
+	/* the throttle, left off while replaying */
+	io_realtime(state);
+}
+
+static void
+take_checkpoint(ARMul_State *state, int pinned)
+{
+	reverse_state_t *rev = &state->reverse;
+	reverse_ckpt_t *ck = &rev->ckpts[rev->nckpts++];
+	int page, n = 0;
+
+	ck->pinned = pinned;
+	freeze(state, ck);
+
+	for (page = 0; page < DRAM_PAGES; page++)
+		if (rev->nckpts == 1 ||
+		    (state->mem.dirty[page] & MEM_DIRTY_REVERSE))
+			n++;
+	ck->pages = alloc(n * sizeof(*ck->pages));
+	ck->data = alloc(n * PAGE_BYTES);
+	for (n = 0, page = 0; page < DRAM_PAGES; page++)
+		if (rev->nckpts == 1 ||
+		    (state->mem.dirty[page] & MEM_DIRTY_REVERSE)) {
+			ck->pages[n] = page;
+			memcpy(ck->data + (long)n++ * PAGE_WORDS,
+			       state->mem.dram + (long)page * PAGE_WORDS,
+			       PAGE_BYTES);
+		}
+	ck->npages = n;
+	rev->memory += n * PAGE_BYTES;
+	mem_clean(state, MEM_DIRTY_REVERSE);
+	if (rev->nckpts > 1 && rev->ckpts[rev->nckpts - 2].nsectors)
+		forget_sectors(state);
+
+	if (rev->nckpts > REVERSE_SLOTS)
+		drop(state, victim(state));
+	while (rev->memory > REVERSE_MEMORY && rev->nckpts > 1)
+		drop(state, 0);
+}
+
+/* Put the machine back as it was at checkpoint k, which becomes the
+   newest. */
+static void
+restore(ARMul_State *state, int k)
+{
+	reverse_state_t *rev = &state->reverse;
+	reverse_ckpt_t *ck = &rev->ckpts[k];
+	unsigned char need[DRAM_PAGES];
+	ARMword *src;
+	long s;
+	int page, i, j;
+
+	/* DRAM: pages written since, from the newest copy at or before k */
+	for (page = 0; page < DRAM_PAGES; page++)
+		need[page] = state->mem.dirty[page] & MEM_DIRTY_REVERSE;
+	for (j = k + 1; j < rev->nckpts; j++)
+		for (i = 0; i < rev->ckpts[j].npages; i++)
+			need[rev->ckpts[j].pages[i]] = 1;
+	for (page = 0; page < DRAM_PAGES; page++) {
+		if (!need[page])
+			continue;
+		for (j = k, src = NULL; j >= 0 && !src; j--)
+			src = find_page(&rev->ckpts[j], page);
+		memcpy(state->mem.dram + (long)page * PAGE_WORDS, src,
+		       PAGE_BYTES);
+		state->mem.dirty[page] |= MEM_DIRTY_SNAP;
+	}
+	mem_clean(state, MEM_DIRTY_REVERSE);
+
+	/* the card: newest first, each checkpoint's sectors in reverse */
+	for (j = rev->nckpts - 1; j >= k; j--)
+		for (s = rev->ckpts[j].nsectors - 1; s >= 0; s--)
+			memcpy(state->cf.image + rev->ckpts[j].sectors[s] * CF_SECTOR,
+			       rev->ckpts[j].sector_data + s * CF_SECTOR,
+			       CF_SECTOR);
+	while (rev->nckpts > k + 1)
+		free_ckpt(state, &rev->ckpts[--rev->nckpts]);
+	rev->memory -= ck->nsectors * CF_SECTOR;
+	free(ck->sectors);
+	free(ck->sector_data);
+	ck->sectors = NULL;
+	ck->sector_data = NULL;
+	ck->nsectors = 0;
+	forget_sectors(state);
+	thaw(state, ck);
+}
+
+/* Put the machine as it was at checkpoint k for a look, keeping every
+   checkpoint: DRAM, whatever it holds now, from the newest copy of
+   each page at or before k, and the card from the sectors kept since.
+   Nothing is taken or kept while searching (see reverse_last_write). */
+static void
+visit(ARMul_State *state, int k)
+{
+	reverse_state_t *rev = &state->reverse;
+	ARMword *src;
+	long s;
+	int page, j;
+
+	for (page = 0; page < DRAM_PAGES; page++) {
+		for (j = k, src = NULL; j >= 0 && !src; j--)
+			src = find_page(&rev->ckpts[j], page);
+		memcpy(state->mem.dram + (long)page * PAGE_WORDS, src,
+		       PAGE_BYTES);
+	}
+	for (j = rev->nckpts - 1; j >= k; j--)
+		for (s = rev->ckpts[j].nsectors - 1; s >= 0; s--)
+			memcpy(state->cf.image + rev->ckpts[j].sectors[s] * CF_SECTOR,
+			       rev->ckpts[j].sector_data + s * CF_SECTOR,
+			       CF_SECTOR);
+	thaw(state, &rev->ckpts[k]);
+}
+
+static void
+leave_home(ARMul_State *state, reverse_home_t *home)
+{
+	reverse_state_t *rev = &state->reverse;
+	long n = 0, s;
+	int j;
+
+	freeze(state, &home->ck);
+	home->dram = alloc(DRAM_PAGES * PAGE_BYTES);
+	memcpy(home->dram, state->mem.dram, DRAM_PAGES * PAGE_BYTES);
+	memcpy(home->dirty, state->mem.dirty, DRAM_PAGES);
+	for (j = 0; j < rev->nckpts; j++)
+		n += rev->ckpts[j].nsectors;
+	home->sectors = alloc(n * sizeof(*home->sectors));
+	home->sector_data = alloc(n * CF_SECTOR);
+	for (n = 0, j = 0; j < rev->nckpts; j++)
+		for (s = 0; s < rev->ckpts[j].nsectors; s++, n++) {
+			home->sectors[n] = rev->ckpts[j].sectors[s];
+			memcpy(home->sector_data + n * CF_SECTOR,
+			       state->cf.image + home->sectors[n] * CF_SECTOR,
+			       CF_SECTOR);
+		}
+	home->nsectors = n;
+	rev->searching = 1;
+}
+
+static void
+come_home(ARMul_State *state, reverse_home_t *home)
+{
+	reverse_state_t *rev = &state->reverse;
+	long s;
+	int page;
+
+	memcpy(state->mem.dram, home->dram, DRAM_PAGES * PAGE_BYTES);
+	/* every page has been something else since the last snapshot */
+	for (page = 0; page < DRAM_PAGES; page++)
+		state->mem.dirty[page] = home->dirty[page] | MEM_DIRTY_SNAP;
+	for (s = 0; s < home->nsectors; s++)
+		memcpy(state->cf.image + home->sectors[s] * CF_SECTOR,
+		       home->sector_data + s * CF_SECTOR, CF_SECTOR);
+	thaw(state, &home->ck);
+	rev->searching = 0;
+	rev->pending = REVERSE_NONE;
+	free(home->ck.devices);
+	free(home->ck.events);
+	free(home->dram);
+	free(home->sectors);
+	free(home->sector_data);
+}
+
+/* The newest checkpoint at or before instruction count target. */
+static int
+checkpoint_before(ARMul_State *state, unsigned long long target)
+{
+	reverse_state_t *rev = &state->reverse;
+	int k = rev->nckpts - 1;
+
+	while (k > 0 && rev->ckpts[k].instrs > target)
+		k--;
+	return k;
+}
+
+static unsigned
+reverse_stop(ARMul_State *state)
+{
+	state->Emulate = STOP;
+	return 0;
+}
+
+/* Run on until target instructions have been executed, taking
+   checkpoints on the way as the first time round.  A stop cycles from
+   now never comes after more than cycles instructions, as each takes
+   at least one, so most of the way goes at full speed and only the
+   end one instruction at a time. */
+static void
+replay_to(ARMul_State *state, unsigned long long target)
+{
+	reverse_state_t *rev = &state->reverse;
+	unsigned long long left;
+	ARMword pc;
+
+	while (state->NumInstrs < target) {
+		left = target - state->NumInstrs;
+		if (left > REVERSE_STEPS) {
+			ARMul_ScheduleEvent(state, left, reverse_stop);
+			pc = ARMul_DoProg(state);
+			ARMul_CancelEvent(state, reverse_stop);
+		} else {
+			pc = ARMul_DoInstr(state);
+		}
+		if (state->NextInstr == RESUME)
+			state->Reg[15] = pc;
+		if (rev->pending == REVERSE_CHECKPOINT) {
+			rev->pending = REVERSE_NONE;
+			if (!rev->searching)
+				take_checkpoint(state, 0);
+		}
+	}
+}
+
+static void
+set_off(ARMul_State *state, reverse_trip_t *trip)
+{
+	trip->script = state->script;
+	trip->realtime = state->realtime;
+	state->realtime = 0;
+	state->reverse.replaying = 1;
+}
+
+/* Back in the present, having gone nowhere */
+static void
+return_from(ARMul_State *state, reverse_trip_t *trip)
+{
+	state->reverse.replaying = 0;
+	replay_resume(state);
+	script_resume(state, &trip->script);
+	state->realtime = trip->realtime;
+	io_realtime(state);
+}
+
+/* Here is where a new history starts. */
+static void
+arrive(ARMul_State *state, reverse_trip_t *trip)
+{
+	return_from(state, trip);
+	take_checkpoint(state, 1);
+}
+
+static void
+travel(ARMul_State *state, unsigned long long target)
+{
+	restore(state, checkpoint_before(state, target));
+	replay_to(state, target);
+}
+
+
+/* Checkpoints are taken once the CPU has stopped. */
+static unsigned
+reverse_tick(ARMul_State *state)
+{
+	reverse_state_t *rev = &state->reverse;
+
+	if (rev->pending == REVERSE_NONE)
+		rev->pending = REVERSE_CHECKPOINT;
+	state->Emulate = STOP;
+	ARMul_ScheduleEvent(state, rev->cycles, reverse_tick);
+	return 0;
+}
+
+/* Host side: never saved */
+const snap_event_t reverse_events[] = {
+	{ NULL, reverse_tick },
+	{ NULL, reverse_stop },
+	{ NULL, NULL }
+};
+
+/* Start keeping history, from the machine as it is now, with the CPU
+   stopped.  The input has to be recorded by armreverse.c itself. */
+int
+reverse_open(ARMul_State *state)
+{
+	reverse_state_t *rev = &state->reverse;
+
+	if (state->replay.mode != REPLAY_OFF) {
+		fprintf(stderr, "Reverse: can't run backwards while the input "
+			"is recorded or replayed\n");
+		return -1;
+	}
+	if (replay_open(state, NULL, REPLAY_RECORD))
+		return -1;
+	rev->ckpts = calloc(REVERSE_SLOTS + 1, sizeof(*rev->ckpts));
+	if (!rev->ckpts) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	if (state->cf.image) {
+		rev->card_saved = calloc((state->cf.sectors + 7) / 8, 1);
+		if (!rev->card_saved) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+	}
+	rev->cycles = (unsigned long long)REVERSE_MS * state->cpu_clock / 1000;
+	rev->enabled = 1;
+	take_checkpoint(state, 1);
+	ARMul_ScheduleEvent(state, rev->cycles, reverse_tick);
+	return 0;
+}
+
+/* The card is about to write count sectors from lba: keep what they
+   hold, unless they have been kept since the newest checkpoint. */
+void
+reverse_card(ARMul_State *state, unsigned long long lba, unsigned long count)
+{
+	reverse_state_t *rev = &state->reverse;
+	reverse_ckpt_t *ck;
+	unsigned long long s;
+
+	if (!rev->enabled || !rev->card_saved || rev->searching)
+		return;
+	ck = &rev->ckpts[rev->nckpts - 1];
+	for (s = lba; s < lba + count; s++) {
+		if (rev->card_saved[s >> 3] & (1 << (s & 7)))
+			continue;
+		rev->card_saved[s >> 3] |= 1 << (s & 7);
+		ck->sectors = realloc(ck->sectors,
+				      (ck->nsectors + 1) * sizeof(*ck->sectors));
+		ck->sector_data = realloc(ck->sector_data,
+					  (ck->nsectors + 1) * CF_SECTOR);
+		if (!ck->sectors || !ck->sector_data) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		ck->sectors[ck->nsectors] = s;
+		memcpy(ck->sector_data + ck->nsectors * CF_SECTOR,
+		       state->cf.image + s * CF_SECTOR, CF_SECTOR);
+		ck->nsectors++;
+		rev->memory += CF_SECTOR;
+	}
+}
+
+/* Ask from inside the emulator to take a checkpoint or go back; it
+   happens once the CPU stops (see armrun.c).  Asking again while
+   history is replayed is the script going over old ground. */
+void
+reverse_request(ARMul_State *state, int what, unsigned long long count,
+		ARMword addr)
+{
+	if (state->reverse.replaying)
+		return;
+	state->reverse.pending = what;
+	state->reverse.count = count;
+	state->reverse.addr = addr;
+	state->Emulate = STOP;
+}
+
+void
+reverse_service(ARMul_State *state)
+{
+	reverse_state_t *rev = &state->reverse;
+	int what = rev->pending;
+
+	rev->pending = REVERSE_NONE;
+	switch (what) {
+	case REVERSE_CHECKPOINT:
+		take_checkpoint(state, 0);
+		break;
+	case REVERSE_BACK:
+		reverse_step_back(state, rev->count);
+		break;
+	case REVERSE_BACKTO:
+		reverse_last_write(state, rev->addr);
+		break;
+	}
+}
+
+/* Go back count instructions, or as far as the history goes. */
+int
+reverse_step_back(ARMul_State *state, unsigned long long count)
+{
+	reverse_state_t *rev = &state->reverse;
+	unsigned long long target;
+	reverse_trip_t trip;
+
+	if (!rev->enabled) {
+		fprintf(stderr, "Reverse: not keeping history\n");
+		return -1;
+	}
+	target = count < state->NumInstrs ? state->NumInstrs - count : 0;
+	if (target < rev->ckpts[0].instrs) {
+		fprintf(stderr, "Reverse: history only goes back to "
+			"instruction %llu\n", rev->ckpts[0].instrs);
+		target = rev->ckpts[0].instrs;
+	}
+	set_off(state, &trip);
+	travel(state, target);
+	arrive(state, &trip);
+	fprintf(stderr, "Reverse: at instruction %llu, pc %08lx\n",
+		state->NumInstrs, (unsigned long)state->Reg[15]);
+	return 0;
+}
+
+/* Go back to just before the last write to DRAM address addr, which
+   is physical, by replaying each gap between checkpoints with the
+   address watched, newest first, until one has a write in it.  The
+   search visits the past without changing its history, and starts
+   each gap from the checkpoint at its start, so it never replays past
+   one a history starts from with the script the old history had.
+   Then it comes back to the present, and only goes back if there was
+   a write, replaying just the gap it was in. */
+int
+reverse_last_write(ARMul_State *state, ARMword addr)
+{
+	reverse_state_t *rev = &state->reverse;
+	unsigned long long now = state->NumInstrs, end, start, hit = 0;
+	reverse_trip_t trip;
+	reverse_home_t home;
+	int k;
+
+	if (!rev->enabled) {
+		fprintf(stderr, "Reverse: not keeping history\n");
+		return -1;
+	}
+	if ((addr >> 28) != 0xc && (addr >> 28) != 0xd) {
+		fprintf(stderr, "Reverse: %08lx is not in DRAM\n",
+			(unsigned long)addr);
+		return -1;
+	}
+	set_off(state, &trip);
+	leave_home(state, &home);
+	for (end = now; !hit && end > rev->ckpts[0].instrs; end = start) {
+		k = checkpoint_before(state, end - 1);
+		start = rev->ckpts[k].instrs;
+		visit(state, k);
+		state->mem.watch = dram_offset(addr & ~3) >> 2;
+		state->mem.watch_hit = 0;
+		replay_to(state, end);
+		state->mem.watch = ~0;
+		if (state->mem.watch_hit > start)
+			hit = state->mem.watch_hit;
+	}
+	come_home(state, &home);
+	if (!hit) {
+		return_from(state, &trip);
+		fprintf(stderr, "Reverse: no write to %08lx since instruction "
+			"%llu\n", (unsigned long)addr, rev->ckpts[0].instrs);
+		return -1;
+	}
+	/* the writing instruction is next */
+	travel(state, hit - 1);
+	arrive(state, &trip);
+	fprintf(stderr, "Reverse: %08lx was last written by instruction %llu, "
+		"at %08lx\n", (unsigned long)addr, hit,
+		(unsigned long)state->Reg[15]);
+	return 0;
+}
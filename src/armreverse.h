@@ -0,0 +1,93 @@
+/*
+    armreverse.h - Running the machine backwards.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMREVERSE_H_
+#define _ARMREVERSE_H_
+
+
+/* The machine can't run backwards, but it can be put back where it was
+   and run forwards again, and it does the same thing the second time
+   as long as it gets the same input at the same points (see
+   armreplay.h).  So while reversing is on, the run keeps checkpoints
+   in memory, REVERSE_MS of guest time apart to begin with, and records
+   its input to a log of its own.  Going back to an instruction count
+   puts the machine back to the last checkpoint before it, takes the
+   log back to the same place, and replays forwards to it; the
+   replaying only takes as long as the gap since the checkpoint.
+
+   A checkpoint holds the CPU and devices as snap_freeze() sees them,
+   the pending events, where the script and the input log had got to,
+   and the DRAM pages written since the checkpoint before.  The oldest
+   has all of DRAM.  Card sectors are saved the first time they are
+   written after a checkpoint.  With REVERSE_SLOTS checkpoints kept, a
+   new one pushes out whichever old one leaves the smallest gap for its
+   age, its pages going to the checkpoint after it, so the gaps grow
+   with age and replaying to a point stays a small part of the way
+   back to it.  When the pages and sectors kept reach REVERSE_MEMORY
+   bytes the oldest goes, and history with it.
+
+   Going back starts a new history from there: the log and checkpoints
+   after that point are dropped, and the script carries on from the
+   command after the one that went back.  Output that the guest makes
+   while history is replayed was made the first time round, so the
+   UART, the sound file and the LCD recording don't see it again. */
+
+#define REVERSE_MS	20			/* first gap between checkpoints */
+#define REVERSE_SLOTS	64			/* checkpoints kept */
+#define REVERSE_MEMORY	(256 << 20)		/* bytes of pages and sectors */
+#define REVERSE_STEPS	64			/* single-stepped at the end */
+
+/* What to do once the CPU stops (see armrun.c) */
+#define REVERSE_NONE		0
+#define REVERSE_CHECKPOINT	1
+#define REVERSE_BACK		2		/* back count instructions */
+#define REVERSE_BACKTO		3		/* to the last write of addr */
+
+#define REVERSE_REPLAYING(state)	((state)->reverse.replaying)
+
+struct reverse_ckpt_t;
+
+typedef struct reverse_state_t {
+	int		enabled;
+	int		pending;		/* REVERSE_* */
+	unsigned long long count;
+	ARMword		addr;
+	int		replaying;
+	int		searching;		/* reverse_last_write() */
+	struct reverse_ckpt_t *ckpts;		/* oldest first */
+	int		nckpts;
+	long		memory;			/* bytes they keep */
+	unsigned long long cycles;		/* first gap */
+	unsigned char *	card_saved;		/* sectors saved since the newest */
+} reverse_state_t;
+
+extern const snap_event_t reverse_events[];
+
+
+int	reverse_open(ARMul_State *state);
+void	reverse_request(ARMul_State *state, int what, unsigned long long count,
+			ARMword addr);
+void	reverse_service(ARMul_State *state);
+int	reverse_step_back(ARMul_State *state, unsigned long long count);
+int	reverse_last_write(ARMul_State *state, ARMword addr);
+void	reverse_card(ARMul_State *state, unsigned long long lba,
+		     unsigned long count);
+
+
+#endif	/* _ARMREVERSE_H_ */
@@ -0,0 +1,89 @@
+/*
+    armring.c - Lock-free single producer / single consumer ring.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "armring.h"
+
+
+int
+ring_init(ring_t *ring, unsigned slots, unsigned elsize)
+{
+	if (slots & (slots - 1)) {
+		return 0;
+	}
+	ring->buf = calloc(slots, elsize);
+	if (!ring->buf) {
+		return 0;
+	}
+	ring->slots = slots;
+	ring->elsize = elsize;
+	ring->head = 0;
+	ring->tail = 0;
+	return 1;
+}
+
+void
+ring_free(ring_t *ring)
+{
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+/* Only the producer writes head and only the consumer writes tail.
+   The acquire/release pairs make the record contents visible before
+   the index that publishes them. */
+
+int
+ring_put(ring_t *ring, const void *rec)
+{
+	unsigned head = ring->head;
+	unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= ring->slots) {
+		return 0;
+	}
+	memcpy(ring->buf + (head & (ring->slots - 1)) * ring->elsize,
+	       rec, ring->elsize);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+int
+ring_get(ring_t *ring, void *rec)
+{
+	unsigned tail = ring->tail;
+	unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		return 0;
+	}
+	memcpy(rec, ring->buf + (tail & (ring->slots - 1)) * ring->elsize,
+	       ring->elsize);
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+unsigned
+ring_count(ring_t *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+	       __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
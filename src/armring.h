@@ -0,0 +1,45 @@
+/*
+    armring.h - Lock-free single producer / single consumer ring.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMRING_H_
+#define _ARMRING_H_
+
+
+/* Fixed-size records passed between exactly one producer thread and
+   one consumer thread.  The number of slots must be a power of two.
+   Neither side ever blocks: ring_put() fails when full and ring_get()
+   fails when empty. */
+
+typedef struct ring_t {
+	unsigned char *	buf;
+	unsigned	slots;		/* power of two */
+	unsigned	elsize;		/* bytes per record */
+	unsigned	head;		/* next slot to write (producer) */
+	unsigned	tail;		/* next slot to read (consumer) */
+} ring_t;
+
+
+int		ring_init(ring_t *ring, unsigned slots, unsigned elsize);
+void		ring_free(ring_t *ring);
+int		ring_put(ring_t *ring, const void *rec);
+int		ring_get(ring_t *ring, void *rec);
+unsigned	ring_count(ring_t *ring);
+
+
+#endif	/* _ARMRING_H_ */
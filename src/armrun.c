@@ -0,0 +1,182 @@
+/*
+    armrun.c - Running the CPU between stops.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "armdefs.h"
+#include "armemu.h"
+
+
+static unsigned
+run_budget(ARMul_State *state)
+{
+	state->Emulate = STOP;
+	return 0;
+}
+
+/* Host side: never saved */
+const snap_event_t run_events[] = {
+	{ NULL, run_budget },
+	{ NULL, NULL }
+};
+
+/* Run for cycles (or RUN_FOREVER), returning RUN_* for why it came
+   back.  A quit or the end of the script is reported once; running
+   again carries on from there. */
+int
+run_for(ARMul_State *state, unsigned long long cycles)
+{
+	unsigned long long end = ARMul_Time(state) + cycles;
+	int serviced, why;
+	ARMword pc;
+
+	if (!cycles)
+		return RUN_CYCLES;
+	if (cycles != RUN_FOREVER)
+		ARMul_ScheduleEvent(state, cycles, run_budget);
+	for (;;) {
+		pc = ARMul_DoProg(state);
+		if (state->NextInstr == RESUME)
+			state->Reg[15] = pc;
+		serviced = 0;
+		if (state->snap.pending) {
+			if ((state->snap.pending_delta ? snap_save_delta :
+			     snap_save)(state, state->snap.pending))
+				fprintf(stderr, "Couldn't save snapshot to %s\n",
+					state->snap.pending);
+			state->snap.pending = NULL;
+			serviced = 1;
+		}
+		if (state->reverse.pending) {
+			reverse_service(state);
+			/* the clock may have gone back, and the budget with it */
+			if (cycles != RUN_FOREVER) {
+				ARMul_CancelEvent(state, run_budget);
+				if (ARMul_Time(state) < end)
+					ARMul_ScheduleEvent(state,
+							    end - ARMul_Time(state),
+							    run_budget);
+			}
+			serviced = 1;
+		}
+		if (state->script.quit) {
+			state->script.quit = 0;
+			why = RUN_QUIT;
+			break;
+		}
+		if (state->script.finished &&
+		    state->script.at_end == SCRIPT_END_STOP) {
+			state->script.at_end = SCRIPT_END_RUN;
+			why = RUN_SCRIPT_END;
+			break;
+		}
+		if (state->run.met) {
+			state->run.met = 0;
+			why = RUN_MET;
+			break;
+		}
+		if (cycles != RUN_FOREVER && ARMul_Time(state) >= end) {
+			why = RUN_CYCLES;
+			break;
+		}
+		if (!serviced) {
+			why = RUN_STOPPED;
+			break;
+		}
+	}
+	ARMul_CancelEvent(state, run_budget);
+	return why;
+}
+
+/* As run_for(), but stopping with RUN_MET when until comes true. */
+int
+run_until(ARMul_State *state, const run_until_t *until,
+	  unsigned long long cycles)
+{
+	int why;
+
+	state->run.until = until;
+	state->run.met = 0;
+	state->run.matched = 0;
+	state->run.sent = 0;
+	state->run.idle = 0;
+	state->run.next_poll = ARMul_Time(state);
+	why = run_for(state, cycles);
+	state->run.until = NULL;
+	state->run.met = 0;
+	return why;
+}
+
+/* From the CPU, where a block starts at pc, while a condition is set */
+void
+run_block(ARMul_State *state, ARMword pc)
+{
+	const run_until_t *u = state->run.until;
+	int met = 0;
+
+	/* history being run again has been looked at already */
+	if (REVERSE_REPLAYING(state))
+		return;
+	switch (u->what) {
+	case RUN_UNTIL_PC:
+		met = pc == u->addr;
+		break;
+	case RUN_UNTIL_UART:
+		met = state->run.sent;
+		break;
+	case RUN_UNTIL_MEM:
+		met = (mem_read_word(state, u->addr & ~3) & u->mask) == u->value;
+		break;
+	case RUN_UNTIL_HASH:
+		if (ARMul_Time(state) >= state->run.next_poll) {
+			state->run.next_poll = ARMul_Time(state) +
+					       state->cpu_clock / RUN_POLL_HZ;
+			met = shot_hash(state) == u->hash;
+		}
+		break;
+	case RUN_UNTIL_IDLE:
+		met = state->run.idle;
+		break;
+	}
+	if (met) {
+		state->run.met = 1;
+		state->Emulate = STOP;
+	}
+}
+
+/* From the UART, for each byte the guest sends.  matched is the
+   longest start of the text that what was sent ends with. */
+void
+run_uart_tx(ARMul_State *state, unsigned char c)
+{
+	const run_until_t *u = state->run.until;
+	int n = state->run.matched, k;
+
+	if (u->what != RUN_UNTIL_UART || !u->len)
+		return;
+	for (k = n + 1; k > 0; k--)
+		if ((unsigned char)u->text[k - 1] == c &&
+		    !memcmp(u->text, u->text + n + 1 - k, k - 1))
+			break;
+	if (k == u->len) {
+		state->run.sent = 1;
+		k = 0;
+	}
+	state->run.matched = k;
+}
@@ -0,0 +1,98 @@
+/*
+    armrun.h - Running the CPU between stops.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMRUN_H_
+#define _ARMRUN_H_
+
+
+/* What needs doing outside an instruction is asked for from an event,
+   which stops the CPU: a snapshot to save (armsnap.c), a checkpoint to
+   take or history to go back through (armreverse.c), the end of the
+   script or a quit (armscript.c).  run_for() restarts the CPU after
+   the ones it can see to itself, and comes back for the rest, or once
+   the cycles it was given have gone by.  The CPU stops before an
+   instruction it has fetched, so it is restarted from that
+   instruction. */
+
+#define RUN_FOREVER	(~0ULL)		/* no limit on the cycles */
+
+/* Why run_for() came back */
+#define RUN_CYCLES	0		/* the cycles have gone by */
+#define RUN_QUIT	1		/* script_quit(); see script.status */
+#define RUN_SCRIPT_END	2		/* out of commands, with SCRIPT_END_STOP */
+#define RUN_STOPPED	3		/* the CPU stopped for nobody here */
+#define RUN_MET		4		/* run_until()'s condition came true */
+
+/* run_until() stops the CPU when a condition comes true.  Conditions
+   are looked at where a block of straight-line code starts: after a
+   branch, any other write to the PC, or an exception.  That costs one
+   test per block, and nothing at all when no condition is set; the
+   price is that a PC only matches where a block starts, such as a
+   function's entry, a return address or a vector.  The CPU stops
+   before the block's first instruction.
+
+	RUN_UNTIL_PC	the PC is addr
+	RUN_UNTIL_UART	the guest has sent text on the UART
+	RUN_UNTIL_MEM	the word at physical address addr, ANDed
+			with mask, is value; reads are the CPU's, so
+			an I/O register's read has its side effects
+	RUN_UNTIL_HASH	the screen's frame hash is hash, looked at
+			RUN_POLL_HZ times a guest second
+	RUN_UNTIL_IDLE	the guest has written HALT or STDBY to go idle
+
+   Each run_until() starts afresh: UART text or an idle that came
+   before it doesn't count. */
+
+#define RUN_UNTIL_PC	0
+#define RUN_UNTIL_UART	1
+#define RUN_UNTIL_MEM	2
+#define RUN_UNTIL_HASH	3
+#define RUN_UNTIL_IDLE	4
+
+#define RUN_POLL_HZ	50		/* frame hash checks per guest second */
+
+typedef struct run_until_t {
+	int		what;		/* RUN_UNTIL_* */
+	ARMword		addr;		/* PC or memory */
+	ARMword		value, mask;
+	unsigned long long hash;
+	const char *	text;
+	int		len;
+} run_until_t;
+
+typedef struct run_state_t {
+	const run_until_t *until;	/* or NULL */
+	int		met;
+	int		matched;	/* bytes of text sent so far */
+	int		sent;		/* all of text */
+	int		idle;		/* HALT or STDBY written */
+	unsigned long long next_poll;	/* for RUN_UNTIL_HASH */
+} run_state_t;
+
+extern const snap_event_t run_events[];
+
+
+int	run_for(ARMul_State *state, unsigned long long cycles);
+int	run_until(ARMul_State *state, const run_until_t *until,
+		  unsigned long long cycles);
+void	run_block(ARMul_State *state, ARMword pc);
+void	run_uart_tx(ARMul_State *state, unsigned char c);
+
+
+#endif	/* _ARMRUN_H_ */
@@ -0,0 +1,571 @@
+/*
+    armscript.c - Timed input scripts for unattended runs.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <ctype.h>
+
+#include "armdefs.h"
+#include "armemu.h"
+
+enum {
+	OP_WAIT,
+	OP_AT,
+	OP_KEYDOWN,
+	OP_KEYUP,
+	OP_PENDOWN,
+	OP_PENUP,
+	OP_UART,
+	OP_HASH,
+	OP_SHOT,
+	OP_SAVE,
+	OP_ECHO,
+	OP_QUIT,
+	OP_BACK,
+	OP_BACKTO
+};
+
+#define MAX_LINE	1024
+#define KEY_CODES	64
+
+extern unsigned char keyboard[8];
+
+
+/* Parsing */
+
+static const char *script_name;
+static int script_line;
+
+static void
+parse_error(const char *msg, const char *what)
+{
+	fprintf(stderr, "%s:%d: %s%s%s\n", script_name, script_line, msg,
+		what ? ": " : "", what ? what : "");
+}
+
+static char *
+next_word(char **p)
+{
+	char *s = *p, *w;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (!*s) {
+		*p = s;
+		return NULL;
+	}
+	w = s;
+	while (*s && !isspace((unsigned char)*s))
+		s++;
+	if (*s)
+		*s++ = 0;
+	*p = s;
+	return w;
+}
+
+/* The rest of the line, with surrounding blanks removed. */
+static char *
+rest_of_line(char **p)
+{
+	char *s = *p, *e;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char)e[-1]))
+		*--e = 0;
+	*p = e;
+	return s;
+}
+
+static int
+parse_time(ARMul_State *state, const char *w, unsigned long long *t)
+{
+	char *end;
+	unsigned long long v;
+
+	if (!w || !isdigit((unsigned char)*w)) {
+		parse_error("expected a time", w);
+		return -1;
+	}
+	v = strtoull(w, &end, 0);
+	if (!*end)
+		*t = v;
+	else if (!strcmp(end, "us"))
+		*t = v * state->cpu_clock / 1000000;
+	else if (!strcmp(end, "ms"))
+		*t = v * state->cpu_clock / 1000;
+	else if (!strcmp(end, "s"))
+		*t = v * state->cpu_clock;
+	else {
+		parse_error("bad time", w);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+parse_int(const char *w, int *v)
+{
+	char *end;
+
+	if (!w) {
+		parse_error("expected a number", NULL);
+		return -1;
+	}
+	*v = strtol(w, &end, 0);
+	if (*end) {
+		parse_error("bad number", w);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+hexval(int c)
+{
+	return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+/* A double-quoted string with C escapes, decoded in place.  Returns
+   its length, or -1. */
+static int
+parse_string(char **p, char **text)
+{
+	char *s = *p, *out;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (*s++ != '"') {
+		parse_error("expected a quoted string", NULL);
+		return -1;
+	}
+	*text = out = s;
+	while (*s != '"') {
+		int c = *s++;
+
+		if (!c) {
+			parse_error("unterminated string", NULL);
+			return -1;
+		}
+		if (c == '\\') {
+			c = *s++;
+			switch (c) {
+			case 'n':  c = '\n'; break;
+			case 'r':  c = '\r'; break;
+			case 't':  c = '\t'; break;
+			case 'e':  c = 033; break;
+			case '0':  c = 0; break;
+			case 'x':
+				/* exactly two digits, as a byte */
+				if (!isxdigit((unsigned char)s[0]) ||
+				    !isxdigit((unsigned char)s[1])) {
+					parse_error("expected two hex digits after \\x", NULL);
+					return -1;
+				}
+				c = (hexval(s[0]) << 4) | hexval(s[1]);
+				s += 2;
+				break;
+			case '\\':
+			case '"':
+				break;
+			default:
+				parse_error("bad escape in string", NULL);
+				return -1;
+			}
+		}
+		*out++ = c;
+	}
+	*p = s + 1;
+	return out - *text;
+}
+
+static script_cmd_t *
+add_cmd(script_state_t *script, int op)
+{
+	script_cmd_t *cmd;
+
+	if (!(script->ncmds & 63)) {
+		script->cmds = realloc(script->cmds,
+				       (script->ncmds + 64) * sizeof(*cmd));
+		if (!script->cmds) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+	}
+	cmd = &script->cmds[script->ncmds++];
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->op = op;
+	cmd->line = script_line;
+	return cmd;
+}
+
+static int
+parse_line(ARMul_State *state, char *line)
+{
+	script_state_t *script = &state->script;
+	script_cmd_t *cmd;
+	char *p = line, *w, *arg;
+	int x, y, len;
+
+	/* a comment can't start inside a string */
+	for (w = line, x = 0; *w; w++) {
+		if (*w == '"' && (w == line || w[-1] != '\\'))
+			x = !x;
+		else if (*w == '#' && !x) {
+			*w = 0;
+			break;
+		}
+	}
+	if (!(w = next_word(&p)))
+		return 0;
+
+	if (!strcmp(w, "wait") || !strcmp(w, "at")) {
+		cmd = add_cmd(script, *w == 'w' ? OP_WAIT : OP_AT);
+		if (parse_time(state, next_word(&p), &cmd->n))
+			return -1;
+	} else if (!strcmp(w, "key")) {
+		arg = next_word(&p);
+		if (!arg || parse_int(next_word(&p), &x))
+			return -1;
+		if (x < 0 || x >= KEY_CODES) {
+			parse_error("no such key", NULL);
+			return -1;
+		}
+		if (!strcmp(arg, "down")) {
+			add_cmd(script, OP_KEYDOWN)->n = x;
+		} else if (!strcmp(arg, "up")) {
+			add_cmd(script, OP_KEYUP)->n = x;
+		} else if (!strcmp(arg, "tap")) {
+			add_cmd(script, OP_KEYDOWN)->n = x;
+			add_cmd(script, OP_WAIT)->n = (unsigned long long)
+				SCRIPT_TAP_MS * state->cpu_clock / 1000;
+			add_cmd(script, OP_KEYUP)->n = x;
+		} else {
+			parse_error("expected down, up or tap", arg);
+			return -1;
+		}
+	} else if (!strcmp(w, "pen")) {
+		arg = next_word(&p);
+		if (arg && !strcmp(arg, "up")) {
+			add_cmd(script, OP_PENUP);
+		} else if (arg && (!strcmp(arg, "down") || !strcmp(arg, "move"))) {
+			if (parse_int(next_word(&p), &x) || parse_int(next_word(&p), &y))
+				return -1;
+			cmd = add_cmd(script, OP_PENDOWN);
+			cmd->x = x;
+			cmd->y = y;
+		} else {
+			parse_error("expected down, move or up", arg);
+			return -1;
+		}
+	} else if (!strcmp(w, "tap")) {
+		if (parse_int(next_word(&p), &x) || parse_int(next_word(&p), &y))
+			return -1;
+		cmd = add_cmd(script, OP_PENDOWN);
+		cmd->x = x;
+		cmd->y = y;
+		add_cmd(script, OP_WAIT)->n = (unsigned long long)
+			SCRIPT_TAP_MS * state->cpu_clock / 1000;
+		cmd = add_cmd(script, OP_PENUP);
+		cmd->x = x;
+		cmd->y = y;
+	} else if (!strcmp(w, "uart")) {
+		if ((len = parse_string(&p, &arg)) < 0)
+			return -1;
+		cmd = add_cmd(script, OP_UART);
+		cmd->n = len;
+		cmd->text = malloc(len + 1);
+		if (!cmd->text) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		memcpy(cmd->text, arg, len);
+	} else if (!strcmp(w, "hash")) {
+		char *end;
+
+		arg = next_word(&p);
+		if (!arg) {
+			parse_error("expected a frame hash", NULL);
+			return -1;
+		}
+		cmd = add_cmd(script, OP_HASH);
+		cmd->n = strtoull(arg, &end, 16);
+		if (*end) {
+			parse_error("bad frame hash", arg);
+			return -1;
+		}
+		cmd->limit = (unsigned long long)SCRIPT_HASH_TIMEOUT * state->cpu_clock;
+		if ((arg = next_word(&p)) && parse_time(state, arg, &cmd->limit))
+			return -1;
+	} else if (!strcmp(w, "shot") || !strcmp(w, "save") ||
+		   !strcmp(w, "echo")) {
+		arg = rest_of_line(&p);
+		if (*w == 's' && !*arg) {
+			parse_error("expected a file name", NULL);
+			return -1;
+		}
+		cmd = add_cmd(script, !strcmp(w, "shot") ? OP_SHOT :
+				      *w == 's' ? OP_SAVE : OP_ECHO);
+		cmd->text = strdup(arg);
+		if (!cmd->text) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+	} else if (!strcmp(w, "back") || !strcmp(w, "backto")) {
+		char *end;
+
+		if (!state->reverse.enabled) {
+			parse_error("needs history kept with -b", w);
+			return -1;
+		}
+		cmd = add_cmd(script, w[4] ? OP_BACKTO : OP_BACK);
+		arg = next_word(&p);
+		if (!arg) {
+			parse_error(w[4] ? "expected an address" :
+					   "expected a count", NULL);
+			return -1;
+		}
+		cmd->n = strtoull(arg, &end, 0);
+		if (*end) {
+			parse_error("bad number", arg);
+			return -1;
+		}
+	} else if (!strcmp(w, "quit")) {
+		x = 0;
+		if ((arg = next_word(&p)) && parse_int(arg, &x))
+			return -1;
+		add_cmd(script, OP_QUIT)->n = x;
+	} else {
+		parse_error("unknown command", w);
+		return -1;
+	}
+	if ((w = next_word(&p))) {
+		parse_error("unexpected", w);
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Running: on the CPU thread, from the event. */
+
+static unsigned script_event(ARMul_State *state);
+
+static void
+script_sleep(ARMul_State *state, unsigned long long cycles)
+{
+	ARMul_ScheduleEvent(state, cycles ? cycles : 1, script_event);
+}
+
+/* Also how armreplay.c ends a replay.  The CPU stops before its next
+   instruction, and whoever runs it finishes up (see armrun.c). */
+void
+script_quit(ARMul_State *state, int status)
+{
+	state->script.status = status;
+	state->script.quit = 1;
+	state->Emulate = STOP;
+}
+
+static unsigned
+script_event(ARMul_State *state)
+{
+	script_state_t *script = &state->script;
+	script->now = ARMul_Time(state) - script->start;
+
+	while (script->pc < script->ncmds) {
+		script_cmd_t *cmd = &script->cmds[script->pc];
+		unsigned long long hash;
+
+		switch (cmd->op) {
+		case OP_WAIT:
+			if (script->now < script->mark + cmd->n) {
+				script_sleep(state, script->mark + cmd->n - script->now);
+				return 0;
+			}
+			break;
+		case OP_AT:
+			if (script->now < cmd->n) {
+				script_sleep(state, cmd->n - script->now);
+				return 0;
+			}
+			break;
+		case OP_KEYDOWN:
+			keyboard[cmd->n >> 3] |= 1 << (cmd->n & 7);
+			break;
+		case OP_KEYUP:
+			keyboard[cmd->n >> 3] &= ~(1 << (cmd->n & 7));
+			break;
+		case OP_PENDOWN:
+			ssi_pen(state, 1, cmd->x, cmd->y);
+			break;
+		case OP_PENUP:
+			ssi_pen(state, 0, cmd->x, cmd->y);
+			break;
+		case OP_UART:
+			script->text_pos += uart_inject(state, cmd->text + script->text_pos,
+							cmd->n - script->text_pos);
+			if (script->text_pos < cmd->n) {
+				/* the guest hasn't taken the last lot yet */
+				script_sleep(state, state->uart.char_cycles * UART_FIFO);
+				return 0;
+			}
+			script->text_pos = 0;
+			break;
+		case OP_HASH:
+			hash = shot_hash(state);
+			if (hash != cmd->n) {
+				if (script->now - script->mark >= cmd->limit) {
+					fprintf(stderr, "%s:%d: frame hash is %016llx, "
+						"not %016llx\n", script->name,
+						cmd->line, hash, cmd->n);
+					script_quit(state, 1);
+					return 0;
+				}
+				script_sleep(state, state->cpu_clock / SCRIPT_POLL_HZ);
+				return 0;
+			}
+			break;
+		case OP_SHOT:
+			/* history being replayed has done this already */
+			if (!REVERSE_REPLAYING(state) && shot_save(state, cmd->text))
+				fprintf(stderr, "%s:%d: couldn't save screenshot to %s\n",
+					script->name, cmd->line, cmd->text);
+			break;
+		case OP_SAVE:
+			/* the CPU stops after this event; carry on just
+			   after the snapshot is written */
+			if (!REVERSE_REPLAYING(state))
+				snap_request(state, cmd->text, 0);
+			script->pc++;
+			script->mark = script->now;
+			script_sleep(state, 0);
+			return 0;
+		case OP_ECHO:
+			if (!REVERSE_REPLAYING(state))
+				printf("%s\n", cmd->text);
+			break;
+		case OP_QUIT:
+			script_quit(state, cmd->n);
+			return 0;
+		case OP_BACK:
+		case OP_BACKTO:
+			/* like save; script_resume() carries on after it */
+			reverse_request(state, cmd->op == OP_BACK ? REVERSE_BACK :
+					REVERSE_BACKTO, cmd->n, cmd->n);
+			script->pc++;
+			script->mark = script->now;
+			script_sleep(state, 0);
+			return 0;
+		}
+		script->pc++;
+		script->mark = script->now;
+	}
+	if (!script->finished) {
+		script->finished = 1;
+		if (script->at_end == SCRIPT_END_STOP)
+			state->Emulate = STOP;
+		else if (script->at_end == SCRIPT_END_QUIT)
+			script_quit(state, 0);
+	}
+	return 0;
+}
+
+/* After armreverse.c has taken the machine back: carry on from where
+   the script had got to, timing the next command from now. */
+void
+script_resume(ARMul_State *state, const script_state_t *live)
+{
+	script_state_t *script = &state->script;
+
+	*script = *live;
+	ARMul_CancelEvent(state, script_event);
+	if (script->pc >= script->ncmds)
+		return;
+	if (script->start > ARMul_Time(state))
+		script->start = ARMul_Time(state);
+	script->now = script->mark = ARMul_Time(state) - script->start;
+	script_sleep(state, 0);
+}
+
+/* The script belongs to the run, not the machine: it is not saved. */
+const snap_event_t script_events[] = {
+	{ NULL, script_event },
+	{ NULL, NULL }
+};
+
+/* Stop running the script and forget it. */
+void
+script_close(ARMul_State *state)
+{
+	script_state_t *script = &state->script;
+	int i;
+
+	ARMul_CancelEvent(state, script_event);
+	for (i = 0; i < script->ncmds; i++)
+		free(script->cmds[i].text);
+	free(script->cmds);
+	script->cmds = NULL;
+	script->ncmds = 0;
+}
+
+/* Read a script (see armscript.h) and start running it from now, in
+   place of any script already running. */
+int
+script_open(ARMul_State *state, const char *filename)
+{
+	script_state_t *script = &state->script;
+	char line[MAX_LINE];
+	FILE *f = fopen(filename, "r");
+	int err = 0;
+
+	if (!f) {
+		perror(filename);
+		return -1;
+	}
+	script_close(state);
+	script_name = script->name = filename;
+	script_line = 0;
+	while (fgets(line, sizeof(line), f)) {
+		script_line++;
+		if (!strchr(line, '\n') && !feof(f)) {
+			parse_error("line too long", NULL);
+			err = -1;
+			break;
+		}
+		if (parse_line(state, line))
+			err = -1;
+	}
+	fclose(f);
+	if (err) {
+		/* none of it runs: forget what did parse */
+		script_close(state);
+		return -1;
+	}
+
+	script->pc = 0;
+	script->text_pos = 0;
+	script->finished = 0;
+	script->status = 0;
+	script->quit = 0;
+	script->now = script->mark = 0;
+	script->start = ARMul_Time(state);
+	ARMul_ScheduleEvent(state, 0, script_event);
+	return 0;
+}
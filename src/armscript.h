@@ -0,0 +1,93 @@
+/*
+    armscript.h - Timed input scripts for unattended runs.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMSCRIPT_H_
+#define _ARMSCRIPT_H_
+
+
+/* A script is read whole before the guest starts and then stepped by
+   a scheduler event, which only runs when the next command is due, so
+   it costs nothing between commands.  One command per line; '#'
+   starts a comment.  TIME is in guest cycles, or takes a suffix of
+   us, ms or s.
+
+	wait TIME		pause for TIME after the previous command
+	at TIME			pause until TIME after the script started
+	key down|up|tap CODE	keyboard matrix index 0..63 (see xkeycodes.h)
+	pen down|move X Y	in LCD pixels
+	pen up
+	tap X Y			pen down, then up SCRIPT_TAP later
+	uart "TEXT"		bytes for the guest's UART; escapes \n \r \t
+				\e \0 \\ \" and \xHH (two digits)
+	hash HASH [TIME]	wait until the screen's frame hash is HASH,
+				and fail if it isn't within TIME (default
+				SCRIPT_HASH_TIMEOUT)
+	shot FILE		save the screen as PPM or PNG
+	save FILE		save a snapshot of the machine (see armsnap.h)
+	echo TEXT		print TEXT
+	quit [STATUS]		stop the emulator with this exit status
+	back COUNT		run back COUNT instructions (needs -b)
+	backto ADDR		run back to just before the last write to
+				the DRAM word at physical address ADDR
+
+   Going back takes the guest back but not the script, which goes on
+   from the command after, timed from there.  A failed hash stops the
+   emulator with status 1.  What happens when the script runs out of
+   commands is up to at_end. */
+
+#define SCRIPT_TAP_MS		50
+#define SCRIPT_HASH_TIMEOUT	60	/* seconds of guest time */
+#define SCRIPT_POLL_HZ		50	/* hash checks per guest second */
+
+#define SCRIPT_END_RUN		0	/* the guest carries on */
+#define SCRIPT_END_STOP		1	/* the CPU stops (see armfork.c) */
+#define SCRIPT_END_QUIT		2	/* quit with status 0 */
+
+typedef struct script_cmd_t {
+	int		op;
+	unsigned long long n;		/* time, code, hash or status */
+	unsigned long long limit;	/* hash timeout */
+	int		x, y;
+	char *		text;
+	int		line;
+} script_cmd_t;
+
+typedef struct script_state_t {
+	const char *	name;
+	script_cmd_t *	cmds;
+	int		ncmds;
+	int		pc;			/* next command */
+	int		text_pos;		/* uart bytes already sent */
+	unsigned long long now;			/* guest cycles since the start */
+	unsigned long long start;		/* ARMul_Time when it started */
+	unsigned long long mark;		/* when command pc started */
+	int		status;			/* exit status */
+	int		quit;			/* script_quit() was called */
+	int		at_end;			/* SCRIPT_END_* */
+	int		finished;		/* ran out of commands */
+} script_state_t;
+
+
+int	script_open(ARMul_State *state, const char *filename);
+void	script_close(ARMul_State *state);
+void	script_quit(ARMul_State *state, int status);
+void	script_resume(ARMul_State *state, const script_state_t *live);
+
+
+#endif	/* _ARMSCRIPT_H_ */
@@ -0,0 +1,303 @@
+/*
+    armshot.c - LCD screenshots and frame hashing, independent of X.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "armdefs.h"
+
+
+unsigned long shot_palette[GREY_LEVELS] = {
+ 0x00a7c57f, 0x009bb776, 0x0090aa6e, 0x00859d65,
+ 0x007a905d, 0x006f8354, 0x0064764c, 0x00596943,
+ 0x004d5b3b, 0x00424e32, 0x0037412a, 0x002c3421,
+ 0x00212719, 0x00161a10, 0x000b0d08, 0x00000000};
+
+
+void
+shot_render(const unsigned char *fb, int width, int height, int depth,
+	    ARMword pallsw, ARMword palmsw, unsigned char *rgb)
+{
+	unsigned long lut[16];
+	long pixnum, pixels = (long)width * height;
+	int i, mask = (1 << depth) - 1;
+
+	for (i = 0; i < 16; i++) {
+		ARMword pal = (i & 8) ? palmsw : pallsw;
+		lut[i] = shot_palette[(pal >> ((i & 7) * 4)) & 15];
+	}
+	for (pixnum = 0; pixnum < pixels; pixnum++) {
+		long bit = pixnum * depth;
+		unsigned long c = lut[(fb[bit >> 3] >> (bit & 7)) & mask];
+
+		*rgb++ = c >> 16;
+		*rgb++ = c >> 8;
+		*rgb++ = c;
+	}
+}
+
+int
+shot_write_ppm(FILE *f, const unsigned char *rgb, int width, int height)
+{
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	if (fwrite(rgb, 3, (size_t)width * height, f) != (size_t)width * height) {
+		return -1;
+	}
+	return 0;
+}
+
+
+/* A minimal PNG encoder: 8-bit RGB, no filtering, and the zlib stream
+   is made of stored (uncompressed) deflate blocks.  Screenshots are
+   small enough that this is not worth a dependency on libpng. */
+
+static unsigned long crc_table[256];
+
+static unsigned long
+png_crc(unsigned long crc, const unsigned char *p, long len)
+{
+	if (!crc_table[1]) {
+		unsigned long c;
+		int n, k;
+
+		for (n = 0; n < 256; n++) {
+			c = n;
+			for (k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			crc_table[n] = c;
+		}
+	}
+	crc ^= 0xffffffffUL;
+	while (len-- > 0)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffffUL;
+}
+
+static void
+put_be32(unsigned char *p, unsigned long v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int
+png_chunk(FILE *f, const char *type, const unsigned char *data, long len)
+{
+	unsigned char buf[4];
+	unsigned long crc;
+
+	put_be32(buf, len);
+	fwrite(buf, 1, 4, f);
+	fwrite(type, 1, 4, f);
+	if (len)
+		fwrite(data, 1, len, f);
+	crc = png_crc(0, (const unsigned char *)type, 4);
+	crc = png_crc(crc, data, len);
+	put_be32(buf, crc);
+	fwrite(buf, 1, 4, f);
+	return ferror(f) ? -1 : 0;
+}
+
+int
+shot_write_png(FILE *f, const unsigned char *rgb, int width, int height)
+{
+	static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	unsigned char ihdr[13];
+	unsigned char *idat, *p;
+	long stride = (long)width * 3 + 1;	/* filter byte + pixels */
+	long raw = stride * height;
+	long blocks = (raw + 65534) / 65535;
+	unsigned long a = 1, b = 0;
+	long i, left;
+	int y, ret;
+
+	put_be32(ihdr, width);
+	put_be32(ihdr + 4, height);
+	ihdr[8] = 8;		/* bit depth */
+	ihdr[9] = 2;		/* truecolour */
+	ihdr[10] = 0;		/* deflate */
+	ihdr[11] = 0;		/* adaptive filtering */
+	ihdr[12] = 0;		/* no interlace */
+
+	idat = malloc(2 + raw + blocks * 5 + 4);
+	if (!idat) {
+		return -1;
+	}
+	p = idat;
+	*p++ = 0x78;		/* deflate, 32K window */
+	*p++ = 0x01;		/* no preset dictionary, fastest */
+	left = 0;
+	for (y = 0, i = 0; i < raw; i++) {
+		unsigned char c;
+
+		if (left == 0) {
+			long n = raw - i < 65535 ? raw - i : 65535;
+
+			*p++ = (raw - i <= 65535);	/* BFINAL, stored */
+			*p++ = n;
+			*p++ = n >> 8;
+			*p++ = ~n;
+			*p++ = ~n >> 8;
+			left = n;
+		}
+		if (i % stride == 0) {
+			c = 0;			/* filter: none */
+		} else {
+			c = rgb[(long)y * width * 3 + (i % stride) - 1];
+			if (i % stride == stride - 1)
+				y++;
+		}
+		*p++ = c;
+		left--;
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	put_be32(p, (b << 16) | a);
+	p += 4;
+
+	fwrite(sig, 1, 8, f);
+	ret = png_chunk(f, "IHDR", ihdr, 13);
+	if (!ret)
+		ret = png_chunk(f, "IDAT", idat, p - idat);
+	if (!ret)
+		ret = png_chunk(f, "IEND", NULL, 0);
+	free(idat);
+	return ret;
+}
+
+
+/* Frame hash: 64-bit FNV-1a taken a 32-bit word at a time, with a final
+   avalanche.  It covers the geometry and palette as well as the pixels,
+   so equal hashes mean equal screens. */
+
+#define FNV_OFFSET	0xcbf29ce484222325ULL
+#define FNV_PRIME	0x100000001b3ULL
+
+unsigned long long
+shot_hash_raw(const unsigned char *fb, int width, int height, int depth,
+	      ARMword pallsw, ARMword palmsw)
+{
+	unsigned long long h = FNV_OFFSET;
+	long i, size = (long)width * height * depth / 8;
+
+	h = (h ^ (unsigned)width) * FNV_PRIME;
+	h = (h ^ (unsigned)height) * FNV_PRIME;
+	h = (h ^ (unsigned)depth) * FNV_PRIME;
+	h = (h ^ (pallsw & 0xffffffffUL)) * FNV_PRIME;
+	h = (h ^ (palmsw & 0xffffffffUL)) * FNV_PRIME;
+	for (i = 0; i + 4 <= size; i += 4) {
+		unsigned long w = fb[i] | (fb[i + 1] << 8) |
+				  (fb[i + 2] << 16) | ((unsigned long)fb[i + 3] << 24);
+		h = (h ^ w) * FNV_PRIME;
+	}
+	for (; i < size; i++) {
+		h = (h ^ fb[i]) * FNV_PRIME;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+long
+shot_fb_size(ARMul_State *state)
+{
+	if (!state->lcd.width) {
+		return -1;
+	}
+	return (long)state->lcd.width * state->lcd.height * state->lcd.depth / 8;
+}
+
+/* Copy the framebuffer out of DRAM into guest byte order.  LCD_BASE is
+   the bottom of DRAM, so this indexes mem.dram directly rather than going
+   through the memory map; that keeps this file free of link dependencies
+   for the stand-alone tools. */
+void
+shot_read_fb(ARMul_State *state, unsigned char *fb)
+{
+	long i, size = shot_fb_size(state);
+
+	for (i = 0; i < size; i += 4) {
+		ARMword w = state->mem.dram[i >> 2];
+		int n;
+
+		for (n = 0; n < 4 && i + n < size; n++, w >>= 8)
+			fb[i + n] = w;
+	}
+}
+
+unsigned long long
+shot_hash(ARMul_State *state)
+{
+	unsigned long long h;
+	unsigned char *fb;
+	long size = shot_fb_size(state);
+
+	if (size < 0 || !(fb = malloc(size))) {
+		return 0;
+	}
+	shot_read_fb(state, fb);
+	h = shot_hash_raw(fb, state->lcd.width, state->lcd.height,
+			  state->lcd.depth, state->io.pallsw, state->io.palmsw);
+	free(fb);
+	return h;
+}
+
+/* Write a PNG if the name ends in .png, otherwise a binary PPM. */
+int
+shot_save(ARMul_State *state, const char *filename)
+{
+	unsigned char *fb, *rgb;
+	long size = shot_fb_size(state);
+	int ret, width = state->lcd.width, height = state->lcd.height;
+	size_t len = strlen(filename);
+	FILE *f;
+
+	if (size < 0) {
+		return -1;
+	}
+	fb = malloc(size);
+	rgb = malloc((size_t)width * height * 3);
+	f = fopen(filename, "wb");
+	if (!fb || !rgb || !f) {
+		if (!f)
+			perror(filename);
+		free(fb);
+		free(rgb);
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	shot_read_fb(state, fb);
+	shot_render(fb, width, height, state->lcd.depth,
+		    state->io.pallsw, state->io.palmsw, rgb);
+	if (len > 4 && !strcmp(filename + len - 4, ".png"))
+		ret = shot_write_png(f, rgb, width, height);
+	else
+		ret = shot_write_ppm(f, rgb, width, height);
+	if (fclose(f))
+		ret = -1;
+	free(fb);
+	free(rgb);
+	return ret;
+}
@@ -0,0 +1,49 @@
+/*
+    armshot.h - LCD screenshots and frame hashing, independent of X.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMSHOT_H_
+#define _ARMSHOT_H_
+
+
+/* 0x00RRGGBB for each of the 16 grey levels of the LCD */
+extern unsigned long shot_palette[GREY_LEVELS];
+
+/* Raw helpers that work on a copy of the guest framebuffer, so tools
+   without an ARMul_State can use them.  fb holds the framebuffer bytes
+   in guest order (pixel 0 in the low bits of byte 0). */
+
+void	shot_render(const unsigned char *fb, int width, int height, int depth,
+		    ARMword pallsw, ARMword palmsw, unsigned char *rgb);
+int	shot_write_ppm(FILE *f, const unsigned char *rgb, int width, int height);
+int	shot_write_png(FILE *f, const unsigned char *rgb, int width, int height);
+unsigned long long
+	shot_hash_raw(const unsigned char *fb, int width, int height, int depth,
+		      ARMword pallsw, ARMword palmsw);
+
+/* The same on the live guest LCD.  These return -1 (or a hash of 0) if
+   the guest has never programmed the LCD. */
+
+long	shot_fb_size(ARMul_State *state);
+void	shot_read_fb(ARMul_State *state, unsigned char *fb);
+int	shot_save(ARMul_State *state, const char *filename);
+unsigned long long
+	shot_hash(ARMul_State *state);
+
+
+#endif	/* _ARMSHOT_H_ */
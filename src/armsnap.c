@@ -0,0 +1,1316 @@
+/*
+    armsnap.c - Saving and restoring the whole machine.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "armdefs.h"
+#include "armemu.h"
+
+/* cf xfer points into */
+#define XFER_NONE	0
+#define XFER_IDENTIFY	1
+#define XFER_IMAGE	2
+
+extern unsigned char keyboard[8];
+
+static const snap_event_t *event_tables[] = {
+	io_events, uart_events, codec_events, ssi_events, script_events,
+	snap_events, replay_events, reverse_events, run_events
+};
+
+#define EVENT_TABLES	(sizeof(event_tables) / sizeof(event_tables[0]))
+
+
+/* A section is built in, or read from, a buffer.  Reads past the end
+   return zeros and mark the buffer bad, so the loader only checks
+   once per section. */
+
+typedef struct snap_buf_t {
+	unsigned char *	data;
+	long		len, size;
+	long		pos;
+	int		bad;
+} snap_buf_t;
+
+static void
+put_bytes(snap_buf_t *b, const void *p, long n)
+{
+	if (b->len + n > b->size) {
+		b->size = (b->len + n) * 2;
+		b->data = realloc(b->data, b->size);
+		if (!b->data) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+}
+
+static void
+put_u32(snap_buf_t *b, unsigned long v)
+{
+	unsigned char c[4];
+	int i;
+
+	for (i = 0; i < 4; i++, v >>= 8)
+		c[i] = v;
+	put_bytes(b, c, 4);
+}
+
+static void
+put_u64(snap_buf_t *b, unsigned long long v)
+{
+	put_u32(b, v & 0xffffffff);
+	put_u32(b, v >> 32);
+}
+
+static void
+get_bytes(snap_buf_t *b, void *p, long n)
+{
+	if (b->pos + n > b->len) {
+		b->bad = 1;
+		memset(p, 0, n);
+		return;
+	}
+	memcpy(p, b->data + b->pos, n);
+	b->pos += n;
+}
+
+static unsigned long
+get_u32(snap_buf_t *b)
+{
+	unsigned char c[4];
+
+	get_bytes(b, c, 4);
+	return c[0] | (c[1] << 8) | (c[2] << 16) | ((unsigned long)c[3] << 24);
+}
+
+static unsigned long long
+get_u64(snap_buf_t *b)
+{
+	unsigned long long lo = get_u32(b);
+
+	return lo | ((unsigned long long)get_u32(b) << 32);
+}
+
+static void
+put_words(snap_buf_t *b, const ARMword *w, int n)
+{
+	while (n--)
+		put_u32(b, *w++);
+}
+
+static void
+get_words(snap_buf_t *b, ARMword *w, int n)
+{
+	while (n--)
+		*w++ = get_u32(b);
+}
+
+static int
+put_section(FILE *f, const char *tag, snap_buf_t *b)
+{
+	unsigned char h[8];
+	int i;
+
+	memcpy(h, tag, 4);
+	for (i = 0; i < 4; i++)
+		h[4 + i] = b->len >> (8 * i);
+	if (fwrite(h, 1, 8, f) != 8 ||
+	    (b->len && fwrite(b->data, 1, b->len, f) != b->len))
+		return -1;
+	b->len = 0;
+	return 0;
+}
+
+
+/* Events */
+
+static const snap_event_t *
+event_by_func(unsigned (*func)())
+{
+	const snap_event_t *e;
+	int t;
+
+	for (t = 0; t < EVENT_TABLES; t++)
+		for (e = event_tables[t]; e->func; e++)
+			if (e->func == func)
+				return e;
+	return NULL;
+}
+
+static const snap_event_t *
+event_by_name(const char *name)
+{
+	const snap_event_t *e;
+	int t;
+
+	for (t = 0; t < EVENT_TABLES; t++)
+		for (e = event_tables[t]; e->func; e++)
+			if (e->name && !strcmp(e->name, name))
+				return e;
+	return NULL;
+}
+
+/* Pending events in the order they were scheduled, for the loader to
+   schedule them in the same order. */
+static int
+event_order(const void *a, const void *b)
+{
+	const struct EventNode *x = a, *y = b;
+
+	return (long)(x->seq - y->seq) < 0 ? -1 : x->seq != y->seq;
+}
+
+static int
+save_events(ARMul_State *state, snap_buf_t *b)
+{
+	struct EventNode *ev = malloc((state->EventSet + 1) * sizeof(*ev));
+	const snap_event_t *e;
+	unsigned i, n = 0;
+
+	if (!ev) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	for (i = 0; i < state->EventSet; i++) {
+		e = event_by_func(state->Events[i].func);
+		if (!e) {
+			fprintf(stderr, "Snapshot: an event has no name\n");
+			free(ev);
+			return -1;
+		}
+		if (e->name)
+			ev[n++] = state->Events[i];
+	}
+	qsort(ev, n, sizeof(ev[0]), event_order);
+	put_u32(b, state->EventSeq);
+	put_u32(b, n);
+	for (i = 0; i < n; i++) {
+		e = event_by_func(ev[i].func);
+		put_u32(b, strlen(e->name));
+		put_bytes(b, e->name, strlen(e->name));
+		put_u64(b, ev[i].when);
+		put_u32(b, ev[i].seq);
+	}
+	free(ev);
+	return 0;
+}
+
+/* Replace whatever reset scheduled with the saved events, giving each
+   back its deadline and its place among events due together. */
+static int
+load_events(ARMul_State *state, snap_buf_t *b)
+{
+	const snap_event_t *e;
+	unsigned long seq = get_u32(b), n = get_u32(b), i, len;
+	unsigned long long when;
+	char name[64];
+	int t;
+
+	for (t = 0; t < EVENT_TABLES; t++)
+		for (e = event_tables[t]; e->func; e++)
+			ARMul_CancelEvent(state, e->func);
+	/* a name, at least, a deadline and a seq each */
+	if (n > (b->len - b->pos) / 16)
+		return -1;
+	for (i = 0; i < n; i++) {
+		len = get_u32(b);
+		if (len >= sizeof(name))
+			return -1;
+		get_bytes(b, name, len);
+		name[len] = 0;
+		when = get_u64(b);
+		state->EventSeq = get_u32(b);
+		if (b->bad)
+			return -1;
+		if (!(e = event_by_name(name))) {
+			fprintf(stderr, "Snapshot: unknown event %s\n", name);
+			return -1;
+		}
+		if (ARMul_ScheduleEvent(state, when > state->Cycles ?
+					when - state->Cycles : 0, e->func))
+			return -1;
+	}
+	state->EventSeq = seq;
+	return 0;
+}
+
+
+/* The sections */
+
+static void
+save_cpu(ARMul_State *state, snap_buf_t *b)
+{
+	put_words(b, state->Reg, 16);
+	put_words(b, &state->RegBank[0][0], 7 * 16);
+	put_u32(b, state->Cpsr);
+	put_words(b, state->Spsr, 7);
+	put_u32(b, state->NFlag);
+	put_u32(b, state->ZFlag);
+	put_u32(b, state->CFlag);
+	put_u32(b, state->VFlag);
+	put_u32(b, state->IFFlags);
+#ifdef MODET
+	put_u32(b, state->TFlag);
+#else
+	put_u32(b, 0);
+#endif
+	put_u32(b, state->Bank);
+	put_u32(b, state->Mode);
+	put_u32(b, state->instr);
+	put_u32(b, state->pc);
+	put_u32(b, state->temp);
+	put_u32(b, state->loaded);
+	put_u32(b, state->decoded);
+	put_u32(b, state->NextInstr);
+	put_u32(b, state->Exception);
+	put_u32(b, state->IntPend);
+	put_u32(b, state->NresetSig);
+	put_u32(b, state->NfiqSig);
+	put_u32(b, state->NirqSig);
+	put_u32(b, state->abortSig);
+	put_u32(b, state->NtransSig);
+	put_u32(b, state->bigendSig);
+	put_u32(b, state->prog32Sig);
+	put_u32(b, state->data32Sig);
+	put_u32(b, state->lateabtSig);
+	put_u32(b, state->Vector);
+	put_u32(b, state->Aborted);
+	put_u32(b, state->Reseted);
+	put_u32(b, state->Inted);
+	put_u32(b, state->LastInted);
+	put_u32(b, state->Base);
+	put_u32(b, state->AbortAddr);
+	put_u64(b, state->Cycles);
+	put_u64(b, state->NumInstrs);
+	put_u32(b, state->cpu_clock);
+	put_u32(b, state->deterministic);
+}
+
+static void
+load_cpu(ARMul_State *state, snap_buf_t *b)
+{
+	get_words(b, state->Reg, 16);
+	get_words(b, &state->RegBank[0][0], 7 * 16);
+	state->Cpsr = get_u32(b);
+	get_words(b, state->Spsr, 7);
+	state->NFlag = get_u32(b);
+	state->ZFlag = get_u32(b);
+	state->CFlag = get_u32(b);
+	state->VFlag = get_u32(b);
+	state->IFFlags = get_u32(b);
+#ifdef MODET
+	state->TFlag = get_u32(b);
+#else
+	get_u32(b);
+#endif
+	state->Bank = get_u32(b);
+	state->Mode = get_u32(b);
+	state->instr = get_u32(b);
+	state->pc = get_u32(b);
+	state->temp = get_u32(b);
+	state->loaded = get_u32(b);
+	state->decoded = get_u32(b);
+	state->NextInstr = get_u32(b);
+	state->Exception = get_u32(b);
+	state->IntPend = get_u32(b);
+	state->NresetSig = get_u32(b);
+	state->NfiqSig = get_u32(b);
+	state->NirqSig = get_u32(b);
+	state->abortSig = get_u32(b);
+	state->NtransSig = get_u32(b);
+	state->bigendSig = get_u32(b);
+	state->prog32Sig = get_u32(b);
+	state->data32Sig = get_u32(b);
+	state->lateabtSig = get_u32(b);
+	state->Vector = get_u32(b);
+	state->Aborted = get_u32(b);
+	state->Reseted = get_u32(b);
+	state->Inted = get_u32(b);
+	state->LastInted = get_u32(b);
+	state->Base = get_u32(b);
+	state->AbortAddr = get_u32(b);
+	state->Cycles = get_u64(b);
+	state->NumInstrs = get_u64(b);
+	state->cpu_clock = get_u32(b);
+	state->deterministic = get_u32(b);
+}
+
+static void
+save_mmu(ARMul_State *state, snap_buf_t *b)
+{
+	mmu_state_t *mmu = &state->mmu;
+	int i, j;
+
+	put_u32(b, mmu->control);
+	put_u32(b, mmu->translation_table_base);
+	put_u32(b, mmu->domain_access_control);
+	put_u32(b, mmu->fault_status);
+	put_u32(b, mmu->fault_address);
+	put_u32(b, mmu->tlb_cycle);
+	put_u32(b, mmu->last_domain);
+	for (i = 0; i < CACHE_LINES; i++)
+		for (j = 0; j < CACHE_BANKS; j++) {
+			put_words(b, mmu->cache[i][j].data, 4);
+			put_u32(b, mmu->cache[i][j].tag);
+		}
+	for (i = 0; i < TLB_ENTRIES; i++) {
+		put_u32(b, mmu->tlb[i].virt_addr);
+		put_u32(b, mmu->tlb[i].phys_addr);
+		put_u32(b, mmu->tlb[i].perms);
+		put_u32(b, mmu->tlb[i].domain);
+		put_u32(b, mmu->tlb[i].mapping);
+	}
+}
+
+static void
+load_mmu(ARMul_State *state, snap_buf_t *b)
+{
+	mmu_state_t *mmu = &state->mmu;
+	int i, j;
+
+	mmu->control = get_u32(b);
+	mmu->translation_table_base = get_u32(b);
+	mmu->domain_access_control = get_u32(b);
+	mmu->fault_status = get_u32(b);
+	mmu->fault_address = get_u32(b);
+	mmu->tlb_cycle = get_u32(b);
+	mmu->last_domain = get_u32(b);
+	for (i = 0; i < CACHE_LINES; i++)
+		for (j = 0; j < CACHE_BANKS; j++) {
+			get_words(b, mmu->cache[i][j].data, 4);
+			mmu->cache[i][j].tag = get_u32(b);
+		}
+	for (i = 0; i < TLB_ENTRIES; i++) {
+		mmu->tlb[i].virt_addr = get_u32(b);
+		mmu->tlb[i].phys_addr = get_u32(b);
+		mmu->tlb[i].perms = get_u32(b);
+		mmu->tlb[i].domain = get_u32(b);
+		mmu->tlb[i].mapping = get_u32(b);
+	}
+}
+
+/* Which way of the cache the next refill takes.  A section of its own,
+   "VICT", which older snapshots go without: they chose with rand(),
+   and keep the seed from reset. */
+static void
+save_victim(ARMul_State *state, snap_buf_t *b)
+{
+	put_u32(b, state->mmu.victim);
+}
+
+static void
+load_victim(ARMul_State *state, snap_buf_t *b)
+{
+	state->mmu.victim = get_u32(b);
+}
+
+static void
+save_io(ARMul_State *state, snap_buf_t *b)
+{
+	io_state_t *io = &state->io;
+
+	put_u32(b, io->syscon);
+	put_u32(b, io->sysflg);
+	put_u32(b, io->intmr);
+	put_u32(b, io->intsr);
+	put_words(b, io->tcd, 2);
+	put_words(b, io->tcd_reload, 2);
+	put_u64(b, io->tc_base[0]);
+	put_u64(b, io->tc_base[1]);
+	put_u32(b, io->tc_freq[0]);
+	put_u32(b, io->tc_freq[1]);
+	put_u64(b, io->rtc_offset);
+	put_u32(b, io->rtcmr);
+	put_u32(b, io->rtc_armed);
+	put_u64(b, io->rtc_base);
+	put_u32(b, io->lcdcon);
+	put_u32(b, io->pallsw);
+	put_u32(b, io->palmsw);
+	put_bytes(b, keyboard, sizeof(keyboard));
+}
+
+static void
+load_io(ARMul_State *state, snap_buf_t *b)
+{
+	io_state_t *io = &state->io;
+
+	io->syscon = get_u32(b);
+	io->sysflg = get_u32(b);
+	io->intmr = get_u32(b);
+	io->intsr = get_u32(b);
+	get_words(b, io->tcd, 2);
+	get_words(b, io->tcd_reload, 2);
+	io->tc_base[0] = get_u64(b);
+	io->tc_base[1] = get_u64(b);
+	io->tc_freq[0] = get_u32(b);
+	io->tc_freq[1] = get_u32(b);
+	io->rtc_offset = get_u64(b);
+	io->rtcmr = get_u32(b);
+	io->rtc_armed = get_u32(b);
+	io->rtc_base = get_u64(b);
+	io->lcdcon = get_u32(b);
+	io->pallsw = get_u32(b);
+	io->palmsw = get_u32(b);
+	get_bytes(b, keyboard, sizeof(keyboard));
+}
+
+static void
+save_lcd(ARMul_State *state, snap_buf_t *b)
+{
+	put_u32(b, state->lcd.enabled);
+	put_u32(b, state->lcd.width);
+	put_u32(b, state->lcd.height);
+	put_u32(b, state->lcd.depth);
+}
+
+/* Only read here: the display is set up once everything is loaded. */
+static void
+load_lcd(ARMul_State *state, snap_buf_t *b)
+{
+	state->lcd.enabled = get_u32(b);
+	state->lcd.width = get_u32(b);
+	state->lcd.height = get_u32(b);
+	state->lcd.depth = get_u32(b);
+}
+
+static void
+save_uart(ARMul_State *state, snap_buf_t *b)
+{
+	uart_state_t *uart = &state->uart;
+
+	put_u32(b, uart->ubrlcr);
+	put_words(b, uart->rx_fifo, UART_FIFO);
+	put_u32(b, uart->rx_head);
+	put_u32(b, uart->rx_count);
+	put_bytes(b, uart->tx_fifo, UART_FIFO);
+	put_u32(b, uart->tx_head);
+	put_u32(b, uart->tx_count);
+	put_u32(b, uart->rx_idle);
+	put_u32(b, uart->rx_timeout);
+	put_u32(b, uart->rx_running);
+	put_u32(b, uart->tx_running);
+	put_u32(b, uart->char_cycles);
+	put_bytes(b, uart->inject, UART_INJECT);
+	put_u32(b, uart->inject_head);
+	put_u32(b, uart->inject_count);
+}
+
+static void
+load_uart(ARMul_State *state, snap_buf_t *b)
+{
+	uart_state_t *uart = &state->uart;
+
+	uart->ubrlcr = get_u32(b);
+	get_words(b, uart->rx_fifo, UART_FIFO);
+	uart->rx_head = get_u32(b);
+	uart->rx_count = get_u32(b);
+	get_bytes(b, uart->tx_fifo, UART_FIFO);
+	uart->tx_head = get_u32(b);
+	uart->tx_count = get_u32(b);
+	uart->rx_idle = get_u32(b);
+	uart->rx_timeout = get_u32(b);
+	uart->rx_running = get_u32(b);
+	uart->tx_running = get_u32(b);
+	uart->char_cycles = get_u32(b);
+	get_bytes(b, uart->inject, UART_INJECT);
+	uart->inject_head = get_u32(b);
+	uart->inject_count = get_u32(b);
+}
+
+static void
+save_cf(ARMul_State *state, snap_buf_t *b)
+{
+	cf_state_t *cf = &state->cf;
+	int kind = XFER_NONE;
+	long offset = 0;
+
+	if (cf->xfer_left && cf->xfer >= cf->identify &&
+	    cf->xfer <= cf->identify + CF_SECTOR) {
+		kind = XFER_IDENTIFY;
+		offset = cf->xfer - cf->identify;
+	} else if (cf->xfer_left) {
+		kind = XFER_IMAGE;
+		offset = cf->xfer - cf->image;
+	}
+	put_u64(b, cf->image ? cf->sectors : 0);
+	put_u32(b, cf->feature);
+	put_u32(b, cf->count);
+	put_words(b, cf->lba, 4);
+	put_u32(b, cf->status);
+	put_u32(b, cf->error);
+	put_u32(b, cf->dma_addr);
+	put_u32(b, kind);
+	put_u64(b, offset);
+	put_u32(b, cf->xfer_left);
+	put_u32(b, cf->sectors_left);
+	put_u32(b, cf->writing);
+}
+
+static int
+load_cf(ARMul_State *state, snap_buf_t *b)
+{
+	cf_state_t *cf = &state->cf;
+	unsigned long long sectors = get_u64(b), offset;
+	int kind;
+
+	if (sectors != (cf->image ? cf->sectors : 0)) {
+		fprintf(stderr, "Snapshot: it was saved with a %llu sector card, "
+			"not %llu\n", sectors, cf->image ? cf->sectors : 0);
+		return -1;
+	}
+	cf->feature = get_u32(b);
+	cf->count = get_u32(b);
+	get_words(b, cf->lba, 4);
+	cf->status = get_u32(b);
+	cf->error = get_u32(b);
+	cf->dma_addr = get_u32(b);
+	kind = get_u32(b);
+	offset = get_u64(b);
+	cf->xfer_left = get_u32(b);
+	cf->sectors_left = get_u32(b);
+	cf->writing = get_u32(b);
+	if (kind == XFER_IDENTIFY && offset <= CF_SECTOR)
+		cf->xfer = cf->identify + offset;
+	else if (kind == XFER_IMAGE && offset <= sectors * CF_SECTOR)
+		cf->xfer = cf->image + offset;
+	else
+		cf->xfer_left = 0;
+	return 0;
+}
+
+static void
+save_codec(ARMul_State *state, snap_buf_t *b)
+{
+	codec_state_t *codec = &state->codec;
+
+	put_bytes(b, codec->tx_fifo, CODEC_FIFO);
+	put_u32(b, codec->tx_head);
+	put_u32(b, codec->tx_count);
+	put_bytes(b, codec->rx_fifo, CODEC_FIFO);
+	put_u32(b, codec->rx_head);
+	put_u32(b, codec->rx_count);
+	put_u32(b, codec->running);
+	put_u64(b, codec->frame_base);
+	put_u64(b, codec->frames);
+}
+
+static void
+load_codec(ARMul_State *state, snap_buf_t *b)
+{
+	codec_state_t *codec = &state->codec;
+
+	get_bytes(b, codec->tx_fifo, CODEC_FIFO);
+	codec->tx_head = get_u32(b);
+	codec->tx_count = get_u32(b);
+	get_bytes(b, codec->rx_fifo, CODEC_FIFO);
+	codec->rx_head = get_u32(b);
+	codec->rx_count = get_u32(b);
+	codec->running = get_u32(b);
+	codec->frame_base = get_u64(b);
+	codec->frames = get_u64(b);
+}
+
+static void
+save_ssi(ARMul_State *state, snap_buf_t *b)
+{
+	ssi_state_t *ssi = &state->ssi;
+
+	put_u32(b, ssi->result);
+	put_u32(b, ssi->command);
+	put_u32(b, ssi->busy);
+	put_u32(b, ssi->penirq);
+	put_u32(b, ssi->pen_down);
+	put_u32(b, ssi->pen_x);
+	put_u32(b, ssi->pen_y);
+}
+
+static void
+load_ssi(ARMul_State *state, snap_buf_t *b)
+{
+	ssi_state_t *ssi = &state->ssi;
+
+	ssi->result = get_u32(b);
+	ssi->command = get_u32(b);
+	ssi->busy = get_u32(b);
+	ssi->penirq = get_u32(b);
+	ssi->pen_down = get_u32(b);
+	ssi->pen_x = get_u32(b);
+	ssi->pen_y = get_u32(b);
+}
+
+/* DRAM, a page number and its contents for each page that isn't all
+   zero; in a delta ("DDRM"), for each page written since the base,
+   zero or not.  Guest words are stored little-endian like everything
+   else. */
+
+static int
+page_is_zero(const ARMword *w)
+{
+	int i;
+
+	for (i = 0; i < SNAP_PAGE / 4; i++)
+		if (w[i])
+			return 0;
+	return 1;
+}
+
+static void
+save_dram(ARMul_State *state, snap_buf_t *b)
+{
+	const ARMword *w;
+	long page;
+
+	for (page = 0; page < DRAM_PAGES; page++) {
+		w = state->mem.dram + page * (SNAP_PAGE / 4);
+		if (page_is_zero(w))
+			continue;
+		put_u32(b, page);
+		put_words(b, w, SNAP_PAGE / 4);
+	}
+}
+
+static void
+save_dram_delta(ARMul_State *state, snap_buf_t *b)
+{
+	long page;
+
+	for (page = 0; page < DRAM_PAGES; page++)
+		if (state->mem.dirty[page] & MEM_DIRTY_SNAP) {
+			put_u32(b, page);
+			put_words(b, state->mem.dram + page * (SNAP_PAGE / 4),
+				  SNAP_PAGE / 4);
+		}
+}
+
+static int
+load_dram(ARMul_State *state, snap_buf_t *b, int delta)
+{
+	unsigned long page;
+
+	if (!delta)
+		memset(state->mem.dram, 0, 1 << DRAM_BITS);
+	while (b->pos < b->len) {
+		page = get_u32(b);
+		if (page >= DRAM_PAGES)
+			return -1;
+		get_words(b, state->mem.dram + page * (SNAP_PAGE / 4), SNAP_PAGE / 4);
+	}
+	return 0;
+}
+
+/* The ROM isn't saved, but it had better be the same one. */
+static unsigned long long
+rom_hash(ARMul_State *state)
+{
+	const unsigned char *p = (const unsigned char *)state->mem.rom[0];
+	unsigned long long h = 14695981039346656037ULL;	/* FNV-1a */
+	long i;
+
+	for (i = 0; i < state->mem.rom_size[0]; i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	return h;
+}
+
+static int
+check_rom(ARMul_State *state, snap_buf_t *b)
+{
+	unsigned long long size = get_u64(b), hash = get_u64(b);
+
+	if (size != state->mem.rom_size[0] || hash != rom_hash(state)) {
+		fprintf(stderr, "Snapshot: it was saved with a different ROM\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Snapshots are told apart by an ID, so a delta can check that the
+   file it names as its base is still the one it was saved against. */
+static unsigned long long
+new_id(void)
+{
+	static unsigned long long count;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (ts.tv_sec * 1000000000ULL + ts.tv_nsec) ^
+		((unsigned long long)getpid() << 40) ^ count++;
+}
+
+static char *
+copy_string(const char *s, int n)
+{
+	char *p = malloc(n + 1);
+
+	if (!p) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	memcpy(p, s, n);
+	p[n] = 0;
+	return p;
+}
+
+/* Length of the directory part of a path, including its '/'. */
+static int
+dir_len(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return slash ? slash - path + 1 : 0;
+}
+
+/* How a delta saved as file refers to base: by its bare name when they
+   share a directory, otherwise by its absolute path. */
+static char *
+base_ref(const char *base, const char *file)
+{
+	char path[PATH_MAX];
+	int n = dir_len(base);
+
+	if (n == dir_len(file) && !memcmp(base, file, n))
+		return copy_string(base + n, strlen(base + n));
+	if (realpath(base, path))
+		return copy_string(path, strlen(path));
+	return copy_string(base, strlen(base));
+}
+
+/* ...and back to a path, from the delta's own name; snapcompact too. */
+char *
+snap_base_path(const char *ref, const char *file)
+{
+	int n = ref[0] == '/' ? 0 : dir_len(file);
+	char *path = malloc(n + strlen(ref) + 1);
+
+	if (!path) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	memcpy(path, file, n);
+	strcpy(path + n, ref);
+	return path;
+}
+
+/* The chain now starts from filename, and DRAM matches it. */
+static void
+set_last(ARMul_State *state, const char *filename, unsigned long long id)
+{
+	char *last = copy_string(filename, strlen(filename));
+
+	free(state->snap.last);
+	state->snap.last = last;
+	state->snap.last_id = id;
+	mem_clean(state, MEM_DIRTY_SNAP);
+}
+
+
+/* The CPU and the guest side of every device: all but DRAM and the
+   events. */
+static int
+put_devices(ARMul_State *state, FILE *f, snap_buf_t *b)
+{
+	int err = 0;
+
+	save_cpu(state, b);
+	err |= put_section(f, "CPU ", b);
+	save_mmu(state, b);
+	err |= put_section(f, "MMU ", b);
+	save_victim(state, b);
+	err |= put_section(f, "VICT", b);
+	save_io(state, b);
+	err |= put_section(f, "IO  ", b);
+	save_lcd(state, b);
+	err |= put_section(f, "LCD ", b);
+	save_uart(state, b);
+	err |= put_section(f, "UART", b);
+	save_cf(state, b);
+	err |= put_section(f, "CF  ", b);
+	save_codec(state, b);
+	err |= put_section(f, "CODC", b);
+	save_ssi(state, b);
+	err |= put_section(f, "SSI ", b);
+	return err;
+}
+
+
+/* Ask for a snapshot from inside the emulator, e.g. from an event.
+   The CPU stops before its next instruction, and whoever runs it
+   saves to filename (see armrun.c) and carries on. */
+void
+snap_request(ARMul_State *state, const char *filename, int delta)
+{
+	state->snap.pending = filename;
+	state->snap.pending_delta = delta;
+	state->Emulate = STOP;
+}
+
+/* Save the machine; only while it isn't running.  The file is written
+   under a temporary name and renamed, so a failed save never leaves
+   half a snapshot behind. */
+static int
+save(ARMul_State *state, const char *filename, int delta)
+{
+	snap_buf_t b = { NULL, 0, 0, 0, 0 };
+	char *tmp = malloc(strlen(filename) + 5), *ref;
+	unsigned long long id = new_id();
+	FILE *f;
+	int err = 0;
+
+	if (!tmp) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	sprintf(tmp, "%s.tmp", filename);
+	f = fopen(tmp, "wb");
+	if (!f) {
+		perror(tmp);
+		free(tmp);
+		return -1;
+	}
+	put_bytes(&b, SNAP_MAGIC, 8);
+	put_u32(&b, SNAP_VERSION);
+	err |= fwrite(b.data, 1, b.len, f) != b.len;
+	b.len = 0;
+
+	put_u64(&b, id);
+	err |= put_section(f, "ID  ", &b);
+	if (delta) {
+		ref = base_ref(state->snap.last, filename);
+		put_u64(&b, state->snap.last_id);
+		put_u32(&b, strlen(ref));
+		put_bytes(&b, ref, strlen(ref));
+		free(ref);
+		err |= put_section(f, "BASE", &b);
+	}
+	put_u64(&b, state->mem.rom_size[0]);
+	put_u64(&b, rom_hash(state));
+	err |= put_section(f, "ROM ", &b);
+	err |= put_devices(state, f, &b);
+	if (save_events(state, &b)) {
+		fclose(f);
+		remove(tmp);
+		free(tmp);
+		free(b.data);
+		return -1;
+	}
+	err |= put_section(f, "EVNT", &b);
+	if (delta) {
+		save_dram_delta(state, &b);
+		err |= put_section(f, "DDRM", &b);
+	} else {
+		save_dram(state, &b);
+		err |= put_section(f, "DRAM", &b);
+	}
+	err |= put_section(f, "END ", &b);
+	free(b.data);
+
+	if (fclose(f) || err || rename(tmp, filename)) {
+		perror(filename);
+		remove(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+	set_last(state, filename, id);
+	return 0;
+}
+
+int
+snap_save(ARMul_State *state, const char *filename)
+{
+	return save(state, filename, 0);
+}
+
+/* Save only what changed since the last snapshot saved or loaded;
+   with none yet, save a full one to start the chain. */
+int
+snap_save_delta(ARMul_State *state, const char *filename)
+{
+	return save(state, filename, state->snap.last != NULL);
+}
+
+
+/* Reading: open a file and check its header, then read it a section
+   at a time into b. */
+
+static FILE *
+open_snap(const char *filename)
+{
+	unsigned char h[12];
+	unsigned long version;
+	FILE *f = fopen(filename, "rb");
+
+	if (!f) {
+		perror(filename);
+		return NULL;
+	}
+	if (fread(h, 1, 12, f) != 12 || memcmp(h, SNAP_MAGIC, 8)) {
+		fprintf(stderr, "%s: not a snapshot\n", filename);
+		fclose(f);
+		return NULL;
+	}
+	version = h[8] | (h[9] << 8) | (h[10] << 16) | ((unsigned long)h[11] << 24);
+	if (version < 1 || version > SNAP_VERSION) {
+		fprintf(stderr, "%s: snapshot version %lu, this emulator reads %d\n",
+			filename, version, SNAP_VERSION);
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+static int
+get_section(FILE *f, char *tag, snap_buf_t *b)
+{
+	unsigned char h[8];
+	unsigned long len;
+
+	if (fread(h, 1, 8, f) != 8)
+		return -1;
+	memcpy(tag, h, 4);
+	tag[4] = 0;
+	len = h[4] | (h[5] << 8) | (h[6] << 16) | ((unsigned long)h[7] << 24);
+	free(b->data);
+	b->data = malloc(len ? len : 1);
+	b->len = b->size = len;
+	b->pos = 0;
+	b->bad = 0;
+	if (!b->data) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	return fread(b->data, 1, len, f) == len ? 0 : -1;
+}
+
+/* Follow a snapshot's bases back to the full one the chain starts
+   from.  Returns the files newest first, and the newest one's ID. */
+static char **
+find_chain(const char *filename, int *n, unsigned long long *id)
+{
+	snap_buf_t b = { NULL, 0, 0, 0, 0 };
+	char **chain = NULL, tag[5], *name, *ref;
+	unsigned long long want = 0, this_id;
+	unsigned long len;
+	int more = 1;
+	FILE *f;
+
+	name = copy_string(filename, strlen(filename));
+	for (*n = 0; more; (*n)++) {
+		chain = realloc(chain, (*n + 1) * sizeof(*chain));
+		if (!chain) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		chain[*n] = name;
+		if (*n > CHAIN_MAX || !(f = open_snap(name)))
+			goto fail;
+
+		/* version 1 files have neither */
+		this_id = 0;
+		if (get_section(f, tag, &b))
+			goto damaged;
+		if (!strcmp(tag, "ID  ")) {
+			this_id = get_u64(&b);
+			if (get_section(f, tag, &b))
+				goto damaged;
+		}
+		if (*n && this_id != want) {
+			fprintf(stderr, "%s: not the snapshot %s was saved "
+				"against\n", name, chain[*n - 1]);
+			fclose(f);
+			goto fail;
+		}
+		if (!*n)
+			*id = this_id;
+		more = !strcmp(tag, "BASE");
+		if (more) {
+			want = get_u64(&b);
+			len = get_u32(&b);
+			if (b.bad || len > b.len - b.pos)
+				goto damaged;
+			ref = copy_string((char *)b.data + b.pos, len);
+			name = snap_base_path(ref, name);
+			free(ref);
+		}
+		fclose(f);
+	}
+	free(b.data);
+	return chain;
+
+damaged:
+	fprintf(stderr, "%s: snapshot is damaged\n", name);
+	fclose(f);
+fail:
+	while (*n >= 0)
+		free(chain[(*n)--]);
+	free(chain);
+	free(b.data);
+	return NULL;
+}
+
+/* Read sections up to "END " into the state. */
+static int
+load_sections(ARMul_State *state, FILE *f)
+{
+	snap_buf_t b = { NULL, 0, 0, 0, 0 };
+	char tag[5];
+	int err = 0, end = 0;
+
+	while (!err && !end) {
+		if (get_section(f, tag, &b)) {
+			err = -1;
+			break;
+		}
+		if (!strcmp(tag, "ROM "))
+			err = check_rom(state, &b);
+		else if (!strcmp(tag, "CPU "))
+			load_cpu(state, &b);
+		else if (!strcmp(tag, "MMU "))
+			load_mmu(state, &b);
+		else if (!strcmp(tag, "VICT"))
+			load_victim(state, &b);
+		else if (!strcmp(tag, "IO  "))
+			load_io(state, &b);
+		else if (!strcmp(tag, "LCD "))
+			load_lcd(state, &b);
+		else if (!strcmp(tag, "UART"))
+			load_uart(state, &b);
+		else if (!strcmp(tag, "CF  "))
+			err = load_cf(state, &b);
+		else if (!strcmp(tag, "CODC"))
+			load_codec(state, &b);
+		else if (!strcmp(tag, "SSI "))
+			load_ssi(state, &b);
+		else if (!strcmp(tag, "EVNT"))
+			err = load_events(state, &b);	/* needs CPU first */
+		else if (!strcmp(tag, "DRAM"))
+			err = load_dram(state, &b, 0);
+		else if (!strcmp(tag, "DDRM"))
+			err = load_dram(state, &b, 1);
+		else if (!strcmp(tag, "END "))
+			end = 1;
+		if (b.bad)
+			err = -1;
+	}
+	free(b.data);
+	return err;
+}
+
+/* Load one file of a chain over whatever its base left. */
+static int
+load_file(ARMul_State *state, const char *filename)
+{
+	FILE *f = open_snap(filename);
+	int err;
+
+	if (!f)
+		return -1;
+	err = load_sections(state, f);
+	fclose(f);
+	if (err) {
+		fprintf(stderr, "%s: snapshot is damaged or doesn't fit "
+			"this machine\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+/* The display follows the guest once it has been loaded. */
+static void
+host_follows(ARMul_State *state)
+{
+	if (state->lcd.enabled)
+		lcd_enable(state, state->lcd.width, state->lcd.height,
+			   state->lcd.depth);
+	else
+		lcd_disable(state);
+}
+
+/* Load a snapshot, and the chain of bases behind it if it's a delta,
+   into a state that has been reset, with its card opened.  The clock
+   rate and deterministic mode come from the snapshot.  If this fails
+   the state is only fit to be reset. */
+int
+snap_load(ARMul_State *state, const char *filename)
+{
+	unsigned long long id;
+	char **chain;
+	int n, i, err = 0;
+
+	if (!(chain = find_chain(filename, &n, &id)))
+		return -1;
+	for (i = n - 1; i >= 0; i--) {
+		if (!err)
+			err = load_file(state, chain[i]);
+		free(chain[i]);
+	}
+	free(chain);
+	if (err)
+		return -1;
+
+	host_follows(state);
+	io_realtime(state);
+	set_last(state, filename, id);
+	return 0;
+}
+
+
+/* The CPU and devices without DRAM or the events, in memory, for
+   armreverse.c to go back to: the same sections as a file.  Returns
+   the bytes, which the caller frees. */
+unsigned char *
+snap_freeze(ARMul_State *state, long *len)
+{
+	snap_buf_t b = { NULL, 0, 0, 0, 0 };
+	char *data = NULL;
+	size_t size = 0;
+	FILE *f = open_memstream(&data, &size);
+	int err;
+
+	if (!f) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	err = put_devices(state, f, &b);
+	err |= put_section(f, "END ", &b);
+	free(b.data);
+	if (fclose(f) || err) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	*len = size;
+	return (unsigned char *)data;
+}
+
+/* ...and back.  The events and DRAM are left as they are. */
+int
+snap_thaw(ARMul_State *state, const unsigned char *data, long len)
+{
+	FILE *f = fmemopen((void *)data, len, "rb");
+	int err;
+
+	if (!f)
+		return -1;
+	err = load_sections(state, f);
+	fclose(f);
+	if (err)
+		return -1;
+	host_follows(state);
+	return 0;
+}
+
+
+/* Periodic checkpoints: a delta every so many guest seconds, each on
+   the one before, so a run can be taken back to any of them. */
+
+static unsigned
+snap_checkpoint(ARMul_State *state)
+{
+	snap_state_t *snap = &state->snap;
+
+	if (REVERSE_REPLAYING(state)) {
+		/* this one was saved the first time round */
+		ARMul_ScheduleEvent(state, snap->ckpt_cycles, snap_checkpoint);
+		return 0;
+	}
+	if (snap->pending) {
+		/* a script's save got there first */
+		ARMul_ScheduleEvent(state, 1, snap_checkpoint);
+		return 0;
+	}
+	free(snap->ckpt_name);
+	snap->ckpt_name = malloc(strlen(snap->ckpt_prefix) + 16);
+	if (!snap->ckpt_name) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	sprintf(snap->ckpt_name, "%s.%04d.snap", snap->ckpt_prefix,
+		snap->ckpt_count++);
+	snap_request(state, snap->ckpt_name, 1);
+	ARMul_ScheduleEvent(state, snap->ckpt_cycles, snap_checkpoint);
+	return 0;
+}
+
+/* The number after the highest PREFIX.NNNN.snap there is already.  A
+   run loaded from one of them carries on past the lot, and never
+   saves over a snapshot its own chain, or any other, is based on. */
+static int
+next_checkpoint(const char *prefix)
+{
+	const char *base = strrchr(prefix, '/');
+	char *dir, tail[8];
+	struct dirent *d;
+	DIR *dp;
+	int len, n, next = 0;
+
+	dir = strdup(prefix);
+	if (!dir) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	if (base) {
+		dir[base - prefix + 1] = 0;
+		base++;
+	} else {
+		strcpy(dir, ".");
+		base = prefix;
+	}
+	len = strlen(base);
+	if ((dp = opendir(dir))) {
+		while ((d = readdir(dp)))
+			if (!strncmp(d->d_name, base, len) &&
+			    d->d_name[len] == '.' &&
+			    sscanf(d->d_name + len + 1, "%d%7s", &n, tail) == 2 &&
+			    !strcmp(tail, ".snap") && n >= next)
+				next = n + 1;
+		closedir(dp);
+	}
+	free(dir);
+	return next;
+}
+
+/* Start checkpointing to PREFIX.NNNN.snap, numbered on from any that
+   are there already.  The first is a delta on the snapshot the run
+   was loaded from, if any, otherwise a full one.  Call after
+   snap_load, which cancels it. */
+void
+snap_checkpoints(ARMul_State *state, const char *prefix, double seconds)
+{
+	snap_state_t *snap = &state->snap;
+
+	snap->ckpt_prefix = prefix;
+	snap->ckpt_count = next_checkpoint(prefix);
+	snap->ckpt_cycles = seconds * state->cpu_clock;
+	if (!snap->ckpt_cycles)
+		snap->ckpt_cycles = 1;
+	ARMul_CancelEvent(state, snap_checkpoint);
+	ARMul_ScheduleEvent(state, snap->ckpt_cycles, snap_checkpoint);
+}
+
+const snap_event_t snap_events[] = {
+	{ NULL, snap_checkpoint },
+	{ NULL, NULL }
+};
@@ -0,0 +1,95 @@
+/*
+    armsnap.h - Saving and restoring the whole machine.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMSNAP_H_
+#define _ARMSNAP_H_
+
+
+/* A snapshot holds everything the guest can see: the CPU registers,
+   banks and pipeline, the MMU with its TLB and cache, the I/O
+   registers and the guest side of every device, DRAM, the LCD
+   geometry and the pending events.  Loaded into a freshly reset
+   state, it carries on exactly where the saving run stopped.
+
+   The host side is not saved.  The ROM, card image, UART endpoint and
+   output files come from the run that loads the snapshot; the ROM and
+   the card's size must match the saving run.  The input script is not
+   saved either, as it belongs to the run.
+
+   The file is little-endian whatever the host:
+
+	"PSIMSNAP", u32 SNAP_VERSION
+	sections of char tag[4], u32 length, then length bytes
+	an "END " section last
+
+   Unknown sections are skipped, so new ones need no new version;
+   changing the layout of an existing one does.  Events are saved by
+   name, from the tables below.
+
+   A delta holds the same sections but for DRAM, where it holds only
+   the pages written since the snapshot this run last saved or loaded,
+   its base.  Its "BASE" section, straight after "ID  ", names the base
+   (relative to the delta's own directory) and carries the base's ID;
+   loading a delta loads the chain of bases first, each checked
+   against the ID its successor expects.  psimulator-snapcompact turns
+   a delta into a full snapshot with the same ID, so the chain behind
+   it can go while the deltas after it still load.  Version 1 files
+   have no ID and no deltas. */
+
+#define SNAP_VERSION	2
+#define SNAP_MAGIC	"PSIMSNAP"
+#define SNAP_PAGE	(1 << DRAM_PAGE_BITS)	/* DRAM is saved in pages */
+#define CHAIN_MAX	100000		/* deltas behind a snapshot, to catch loops */
+
+typedef struct snap_event_t {
+	const char *	name;			/* NULL: never saved */
+	unsigned	(*func)();
+} snap_event_t;
+
+typedef struct snap_state_t {
+	const char *	pending;		/* save here once the CPU stops */
+	int		pending_delta;		/* ... as a delta */
+	char *		last;			/* last saved or loaded, or NULL */
+	unsigned long long last_id;
+	const char *	ckpt_prefix;		/* checkpoints: PREFIX.NNNN.snap */
+	char *		ckpt_name;
+	int		ckpt_count;
+	unsigned long long ckpt_cycles;		/* apart */
+} snap_state_t;
+
+/* Every function each module schedules, ending with a NULL func */
+extern const snap_event_t io_events[];
+extern const snap_event_t uart_events[];
+extern const snap_event_t codec_events[];
+extern const snap_event_t ssi_events[];
+extern const snap_event_t script_events[];
+extern const snap_event_t snap_events[];
+
+
+void	snap_request(ARMul_State *state, const char *filename, int delta);
+int	snap_save(ARMul_State *state, const char *filename);
+int	snap_save_delta(ARMul_State *state, const char *filename);
+int	snap_load(ARMul_State *state, const char *filename);
+void	snap_checkpoints(ARMul_State *state, const char *prefix, double seconds);
+unsigned char *snap_freeze(ARMul_State *state, long *len);
+int	snap_thaw(ARMul_State *state, const unsigned char *data, long len);
+char	*snap_base_path(const char *ref, const char *file);
+
+
+#endif	/* _ARMSNAP_H_ */
@@ -0,0 +1,187 @@
+/*
+    armssi.c - Synchronous serial interface and the touchscreen ADC.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "armdefs.h"
+#include "clps7110.h"
+
+/* control byte */
+#define CB_CHANNEL	0x70
+#define CB_CHANNEL_SHIFT 4
+#define CB_MODE8	0x08		/* 8-bit conversion */
+#define CB_PD0		0x01		/* PENIRQ disabled */
+
+#define CH_Y		1
+#define CH_BATTERY	2
+#define CH_Z1		3
+#define CH_Z2		4
+#define CH_X		5
+
+/* Plausible readings for the channels without a pen behind them.
+   The battery must never read zero: the kernel divides by it. */
+#define ADC_BATTERY	0xc00
+#define ADC_Z1_DOWN	0x400
+#define ADC_Z2_DOWN	0xc00
+
+/* Psion 5 screen, for a pen before the guest sets up the LCD */
+#define DEFAULT_WIDTH	640
+#define DEFAULT_HEIGHT	240
+
+/* SSI clock for each ADCKSEL setting, Hz */
+static const unsigned long ssi_clock[4] = { 4000, 16000, 64000, 128000 };
+
+
+static void
+ssi_update(ARMul_State *state)
+{
+	ssi_state_t *ssi = &state->ssi;
+
+	state->io.sysflg &= ~SSIBUSY;
+	if (ssi->busy)
+		state->io.sysflg |= SSIBUSY;
+	/* the converter holds PENIRQ off while it converts */
+	state->io.intsr &= ~SSI_PEN_INT;
+	if (ssi->pen_down && ssi->penirq && !ssi->busy)
+		state->io.intsr |= SSI_PEN_INT;
+	io_update_int(state);
+}
+
+static ARMword
+ssi_convert(ARMul_State *state, ARMword command)
+{
+	ssi_state_t *ssi = &state->ssi;
+	int value;
+
+	switch ((command & CB_CHANNEL) >> CB_CHANNEL_SHIFT) {
+	case CH_X:
+		value = ssi->pen_down ? ssi->pen_x : 0;
+		break;
+	case CH_Y:
+		value = ssi->pen_down ? ssi->pen_y : 0;
+		break;
+	case CH_Z1:
+		value = ssi->pen_down ? ADC_Z1_DOWN : 0;
+		break;
+	case CH_Z2:
+		value = ssi->pen_down ? ADC_Z2_DOWN : SSI_ADC_MAX;
+		break;
+	case CH_BATTERY:
+	default:
+		value = ADC_BATTERY;
+		break;
+	}
+	if (command & CB_MODE8)
+		value &= ~0xf;
+	return value << 3;
+}
+
+/* The end of a transfer: the result is ready. */
+static unsigned
+ssi_done(ARMul_State *state)
+{
+	ssi_state_t *ssi = &state->ssi;
+
+	ssi->result = ssi_convert(state, ssi->command);
+	ssi->penirq = !(ssi->command & CB_PD0);
+	ssi->busy = 0;
+	state->io.intsr |= SSEOTI;
+	ssi_update(state);
+	return 0;
+}
+
+const snap_event_t ssi_events[] = {
+	{ "ssi", ssi_done },
+	{ NULL, NULL }
+};
+
+void
+ssi_reset(ARMul_State *state)
+{
+	ssi_state_t *ssi = &state->ssi;
+
+	ARMul_CancelEvent(state, ssi_done);
+	ssi->busy = 0;
+	ssi->command = 0;
+	ssi->penirq = 1;
+	/* a read before any transfer sees the battery */
+	ssi->result = ADC_BATTERY << 3;
+	ssi_update(state);
+}
+
+ARMword
+ssi_read_word(ARMul_State *state, ARMword reg)
+{
+	ARMword data = 0;
+
+	switch (reg) {
+	case SYNCIO:
+		data = state->ssi.result & ADCRSW;
+		state->io.intsr &= ~SSEOTI;
+		io_update_int(state);
+		break;
+	}
+	return data;
+}
+
+void
+ssi_write_word(ARMul_State *state, ARMword reg, ARMword data)
+{
+	ssi_state_t *ssi = &state->ssi;
+	unsigned long rate, bits;
+
+	switch (reg) {
+	case SYNCIO:
+		if (!(data & TXFRMEN) || ssi->busy)
+			break;
+		rate = ssi_clock[(state->io.syscon & ADCKSEL) >> ADCKSEL_SHIFT];
+		bits = (data & FRLEN) >> FRLEN_SHIFT;
+		if (!bits)
+			bits = 1;
+		ssi->command = data & ADCCFB;
+		ssi->busy = 1;
+		state->io.intsr &= ~SSEOTI;
+		ssi_update(state);
+		ARMul_ScheduleEvent(state, (unsigned long long)bits *
+				    state->cpu_clock / rate, ssi_done);
+		break;
+	}
+}
+
+/* Move the pen, in LCD pixels.  Positions off the screen are clamped
+   to its edge. */
+void
+ssi_pen(ARMul_State *state, int down, int x, int y)
+{
+	ssi_state_t *ssi = &state->ssi;
+	int width = state->lcd.width ? state->lcd.width : DEFAULT_WIDTH;
+	int height = state->lcd.height ? state->lcd.height : DEFAULT_HEIGHT;
+
+	if (x < 0)
+		x = 0;
+	if (x >= width)
+		x = width - 1;
+	if (y < 0)
+		y = 0;
+	if (y >= height)
+		y = height - 1;
+	/* the middle of the pixel, in ADC counts */
+	ssi->pen_x = (2 * x + 1) * (SSI_ADC_MAX + 1) / (2 * width);
+	ssi->pen_y = (2 * y + 1) * (SSI_ADC_MAX + 1) / (2 * height);
+	ssi->pen_down = down;
+	ssi_update(state);
+}
@@ -0,0 +1,58 @@
+/*
+    armssi.h - Synchronous serial interface and the touchscreen ADC.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMSSI_H_
+#define _ARMSSI_H_
+
+
+/* The digitizer is an ADS7843-style converter on the SSI.  Writing
+   SYNCIO with TXFRMEN sends its ADCCFB byte to the converter as the
+   control byte; FRLEN clocks later, at the rate chosen by SYSCON
+   ADCKSEL, SSIBUSY drops, SSEOTI is raised and the conversion can be
+   read back from SYNCIO, which also clears SSEOTI.  The 12-bit result
+   sits in bits 14..3 of the word.
+
+   Control byte: S A2 A1 A0 MODE SER/DFR PD1 PD0.  Channels are
+   A=1 Y, A=5 X, A=3 Z1, A=4 Z2; the others read the battery.  While
+   the pen is down, and PD0 left PENIRQ enabled after the last
+   conversion, the converter pulls SSI_PEN_INT.
+
+   Nothing is sampled until the guest asks: the pen position is just
+   remembered by ssi_pen(), so an idle pen costs nothing. */
+
+#define SSI_PEN_INT	EINT2		/* PENIRQ */
+#define SSI_ADC_MAX	4095
+
+typedef struct ssi_state_t {
+	ARMword		result;			/* last conversion, as read */
+	ARMword		command;		/* control byte being sent */
+	int		busy;			/* transfer event pending */
+	int		penirq;			/* PENIRQ enabled */
+	int		pen_down;
+	int		pen_x, pen_y;		/* ADC counts */
+} ssi_state_t;
+
+
+void	ssi_reset(ARMul_State *state);
+ARMword	ssi_read_word(ARMul_State *state, ARMword reg);
+void	ssi_write_word(ARMul_State *state, ARMword reg, ARMword data);
+void	ssi_pen(ARMul_State *state, int down, int x, int y);
+
+
+#endif	/* _ARMSSI_H_ */
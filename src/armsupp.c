@@ -58,19 +58,18 @@ ARMword ARMul_MRC(ARMul_State *state,ARMword instr) ;
 void ARMul_CDP(ARMul_State *state,ARMword instr) ;
 void ARMul_UndefInstr(ARMul_State *state,ARMword instr) ;
 unsigned IntPending(ARMul_State *state) ;
+void ARMul_UpdateInt(ARMul_State *state) ;
 
 ARMword ARMul_Align(ARMul_State *state, ARMword address, ARMword data) ;
 
-void ARMul_ScheduleEvent(ARMul_State *state, unsigned long delay,
-                         unsigned (*what)()) ;
+int ARMul_EventRoom(ARMul_State *state, unsigned n) ;
+int ARMul_ScheduleEvent(ARMul_State *state, unsigned long long delay,
+                        unsigned (*what)()) ;
+int ARMul_RescheduleEvent(ARMul_State *state, unsigned long long delay,
+                          unsigned (*what)()) ;
 void ARMul_EnvokeEvent(ARMul_State *state) ;
-unsigned long ARMul_Time(ARMul_State *state) ;
-static void EnvokeList(ARMul_State *state, unsigned long from, unsigned long to) ;
-
-struct EventNode { /* An event list node */
-      unsigned (*func)() ; /* The function to call */
-      struct EventNode *next ;
-      } ;
+void ARMul_CancelEvent(ARMul_State *state, unsigned (*what)()) ;
+unsigned long long ARMul_Time(ARMul_State *state) ;
 
 /***************************************************************************\
 * This routine returns the value of a register from a mode.                 *
@@ -246,6 +245,7 @@ void ARMul_CPSRAltered(ARMul_State *state)
     }
 
  ASSIGNINT(state->Cpsr & INTBITS) ;
+ ARMul_UpdateInt(state) ;
  ASSIGNN((state->Cpsr & NBIT) != 0) ;
  ASSIGNZ((state->Cpsr & ZBIT) != 0) ;
  ASSIGNC((state->Cpsr & CBIT) != 0) ;
@@ -286,6 +286,7 @@ void ARMul_R15Altered(ARMul_State *state)
  if (state->Mode > SVC26MODE)
     state->Emulate = CHANGEMODE ;
  ASSIGNR15INT(R15INT) ;
+ ARMul_UpdateInt(state) ;
  ASSIGNN((state->Reg[15] & NBIT) != 0) ;
  ASSIGNZ((state->Reg[15] & ZBIT) != 0) ;
  ASSIGNC((state->Reg[15] & CBIT) != 0) ;
@@ -620,7 +621,7 @@ void ARMul_UndefInstr(ARMul_State *state,ARMword instr)
 
 unsigned IntPending(ARMul_State *state)
 {
- if (state->Exception) { /* Any exceptions */
+ if (state->IntPend) { /* Any exceptions */
     if (state->NresetSig == LOW) {
        ARMul_Abort(state,ARMul_ResetV) ;
        return(TRUE) ;
@@ -637,6 +638,19 @@ unsigned IntPending(ARMul_State *state)
  return(FALSE) ;
  }
 
+/***************************************************************************\
+* This routine recomputes the cached IntPend flag.  It must be called      *
+* whenever an interrupt line or the I and F bits change, so that the       *
+* emulator only has to test one word per instruction.                      *
+\***************************************************************************/
+
+void ARMul_UpdateInt(ARMul_State *state)
+{
+ state->IntPend = state->NresetSig == LOW ||
+                  (!state->NfiqSig && !FFLAG) ||
+                  (!state->NirqSig && !IFLAG) ;
+}
+
 /***************************************************************************\
 *               Align a word access to a non word boundary                  *
 \***************************************************************************/
@@ -649,66 +663,170 @@ ARMword ARMul_Align(ARMul_State *state, ARMword address, ARMword data)
  return( ( data >> address) | (data << (32 - address)) ) ; /* rot right */
 }
 
+/***************************************************************************\
+* Events are kept in a binary min-heap in an array that only grows, so      *
+* scheduling seldom allocates.  Deadlines are ARMul_Time values; events     *
+* due at the same time run in the order they were scheduled.  state->Now    *
+* caches the first deadline, so the fetch loop only compares it with        *
+* state->Cycles.                                                            *
+\***************************************************************************/
+
+static int EventBefore(struct EventNode *a, struct EventNode *b)
+{return(a->when < b->when ||
+        (a->when == b->when && (long)(a->seq - b->seq) < 0)) ;
+}
+
+static void EventSiftUp(ARMul_State *state, unsigned i)
+{struct EventNode *heap = state->Events, node = heap[i] ;
+
+ while (i > 0 && EventBefore(&node, &heap[(i - 1) / 2])) {
+    heap[i] = heap[(i - 1) / 2] ;
+    i = (i - 1) / 2 ;
+    }
+ heap[i] = node ;
+}
+
+static void EventSiftDown(ARMul_State *state, unsigned i)
+{struct EventNode *heap = state->Events, node = heap[i] ;
+ unsigned child, n = state->EventSet ;
+
+ while ((child = 2 * i + 1) < n) {
+    if (child + 1 < n && EventBefore(&heap[child + 1], &heap[child]))
+       child++ ;
+    if (!EventBefore(&heap[child], &node))
+       break ;
+    heap[i] = heap[child] ;
+    i = child ;
+    }
+ heap[i] = node ;
+}
+
+static void EventRemove(ARMul_State *state, unsigned i)
+{
+ if (i != --state->EventSet) {
+    state->Events[i] = state->Events[state->EventSet] ;
+    EventSiftUp(state, i) ;
+    EventSiftDown(state, i) ;
+    }
+}
+
+static int EventFind(ARMul_State *state, unsigned (*what)(), unsigned from)
+{unsigned i ;
+
+ for (i = from ; i < state->EventSet ; i++)
+    if (state->Events[i].func == what)
+       return(i) ;
+ return(-1) ;
+}
+
+static void EventSetNow(ARMul_State *state)
+{
+ state->Now = state->EventSet ? state->Events[0].when : ~0ULL ;
+}
+
+/**************************************************************************** This routine makes room for n pending events, doubling the heap as many   *
+* times as it takes.  It returns -1, and says so, if there is no memory.    *
+\***************************************************************************/
+
+int ARMul_EventRoom(ARMul_State *state, unsigned n)
+{struct EventNode *heap ;
+ unsigned pool = state->EventPool ? state->EventPool : EVENT_POOL ;
+
+ if (n <= state->EventPool)
+    return(0) ;
+ while (pool < n)
+    pool *= 2 ;
+ heap = realloc(state->Events, pool * sizeof(*heap)) ;
+ if (heap == NULL) {
+    fprintf(stderr,"Armulator: can't allocate memory for %u events\n", pool) ;
+    return(-1) ;
+    }
+ state->Events = heap ;
+ state->EventPool = pool ;
+ return(0) ;
+}
+
 /***************************************************************************\
 * This routine is used to call another routine after a certain number of    *
 * cycles have been executed. The first parameter is the number of cycles    *
 * delay before the function is called, the second argument is a pointer     *
-* to the function. A delay of zero doesn't work, just call the function.    *
+* to the function.  A delay of zero runs the function before the next       *
+* instruction.  It returns -1 if there is no room for the event, which is   *
+* then never called.                                                        *
 \***************************************************************************/
 
-void ARMul_ScheduleEvent(ARMul_State *state, unsigned long delay, unsigned (*what)())
-{unsigned long when ;
- struct EventNode *event ;
+int ARMul_ScheduleEvent(ARMul_State *state, unsigned long long delay, unsigned (*what)())
+{unsigned i ;
 
- if (state->EventSet++ == 0)
-    state->Now = ARMul_Time(state) ;
- when = (state->Now + delay) % EVENTLISTSIZE ;
- event = (struct EventNode *)malloc(sizeof(struct EventNode)) ;
- event->func = what ;
- event->next = *(state->EventPtr + when) ;
- *(state->EventPtr + when) = event ;
+ if (ARMul_EventRoom(state, state->EventSet + 1))
+    return(-1) ;
+ i = state->EventSet++ ;
+ state->Events[i].when = state->Cycles + delay ;
+ state->Events[i].seq = state->EventSeq++ ;
+ state->Events[i].func = what ;
+ EventSiftUp(state, i) ;
+ EventSetNow(state) ;
+ return(0) ;
 }
 
 /***************************************************************************\
-* This routine is called at the beginning of every cycle, to envoke         *
-* scheduled events.                                                         *
+* This routine moves a function's pending call to a new time, or schedules  *
+* it if there was none.  It leaves exactly one call pending, or returns -1  *
+* as ARMul_ScheduleEvent does.                                              *
 \***************************************************************************/
 
-void ARMul_EnvokeEvent(ARMul_State *state)
-{static unsigned long then ;
+int ARMul_RescheduleEvent(ARMul_State *state, unsigned long long delay, unsigned (*what)())
+{int i = EventFind(state, what, 0) ;
 
- then = state->Now ;
- state->Now = ARMul_Time(state) % EVENTLISTSIZE ;
- if (then < state->Now) /* schedule events */
-    EnvokeList(state,then,state->Now) ;
- else if (then > state->Now) { /* need to wrap around the list */
-    EnvokeList(state,then,EVENTLISTSIZE-1L) ;
-    EnvokeList(state,0L,state->Now) ;
+ if (i < 0 || EventFind(state, what, i + 1) >= 0) {
+    ARMul_CancelEvent(state, what) ;
+    return(ARMul_ScheduleEvent(state, delay, what)) ;
     }
- }
+ /* the usual case: move the one node in place */
+ state->Events[i].when = state->Cycles + delay ;
+ state->Events[i].seq = state->EventSeq++ ;
+ EventSiftUp(state, i) ;
+ EventSiftDown(state, i) ;
+ EventSetNow(state) ;
+ return(0) ;
+}
 
-static void EnvokeList(ARMul_State *state, unsigned long from, unsigned long to)
-/* envokes all the entries in a range */
-{struct EventNode *anevent ;
+/***************************************************************************\
+* This routine removes every pending call of a function from the queue, so  *
+* that a device can move its deadline.                                      *
+\***************************************************************************/
 
- for (; from <= to ; from++) {
-    anevent = *(state->EventPtr + from) ;
-    while (anevent) {
-       (anevent->func)(state) ;
-       state->EventSet-- ;
-       anevent = anevent->next ;
-       }
-    *(state->EventPtr + from) = NULL ;
+void ARMul_CancelEvent(ARMul_State *state, unsigned (*what)())
+{int i ;
+
+ while ((i = EventFind(state, what, 0)) >= 0)
+    EventRemove(state, i) ;
+ EventSetNow(state) ;
+}
+
+/***************************************************************************\
+* This routine is called from the fetch loop when state->Now is reached,    *
+* to envoke the events that are due.                                        *
+\***************************************************************************/
+
+void ARMul_EnvokeEvent(ARMul_State *state)
+{unsigned (*func)() ;
+
+ while (state->EventSet && state->Events[0].when <= state->Cycles) {
+    func = state->Events[0].func ;
+    EventRemove(state, 0) ;
+    (*func)(state) ;
     }
- }
+ EventSetNow(state) ;
+}
 
 /***************************************************************************\
-* This routine is returns the number of clock ticks since the last reset.   *
+* This routine returns the number of clock ticks since the state was made.  *
+* It never goes backwards, not even over a reset.                           *
 \***************************************************************************/
 
-unsigned long ARMul_Time(ARMul_State *state)
-{return(state->NumScycles + state->NumNcycles +
-        state->NumIcycles + state->NumCcycles + state->NumFcycles) ;
+unsigned long long ARMul_Time(ARMul_State *state)
+{return(state->Cycles) ;
 }
 
 ARMword ARMul_Debug (ARMul_State * state, ARMword pc, ARMword instr)
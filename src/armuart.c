@@ -0,0 +1,634 @@
+/*
+    armuart.c - Host side of the UART, on its own thread.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#define _GNU_SOURCE	/* posix_openpt and friends */
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "armdefs.h"
+#include "clps7110.h"
+
+#define UART_CLOCK	230400	/* bit rate for a divisor of 0 */
+#define UART_FAST_CYCLES 16	/* char time when the bit rate is ignored */
+#define RX_TIMEOUT_CHARS 3	/* idle time before a partial FIFO interrupts */
+#define UART_IO_CHUNK	512
+#define UART_RETRY_MS	10	/* rx ring full: look again after this */
+
+
+/* Host side: runs on the UART thread, except for the ring ends. */
+
+static void
+kick(uart_state_t *uart)
+{
+	unsigned long long one = 1;
+
+	if (!__atomic_exchange_n(&uart->kicked, 1, __ATOMIC_ACQ_REL)) {
+		if (write(uart->kick_fd, &one, sizeof(one)) < 0) {
+			/* the counter can't overflow; nothing to do */
+		}
+	}
+}
+
+static void
+tx_drain(uart_state_t *uart)
+{
+	unsigned char buf[UART_IO_CHUNK];
+	int n, done;
+
+	__atomic_store_n(&uart->kicked, 0, __ATOMIC_RELEASE);
+	for (;;) {
+		for (n = 0; n < UART_IO_CHUNK && ring_get(&uart->tx, &buf[n]); n++)
+			;
+		if (!n)
+			break;
+		/* with nobody listening the bytes are lost, as on a real line */
+		for (done = 0; uart->out_fd >= 0 && done < n; ) {
+			int w = write(uart->out_fd, buf + done, n - done);
+
+			if (w < 0 && errno != EINTR) {
+				break;
+			}
+			if (w > 0)
+				done += w;
+		}
+	}
+}
+
+/* Returns 0 at end of input. */
+static int
+rx_fill(uart_state_t *uart)
+{
+	unsigned char buf[UART_IO_CHUNK];
+	unsigned room = uart->rx.slots - ring_count(&uart->rx);
+	int i, n;
+
+	if (room > sizeof(buf))
+		room = sizeof(buf);
+	n = read(uart->in_fd, buf, room);
+	if (n == 0 && !isatty(uart->in_fd)) {
+		return 0;
+	}
+	for (i = 0; i < n; i++)
+		ring_put(&uart->rx, &buf[i]);
+	return 1;
+}
+
+static void *
+uart_thread(void *arg)
+{
+	uart_state_t *uart = arg;
+	struct epoll_event ev;
+	int ep, ready, watching = 0, always = 0, eof = 0;
+
+	ep = epoll_create1(0);
+	if (ep < 0) {
+		perror("epoll_create1");
+		return NULL;
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = uart->kick_fd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, uart->kick_fd, &ev);
+	if (uart->listen_fd >= 0) {
+		ev.data.fd = uart->listen_fd;
+		epoll_ctl(ep, EPOLL_CTL_ADD, uart->listen_fd, &ev);
+	}
+
+	for (;;) {
+		int full = ring_count(&uart->rx) == uart->rx.slots;
+		int want = uart->in_fd >= 0 && !eof && !always && !full;
+		int timeout = -1;
+
+		/* only wait on input while there is somewhere to put it */
+		if (want != watching) {
+			ev.events = EPOLLIN;
+			ev.data.fd = uart->in_fd;
+			if (epoll_ctl(ep, want ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+				      uart->in_fd, &ev) == 0) {
+				watching = want;
+			} else if (errno == EPERM) {
+				/* a regular file is always readable */
+				always = 1;
+			} else {
+				eof = 1;
+			}
+		}
+		if (uart->in_fd >= 0 && !eof && (full || always))
+			timeout = full ? UART_RETRY_MS : 0;
+
+		ready = -1;
+		if (epoll_wait(ep, &ev, 1, timeout) > 0)
+			ready = ev.data.fd;
+		if (ready == uart->kick_fd) {
+			unsigned long long v;
+
+			if (read(uart->kick_fd, &v, sizeof(v)) < 0) {
+				/* spurious wakeup */
+			}
+			tx_drain(uart);
+			if (__atomic_load_n(&uart->closing, __ATOMIC_ACQUIRE))
+				break;
+		} else if (ready >= 0 && ready == uart->listen_fd) {
+			int fd = accept(uart->listen_fd, NULL, NULL);
+
+			if (fd >= 0 && uart->in_fd >= 0) {
+				close(fd);	/* one client at a time */
+			} else if (fd >= 0) {
+				uart->in_fd = uart->out_fd = fd;
+				eof = always = 0;
+			}
+		}
+		if (uart->in_fd >= 0 && !eof && !full &&
+		    (always || ready == uart->in_fd)) {
+			if (!rx_fill(uart)) {
+				if (watching)
+					epoll_ctl(ep, EPOLL_CTL_DEL, uart->in_fd, &ev);
+				watching = 0;
+				if (uart->listen_fd >= 0) {
+					/* client went away: wait for the next */
+					close(uart->in_fd);
+					uart->in_fd = uart->out_fd = -1;
+				} else {
+					eof = 1;
+				}
+			}
+		}
+	}
+	close(ep);
+	return NULL;
+}
+
+static int
+open_pty(uart_state_t *uart)
+{
+	struct termios tio;
+	char *name;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || grantpt(fd) || unlockpt(fd) || !(name = ptsname(fd))) {
+		perror("pty");
+		return -1;
+	}
+	/* hold the slave open so the master doesn't see hangups between
+	   clients, and make it raw */
+	uart->hold_fd = open(name, O_RDWR | O_NOCTTY);
+	if (uart->hold_fd >= 0 && !tcgetattr(uart->hold_fd, &tio)) {
+		cfmakeraw(&tio);
+		tcsetattr(uart->hold_fd, TCSANOW, &tio);
+	}
+	printf("UART on %s\n", name);
+	uart->in_fd = uart->out_fd = fd;
+	return 0;
+}
+
+static int
+open_unix(uart_state_t *uart, const char *path)
+{
+	struct sockaddr_un addr;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Bad socket path %s\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	/* a client hanging up must not kill the emulator */
+	signal(SIGPIPE, SIG_IGN);
+	uart->listen_fd = fd;
+	return 0;
+}
+
+/* Connect the UART to a host endpoint (see armuart.h) and start the
+   I/O thread.  Without this the guest's output goes nowhere. */
+int
+uart_open(ARMul_State *state, const char *spec)
+{
+	uart_state_t *uart = &state->uart;
+
+	uart->in_fd = uart->out_fd = -1;
+	uart->listen_fd = uart->hold_fd = -1;
+	if (!strcmp(spec, "stdio")) {
+		uart->in_fd = 0;
+		uart->out_fd = 1;
+	} else if (!strcmp(spec, "pty")) {
+		if (open_pty(uart))
+			return -1;
+	} else if (!strncmp(spec, "unix:", 5)) {
+		if (open_unix(uart, spec + 5))
+			return -1;
+	} else if (!strncmp(spec, "file:", 5)) {
+		uart->out_fd = open(spec + 5, O_WRONLY | O_CREAT | O_APPEND, 0666);
+		if (uart->out_fd < 0) {
+			perror(spec + 5);
+			return -1;
+		}
+	} else {
+		fprintf(stderr, "Unknown UART endpoint %s\n", spec);
+		return -1;
+	}
+
+	uart->kicked = 0;
+	uart->kick_fd = eventfd(0, 0);
+	if (uart->kick_fd < 0 ||
+	    !ring_init(&uart->rx, UART_RING_SLOTS, 1) ||
+	    !ring_init(&uart->tx, UART_RING_SLOTS, 1)) {
+		fprintf( stderr, "Armulator: can't set up the UART\n");
+		exit( -1 );
+	}
+	uart->closing = 0;
+	if (pthread_create(&uart->thread, NULL, uart_thread, uart)) {
+		fprintf( stderr, "Armulator: can't start UART thread\n");
+		exit( -1 );
+	}
+	uart->started = 1;
+	return 0;
+}
+
+static void
+close_fds(uart_state_t *uart)
+{
+	if (uart->in_fd > 2)
+		close(uart->in_fd);
+	if (uart->out_fd > 2 && uart->out_fd != uart->in_fd)
+		close(uart->out_fd);
+	if (uart->listen_fd >= 0)
+		close(uart->listen_fd);
+	if (uart->hold_fd >= 0)
+		close(uart->hold_fd);
+	close(uart->kick_fd);
+	ring_free(&uart->rx);
+	ring_free(&uart->tx);
+	uart->started = 0;
+}
+
+/* In a child of fork() the I/O thread stayed behind in the parent:
+   give this copy an endpoint and a thread of its own.  Bytes that were
+   still on the rings are lost. */
+int
+uart_reconnect(ARMul_State *state, const char *spec)
+{
+	uart_state_t *uart = &state->uart;
+
+	if (uart->started)
+		close_fds(uart);
+	return uart_open(state, spec);
+}
+
+/* Write out what is queued, stop the I/O thread and let go of the
+   endpoint.  The log stays until uart_log() turns it off. */
+void
+uart_close(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+
+	if (!uart->started)
+		return;
+	uart_drain(state);
+	__atomic_store_n(&uart->closing, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&uart->kicked, 0, __ATOMIC_RELEASE);
+	kick(uart);
+	pthread_join(uart->thread, NULL);
+	close_fds(uart);
+}
+
+/* Keep a copy of everything the guest sends, for a caller in the same
+   process (see psimulator.h), or stop keeping one and free it. */
+void
+uart_log(ARMul_State *state, int on)
+{
+	uart_state_t *uart = &state->uart;
+
+	uart->logging = on;
+	if (!on) {
+		free(uart->log);
+		uart->log = NULL;
+		uart->log_len = uart->log_size = 0;
+	}
+}
+
+/* Before exiting: wait (briefly) for queued output to be written. */
+void
+uart_drain(ARMul_State *state)
+{
+	struct timespec ts = { 0, 1000000 };
+	int tries = 1000;
+
+	if (!state->uart.started) {
+		return;
+	}
+	while (ring_count(&state->uart.tx) && tries--) {
+		kick(&state->uart);
+		nanosleep(&ts, NULL);
+	}
+}
+
+
+/* Guest side: CPU thread only. */
+
+static unsigned uart_rx_event(ARMul_State *state);
+static unsigned uart_tx_event(ARMul_State *state);
+
+static int
+fifo_depth(uart_state_t *uart)
+{
+	return (uart->ubrlcr & FIFOEN) ? UART_FIFO : 1;
+}
+
+/* Derive the flags and interrupts from the FIFO levels.  In FIFO mode
+   URXINT means half full, or any data that has sat for RX_TIMEOUT_CHARS
+   character times; UTXINT means half empty. */
+static void
+uart_update(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+	int depth = fifo_depth(uart);
+
+	state->io.sysflg &= ~(URXFE | UTXFF | UBUSY);
+	if (!uart->rx_count)
+		state->io.sysflg |= URXFE;
+	if (uart->tx_count >= depth)
+		state->io.sysflg |= UTXFF;
+	if (uart->tx_running)
+		state->io.sysflg |= UBUSY;
+
+	state->io.intsr &= ~(URXINT | UTXINT);
+	if (uart->rx_count >= (depth + 1) / 2 ||
+	    (uart->rx_count && uart->rx_timeout))
+		state->io.intsr |= URXINT;
+	if (uart->tx_count <= depth / 2)
+		state->io.intsr |= UTXINT;
+	io_update_int(state);
+}
+
+static void
+uart_set_rate(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+	ARMword lcr = uart->ubrlcr;
+	/* start, data, parity and stop bits */
+	int bits = 1 + 5 + ((lcr & WRDLEN) >> WRDLEN_SHIFT) +
+		   ((lcr & PRTEN) ? 1 : 0) + ((lcr & XSTOP) ? 2 : 1);
+
+	if (uart->fast) {
+		uart->char_cycles = UART_FAST_CYCLES;
+	} else {
+		uart->char_cycles = (unsigned long long)state->cpu_clock * bits *
+			((lcr & BRDIV) + 1) / UART_CLOCK;
+	}
+	if (!uart->char_cycles)
+		uart->char_cycles = 1;
+}
+
+/* Bring in what the host has sent, as far as the queue has room.  This
+   is the only place host bytes reach the guest, so it is an input
+   point for armreplay.c, and what the guest receives never depends on
+   when the host thread got round to it. */
+static void
+rx_take(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+	unsigned char buf[UART_INJECT];
+	int room = UART_INJECT - uart->inject_count, n = 0, i;
+
+	if (uart->started && !REPLAY_PLAYING(state))
+		while (n < room && ring_get(&uart->rx, &buf[n]))
+			n++;
+	n = replay_input(state, REPLAY_UART, buf, n, room);
+	for (i = 0; i < n; i++) {
+		uart->inject[(uart->inject_head + uart->inject_count) % UART_INJECT] =
+			buf[i];
+		uart->inject_count++;
+	}
+}
+
+/* Start receiving if there is anything to do. */
+static void
+uart_rx_start(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+
+	if (uart->rx_running)
+		return;
+	rx_take(state);
+	if (uart->inject_count || (uart->rx_count && !uart->rx_timeout)) {
+		uart->rx_running = 1;
+		uart->rx_idle = 0;
+		ARMul_ScheduleEvent(state, uart->char_cycles, uart_rx_event);
+	}
+}
+
+/* Next received byte, in the order the bytes came in. */
+static int
+rx_next(uart_state_t *uart, unsigned char *c)
+{
+	if (!uart->inject_count)
+		return 0;
+	*c = uart->inject[uart->inject_head];
+	uart->inject_head = (uart->inject_head + 1) % UART_INJECT;
+	uart->inject_count--;
+	return 1;
+}
+
+/* One character time on the receive side.  Bytes wait in the host ring
+   while the FIFO is full, so the guest never sees an overrun. */
+static unsigned
+uart_rx_event(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+	unsigned char c;
+
+	if (uart->rx_count < fifo_depth(uart) && rx_next(uart, &c)) {
+		uart->rx_fifo[(uart->rx_head + uart->rx_count) % UART_FIFO] = c;
+		uart->rx_count++;
+		uart->rx_idle = 0;
+	} else if (++uart->rx_idle >= RX_TIMEOUT_CHARS && uart->rx_count) {
+		uart->rx_timeout = 1;
+	}
+	uart_update(state);
+	uart->rx_running = 0;
+	uart_rx_start(state);
+	return 0;
+}
+
+static void
+log_put(uart_state_t *uart, unsigned char c)
+{
+	if (uart->log_len == uart->log_size) {
+		uart->log_size = uart->log_size ? uart->log_size * 2 : UART_IO_CHUNK;
+		uart->log = realloc(uart->log, uart->log_size);
+		if (!uart->log) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+	}
+	uart->log[uart->log_len++] = c;
+}
+
+/* One character time on the transmit side: the oldest byte leaves. */
+static unsigned
+uart_tx_event(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+	unsigned char c;
+
+	if (uart->tx_count) {
+		c = uart->tx_fifo[uart->tx_head];
+		uart->tx_head = (uart->tx_head + 1) % UART_FIFO;
+		uart->tx_count--;
+		if (uart->logging && !REVERSE_REPLAYING(state))
+			log_put(uart, c);
+		if (state->run.until && !REVERSE_REPLAYING(state))
+			run_uart_tx(state, c);
+		/* if the host can't keep up the guest waits, as it would
+		   for a real line with flow control; history being
+		   replayed was sent the first time */
+		while (uart->started && !REVERSE_REPLAYING(state) &&
+		       !ring_put(&uart->tx, &c)) {
+			kick(uart);
+			sched_yield();
+		}
+	}
+	if (uart->tx_count) {
+		ARMul_ScheduleEvent(state, uart->char_cycles, uart_tx_event);
+	} else {
+		uart->tx_running = 0;
+	}
+	uart_update(state);
+	return 0;
+}
+
+const snap_event_t uart_events[] = {
+	{ "uart_rx", uart_rx_event },
+	{ "uart_tx", uart_tx_event },
+	{ NULL, NULL }
+};
+
+void
+uart_reset(ARMul_State *state)
+{
+	uart_state_t *uart = &state->uart;
+
+	ARMul_CancelEvent(state, uart_rx_event);
+	ARMul_CancelEvent(state, uart_tx_event);
+	uart->ubrlcr = 0;
+	uart->rx_head = uart->rx_count = 0;
+	uart->tx_head = uart->tx_count = 0;
+	uart->rx_idle = uart->rx_timeout = 0;
+	uart->rx_running = uart->tx_running = 0;
+	uart->inject_head = uart->inject_count = 0;
+	uart_set_rate(state);
+	uart_update(state);
+}
+
+ARMword
+uart_read_word(ARMul_State *state, ARMword reg)
+{
+	uart_state_t *uart = &state->uart;
+	ARMword data = 0;
+
+	switch (reg) {
+	case UARTDR:
+		if (uart->rx_count) {
+			data = uart->rx_fifo[uart->rx_head];
+			uart->rx_head = (uart->rx_head + 1) % UART_FIFO;
+			if (!--uart->rx_count)
+				uart->rx_timeout = 0;
+		}
+		uart_update(state);
+		uart_rx_start(state);
+		break;
+	case UBRLCR:
+		data = uart->ubrlcr;
+		break;
+	}
+	return data;
+}
+
+void
+uart_write_word(ARMul_State *state, ARMword reg, ARMword data)
+{
+	uart_state_t *uart = &state->uart;
+
+	switch (reg) {
+	case UARTDR:
+		if (uart->tx_count < fifo_depth(uart)) {
+			uart->tx_fifo[(uart->tx_head + uart->tx_count) % UART_FIFO] = data;
+			uart->tx_count++;
+		}
+		if (!uart->tx_running) {
+			uart->tx_running = 1;
+			ARMul_ScheduleEvent(state, uart->char_cycles, uart_tx_event);
+		}
+		uart_update(state);
+		break;
+	case UBRLCR:
+		uart->ubrlcr = data;
+		uart_set_rate(state);
+		uart_update(state);
+		uart_rx_start(state);
+		break;
+	}
+}
+
+/* Called from the periodic I/O poll: notice new input, and hand any
+   queued output to the host in one go. */
+void
+uart_poll(ARMul_State *state)
+{
+	uart_rx_start(state);
+	if (state->uart.started && ring_count(&state->uart.tx)) {
+		kick(&state->uart);
+	}
+}
+
+/* Receive bytes as if they had come from the host, from the CPU
+   thread.  Returns how many were taken; the rest don't fit yet. */
+int
+uart_inject(ARMul_State *state, const char *data, int len)
+{
+	uart_state_t *uart = &state->uart;
+	int n;
+
+	for (n = 0; n < len && uart->inject_count < UART_INJECT; n++) {
+		uart->inject[(uart->inject_head + uart->inject_count) % UART_INJECT] =
+			data[n];
+		uart->inject_count++;
+	}
+	uart_rx_start(state);
+	return n;
+}
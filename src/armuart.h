@@ -0,0 +1,87 @@
+/*
+    armuart.h - Host side of the UART, on its own thread.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _ARMUART_H_
+#define _ARMUART_H_
+
+
+/* The internal UART.  The guest side models the 16-byte FIFOs, their
+   interrupt thresholds and the character time set by UBRLCR, on the
+   CPU thread.  The CPU thread never makes a system call for the serial
+   port: a host I/O thread waits on the endpoint with epoll and fills
+   the rx ring, and drains the tx ring when kicked.  The CPU thread
+   takes bytes from the rx ring at times set by the guest alone, so a
+   run can be replayed (see armreplay.h).
+
+   Host endpoints:
+	stdio		the emulator's stdin and stdout (default)
+	pty		a new pseudo-terminal, whose name is printed
+	unix:PATH	a listening unix socket, one client at a time
+	file:PATH	output appended to a file, no input */
+
+#define UART_FIFO	16
+#define UART_RING_SLOTS	4096
+#define UART_INJECT	256		/* bytes queued by the CPU thread */
+
+typedef struct uart_state_t {
+	/* guest side, CPU thread only */
+	ARMword		ubrlcr;
+	ARMword		rx_fifo[UART_FIFO];	/* data and error bits */
+	int		rx_head, rx_count;
+	unsigned char	tx_fifo[UART_FIFO];
+	int		tx_head, tx_count;
+	int		rx_idle;		/* char times without new data */
+	int		rx_timeout;		/* interrupt for a partial FIFO */
+	int		rx_running, tx_running;	/* char-time events pending */
+	unsigned long	char_cycles;
+	int		fast;			/* ignore the bit rate */
+	unsigned char	inject[UART_INJECT];	/* received, waiting for the FIFO */
+	int		inject_head, inject_count;
+	int		logging;		/* see uart_log() */
+	unsigned char *	log;			/* everything sent */
+	long		log_len, log_size;
+
+	/* host side */
+	int		in_fd;			/* -1: none */
+	int		out_fd;
+	int		listen_fd;		/* unix:, else -1 */
+	int		hold_fd;		/* pty: keeps the slave open */
+	int		kick_fd;		/* eventfd: tx ring has data */
+	int		kicked;			/* a kick is outstanding */
+	int		started;
+	int		closing;		/* the thread is to stop */
+	pthread_t	thread;
+	ring_t		rx;			/* host -> guest bytes */
+	ring_t		tx;			/* guest -> host bytes */
+} uart_state_t;
+
+
+int	uart_open(ARMul_State *state, const char *spec);
+int	uart_reconnect(ARMul_State *state, const char *spec);
+void	uart_close(ARMul_State *state);
+void	uart_log(ARMul_State *state, int on);
+void	uart_reset(ARMul_State *state);
+ARMword	uart_read_word(ARMul_State *state, ARMword reg);
+void	uart_write_word(ARMul_State *state, ARMword reg, ARMword data);
+void	uart_poll(ARMul_State *state);
+void	uart_drain(ARMul_State *state);
+int	uart_inject(ARMul_State *state, const char *data, int len);
+
+
+#endif	/* _ARMUART_H_ */
@@ -215,10 +215,10 @@ ARMul_ReLoadInstr (ARMul_State * state, ARMword address, ARMword isize)
 ARMword
 ARMul_LoadInstrS (ARMul_State * state, ARMword address, ARMword isize)
 {
-  state->NumScycles ++;
+  COUNT_CYCLES (state, S, 1);
 
 #ifdef HOURGLASS
-  if (( state->NumScycles & HOURGLASS_RATE ) == 0)
+  if (( state->Cycles & HOURGLASS_RATE ) == 0)
     {
       HOURGLASS;
     }
@@ -234,7 +234,7 @@ ARMul_LoadInstrS (ARMul_State * state, ARMword address, ARMword isize)
 ARMword
 ARMul_LoadInstrN (ARMul_State * state, ARMword address, ARMword isize)
 {
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
   return ARMul_ReLoadInstr (state, address, isize);
 }
@@ -280,7 +280,7 @@ ARMul_ReadWord (ARMul_State * state, ARMword address)
 ARMword
 ARMul_LoadWordS (ARMul_State * state, ARMword address)
 {
-  state->NumScycles ++;
+  COUNT_CYCLES (state, S, 1);
 
   return ARMul_ReadWord (state, address);
 }
@@ -292,7 +292,7 @@ ARMul_LoadWordS (ARMul_State * state, ARMword address)
 ARMword
 ARMul_LoadWordN (ARMul_State * state, ARMword address)
 {
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
   
   return ARMul_ReadWord (state, address);
 }
@@ -306,7 +306,7 @@ ARMul_LoadHalfWord (ARMul_State * state, ARMword address)
 {
   ARMword temp, offset;
 
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
   temp   = ARMul_ReadWord (state, address);
   offset = (((ARMword)state->bigendSig * 2) ^ (address & 2)) << 3; /* bit offset into the word */
@@ -336,7 +336,7 @@ ARMul_ReadByte (ARMul_State * state, ARMword address)
 ARMword
 ARMul_LoadByte (ARMul_State * state, ARMword address)
 {
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
   return ARMul_ReadByte (state, address);
 }
@@ -380,7 +380,7 @@ ARMul_WriteWord (ARMul_State * state, ARMword address, ARMword data)
 void
 ARMul_StoreWordS (ARMul_State * state, ARMword address, ARMword data)
 {
-  state->NumScycles ++;
+  COUNT_CYCLES (state, S, 1);
 
   ARMul_WriteWord (state, address, data);
 }
@@ -392,7 +392,7 @@ ARMul_StoreWordS (ARMul_State * state, ARMword address, ARMword data)
 void
 ARMul_StoreWordN (ARMul_State * state, ARMword address, ARMword data)
 {
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
   ARMul_WriteWord (state, address, data);
 }
@@ -406,7 +406,7 @@ ARMul_StoreHalfWord (ARMul_State * state, ARMword address, ARMword data)
 {
   ARMword temp, offset;
 
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
  
 #ifdef VALIDATE
   if (address == TUBE)
@@ -447,7 +447,7 @@ ARMul_WriteByte (ARMul_State * state, ARMword address, ARMword data)
 void
 ARMul_StoreByte (ARMul_State * state, ARMword address, ARMword data)
 {
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
 #ifdef VALIDATE
   if (address == TUBE)
@@ -472,11 +472,11 @@ ARMul_SwapWord (ARMul_State * state, ARMword address, ARMword data)
 {
   ARMword temp;
 
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
 
   temp = ARMul_ReadWord (state, address);
   
-  state->NumNcycles ++;
+  COUNT_CYCLES (state, N, 1);
   
   PutWord(state, address, data);
   
@@ -505,7 +505,7 @@ ARMul_SwapByte (ARMul_State * state, ARMword address, ARMword data)
 void
 ARMul_Icycles (ARMul_State * state, unsigned number, ARMword address)
 {
-  state->NumIcycles += number;
+  COUNT_CYCLES (state, I, number);
   ARMul_CLEARABORT;
 }
 
@@ -516,7 +516,7 @@ ARMul_Icycles (ARMul_State * state, unsigned number, ARMword address)
 void
 ARMul_Ccycles (ARMul_State * state, unsigned number, ARMword address)
 {
-  state->NumCcycles += number;
+  COUNT_CYCLES (state, C, number);
   ARMul_CLEARABORT;
 }
 
@@ -170,7 +170,7 @@
 #define EVENPRT 0x00004000  /* Even parity */
 #define XSTOP	0x00008000  /* Extra stop bit */
 #define FIFOEN  0x00010000  /* Enable FIFO */
-#define WRDLEN	0x00030000  /* Word length */
+#define WRDLEN	0x00060000  /* Word length */
 #define WRDLEN_SHIFT	17
 #define WL_5	    0x0	    /*   5 bits */
 #define WL_6	    0x1	    /*   6 bits */
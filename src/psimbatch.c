@@ -0,0 +1,525 @@
+/*
+    psimbatch.c - Run a manifest of jobs, each a ROM, a script and a
+    budget of guest time, across the host's cores, and report on each
+    as a line of JSON.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The emulator keeps some state in globals (see psimulator.h), so the
+   jobs can't run as threads of one process.  Instead there is a pool
+   of worker processes, one a core by default, and each takes the next
+   job from a counter they share as soon as it is free, so long jobs
+   don't hold up the others.  A job gets a machine of its own, made and
+   freed in the worker; the ROMs are mapped read-only before the workers
+   fork, so every machine reads the one copy of each.
+
+   Workers send their results up a pipe, and they are printed in the
+   manifest's order.  A worker that dies takes only its job with it: it
+   is reported as crashed and another worker is started in its place. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "psimulator.h"
+
+typedef struct rom_t {
+	const char *	name;
+	const void *	data;		/* mapped, or NULL if it couldn't be */
+	long		size;
+} rom_t;
+
+typedef struct job_t {
+	const char *	rom_name;
+	const char *	script;		/* or NULL */
+	unsigned long long cycles;
+	rom_t *		rom;
+	char *		result;		/* the JSON line, once in */
+	int		failed;		/* couldn't be run, crashed, or quit
+					   with a status other than 0 */
+} job_t;
+
+typedef struct worker_t {
+	pid_t		pid;		/* 0: finished */
+	int		fd;		/* read end of its pipe */
+	char *		buf;		/* a partial line */
+	long		len, size;
+} worker_t;
+
+/* Shared by the workers, in an anonymous shared mapping */
+typedef struct pool_t {
+	long		next;		/* the next job to take */
+	long		current[1];	/* per worker: job + 1, or 0 */
+} pool_t;
+
+static job_t *		jobs;
+static int		njobs;
+static rom_t *		roms;
+static int		nroms;
+static pool_t *		pool;
+
+
+static void *
+xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	return p;
+}
+
+static char *
+xstrdup(const char *s)
+{
+	return strcpy(xrealloc(NULL, strlen(s) + 1), s);
+}
+
+/* A time as armscript.h has it: cycles, or us, ms or s of PSIM_CLOCK */
+static int
+parse_time(const char *w, unsigned long long *t)
+{
+	char *end;
+	unsigned long long v;
+
+	if (!w || !isdigit((unsigned char)*w))
+		return -1;
+	v = strtoull(w, &end, 0);
+	if (!*end)
+		*t = v;
+	else if (!strcmp(end, "us"))
+		*t = v * PSIM_CLOCK / 1000000;
+	else if (!strcmp(end, "ms"))
+		*t = v * PSIM_CLOCK / 1000;
+	else if (!strcmp(end, "s"))
+		*t = v * PSIM_CLOCK;
+	else
+		return -1;
+	return 0;
+}
+
+static rom_t *
+find_rom(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nroms; i++)
+		if (!strcmp(roms[i].name, name))
+			return &roms[i];
+	roms = xrealloc(roms, (nroms + 1) * sizeof(*roms));
+	roms[nroms].name = name;
+	roms[nroms].data = NULL;
+	roms[nroms].size = 0;
+	return &roms[nroms++];
+}
+
+static void
+read_manifest(const char *filename)
+{
+	FILE *f = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+	char line[1024], rom[1024], script[1024], time[64];
+	int lineno = 0, n;
+	job_t *j;
+
+	if (!f) {
+		perror(filename);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+		n = sscanf(line, "%1023s %1023s %63s", rom, script, time);
+		if (n <= 0)
+			continue;
+		jobs = xrealloc(jobs, (njobs + 1) * sizeof(*jobs));
+		j = &jobs[njobs++];
+		if (n != 3 || parse_time(time, &j->cycles)) {
+			fprintf(stderr, "%s:%d: expected ROM SCRIPT TIME\n",
+				filename, lineno);
+			exit(1);
+		}
+		j->rom_name = xstrdup(rom);
+		j->script = strcmp(script, "-") ? xstrdup(script) : NULL;
+		j->result = NULL;
+	}
+	if (f != stdin)
+		fclose(f);
+	for (n = 0; n < njobs; n++)
+		jobs[n].rom = find_rom(jobs[n].rom_name);
+}
+
+/* Read-only and shared, so the workers' machines all read the page
+   cache's copy.  Past the end of the file, the last page reads as
+   zeroes, as the whole words psim_share_rom() wants. */
+static void
+map_roms(void)
+{
+	struct stat st;
+	void *p;
+	int i, fd;
+
+	for (i = 0; i < nroms; i++) {
+		fd = open(roms[i].name, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st)) {
+			perror(roms[i].name);
+		} else if (st.st_size > 0 &&
+			   (p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+				     fd, 0)) != MAP_FAILED) {
+			roms[i].data = p;
+			roms[i].size = st.st_size;
+		} else {
+			fprintf(stderr, "%s: can't map the ROM\n", roms[i].name);
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+}
+
+
+/* Output, with the UART's bytes taken as Latin-1 */
+
+static void
+put_string(FILE *f, const unsigned char *s, long len)
+{
+	long i;
+
+	putc('"', f);
+	for (i = 0; i < len; i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			fprintf(f, "\\%c", s[i]);
+		else if (s[i] == '\n')
+			fputs("\\n", f);
+		else if (s[i] == '\r')
+			fputs("\\r", f);
+		else if (s[i] < 0x20 || s[i] >= 0x7f)
+			fprintf(f, "\\u%04x", s[i]);
+		else
+			putc(s[i], f);
+	}
+	putc('"', f);
+}
+
+static void
+put_job(FILE *f, int i)
+{
+	fprintf(f, "{\"job\":%d,\"rom\":", i);
+	put_string(f, (const unsigned char *)jobs[i].rom_name,
+		   strlen(jobs[i].rom_name));
+	fputs(",\"script\":", f);
+	if (jobs[i].script)
+		put_string(f, (const unsigned char *)jobs[i].script,
+			   strlen(jobs[i].script));
+	else
+		fputs("null", f);
+}
+
+static const char *
+exit_name(int reason)
+{
+	switch (reason) {
+	case PSIM_CYCLES:
+		return "cycles";
+	case PSIM_QUIT:
+		return "quit";
+	case PSIM_SCRIPT_END:
+		return "script_end";
+	default:
+		return "stopped";
+	}
+}
+
+/* In a worker: run job i on a machine of its own, and send the line,
+   after the job's number and whether it failed for the parent. */
+static void
+run_job(int i, int fd)
+{
+	static const psim_config_t config = { .deterministic = 1 };
+	job_t *j = &jobs[i];
+	psim_t *p;
+	const unsigned char *uart;
+	char *line;
+	size_t size;
+	long len;
+	FILE *f;
+	int reason = PSIM_CYCLES, ok;
+
+	f = open_memstream(&line, &size);
+	if (!f) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	p = j->rom->data ? psim_new(&config) : NULL;
+	ok = p && !(j->script && psim_load_script(p, j->script));
+	if (ok) {
+		psim_share_rom(p, j->rom->data, j->rom->size);
+		reason = psim_run(p, j->cycles);
+	}
+	fprintf(f, "%d %d ", i,
+		!ok || (reason == PSIM_QUIT && psim_status(p)));
+	put_job(f, i);
+	if (!ok) {
+		fputs(",\"exit\":\"error\"}\n", f);
+	} else {
+		uart = psim_uart_output(p, &len);
+		fprintf(f, ",\"exit\":\"%s\",\"status\":%d,\"instructions\":%llu,"
+			"\"cycles\":%llu,\"frame_hash\":\"%016llx\",\"uart\":",
+			exit_name(reason), reason == PSIM_QUIT ? psim_status(p) : 0,
+			psim_instructions(p), psim_cycles(p), psim_frame_hash(p));
+		put_string(f, uart, len);
+		fputs("}\n", f);
+	}
+	psim_free(p);
+	fclose(f);
+	for (len = 0; len < (long)size; ) {
+		long n = write(fd, line + len, size - len);
+
+		if (n < 0 && errno != EINTR)
+			exit(1);
+		len += n > 0 ? n : 0;
+	}
+	free(line);
+}
+
+static void
+worker(int w, int fd)
+{
+	long i;
+
+	/* stdout is for the results; what the jobs print goes to stderr */
+	dup2(2, 1);
+	for (;;) {
+		i = __sync_fetch_and_add(&pool->next, 1);
+		if (i >= njobs)
+			exit(0);
+		pool->current[w] = i + 1;
+		run_job(i, fd);
+		pool->current[w] = 0;
+	}
+}
+
+static void
+start_worker(worker_t *workers, int nworkers, int w)
+{
+	int fds[2], i;
+	pid_t pid;
+
+	/* or the worker prints the parent's buffered output again */
+	fflush(NULL);
+	if (pipe(fds) || (pid = fork()) < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		close(fds[0]);
+		for (i = 0; i < nworkers; i++)
+			if (workers[i].pid)
+				close(workers[i].fd);
+		worker(w, fds[1]);
+	}
+	close(fds[1]);
+	workers[w].pid = pid;
+	workers[w].fd = fds[0];
+	workers[w].len = 0;
+}
+
+
+/* In the parent */
+
+/* "JOB FAILED {...}" from a worker */
+static void
+take_line(char *line)
+{
+	int i, failed, n;
+
+	if (sscanf(line, "%d %d %n", &i, &failed, &n) != 2 || i < 0 ||
+	    i >= njobs || jobs[i].result) {
+		fprintf(stderr, "psimulator-batch: bad result from a worker\n");
+		return;
+	}
+	jobs[i].result = xstrdup(line + n);
+	jobs[i].failed = failed;
+}
+
+/* Its last job never finished, unless it died just after sending it. */
+static void
+worker_died(int w, int status)
+{
+	long i = pool->current[w] - 1;
+	char *line;
+	size_t size;
+	FILE *f;
+
+	pool->current[w] = 0;
+	if (i < 0 || jobs[i].result)
+		return;
+	f = open_memstream(&line, &size);
+	if (!f) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	put_job(f, i);
+	if (WIFSIGNALED(status))
+		fprintf(f, ",\"exit\":\"crashed\",\"signal\":%d}",
+			WTERMSIG(status));
+	else
+		fprintf(f, ",\"exit\":\"crashed\",\"status\":%d}",
+			WEXITSTATUS(status));
+	fclose(f);
+	jobs[i].result = line;
+	jobs[i].failed = 1;
+}
+
+/* Read what a worker has sent; 0 once it has finished. */
+static int
+read_worker(worker_t *wk, int w)
+{
+	char *nl;
+	long n;
+	int status;
+
+	if (wk->size - wk->len < 4096) {
+		wk->size = wk->size * 2 + 4096;
+		wk->buf = xrealloc(wk->buf, wk->size);
+	}
+	n = read(wk->fd, wk->buf + wk->len, wk->size - wk->len - 1);
+	if (n < 0)
+		return errno == EINTR || errno == EAGAIN;
+	if (n > 0) {
+		wk->len += n;
+		wk->buf[wk->len] = 0;
+		while ((nl = strchr(wk->buf, '\n'))) {
+			*nl = 0;
+			take_line(wk->buf);
+			wk->len -= nl + 1 - wk->buf;
+			memmove(wk->buf, nl + 1, wk->len + 1);
+		}
+		return 1;
+	}
+	close(wk->fd);
+	while (waitpid(wk->pid, &status, 0) < 0)
+		if (errno != EINTR) {
+			perror("waitpid");
+			exit(1);
+		}
+	wk->pid = 0;
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		worker_died(w, status);
+	return 0;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: psimulator-batch [-j JOBS] manifest\n");
+	printf("  Runs each job in manifest (- for stdin), one a line:\n");
+	printf("      ROM SCRIPT TIME\n");
+	printf("  with - for no script, and TIME the most guest time to run\n");
+	printf("  for, in cycles or with a suffix of us, ms or s.  Prints a\n");
+	printf("  line of JSON for each, in order, and exits with status 1 if\n");
+	printf("  any couldn't be run, crashed, or quit with a status other\n");
+	printf("  than 0.\n");
+	printf("  -j    jobs at a time (default: one per core)\n");
+	exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+	worker_t *workers;
+	struct pollfd *pfd;
+	int nworkers, running, printed = 0, nfailed = 0, i, n;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	nworkers = cores > 0 ? cores : 1;
+	while ((i = getopt(ac, av, "j:")) != EOF)
+		switch (i) {
+		case 'j':
+			nworkers = atoi(optarg);
+			if (nworkers < 1)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	if (ac - optind != 1)
+		usage();
+	read_manifest(av[optind]);
+	map_roms();
+	if (nworkers > njobs)
+		nworkers = njobs ? njobs : 1;
+
+	pool = mmap(NULL, sizeof(*pool) + nworkers * sizeof(long),
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	workers = calloc(nworkers, sizeof(*workers));
+	pfd = calloc(nworkers, sizeof(*pfd));
+	if (pool == MAP_FAILED || !workers || !pfd) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	for (i = 0; i < nworkers; i++)
+		start_worker(workers, nworkers, i);
+
+	for (running = nworkers; running; ) {
+		for (i = n = 0; i < nworkers; i++)
+			if (workers[i].pid) {
+				pfd[n].fd = workers[i].fd;
+				pfd[n].events = POLLIN;
+				n++;
+			}
+		if (poll(pfd, n, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(1);
+		}
+		for (i = n = 0; i < nworkers; i++) {
+			if (!workers[i].pid)
+				continue;
+			if (pfd[n++].revents && !read_worker(&workers[i], i)) {
+				running--;
+				if (pool->next < njobs) {
+					start_worker(workers, nworkers, i);
+					running++;
+				}
+			}
+		}
+		for (; printed < njobs && jobs[printed].result; printed++) {
+			puts(jobs[printed].result);
+			if (jobs[printed].failed)
+				nfailed++;
+		}
+		fflush(stdout);
+	}
+	for (; printed < njobs; printed++) {
+		/* lost with a worker that died */
+		fflush(stdout);
+		put_job(stdout, printed);
+		puts(",\"exit\":\"crashed\"}");
+		nfailed++;
+	}
+	return nfailed ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+/*
+    psimulator.c - The emulator as a library.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+
+#include "armdefs.h"
+#include "armemu.h"
+#include "psimulator.h"
+
+extern unsigned char keyboard[8];
+
+struct psim_t {
+	ARMul_State *	state;
+};
+
+
+psim_t *
+psim_new(const psim_config_t *config)
+{
+	static const psim_config_t defaults;
+	ARMul_State *state;
+	psim_t *p;
+
+	if (!config)
+		config = &defaults;
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+	ARMul_EmulateInit();
+	p->state = state = ARMul_NewState();
+	if (!state) {
+		free(p);
+		return NULL;
+	}
+	state->bigendSig = LOW;
+	ARMul_CoProInit(state);
+	state->verbose = config->verbose;
+	state->headless = !config->display;
+	state->cpu_clock = config->cpu_clock ? config->cpu_clock : CPU_CLOCK;
+	state->realtime = config->realtime;
+	state->deterministic = config->deterministic;
+	state->uart.fast = config->uart_fast;
+	uart_log(state, 1);
+	state->cf.scratch = config->card_scratch;
+	if ((config->uart && uart_open(state, config->uart)) ||
+	    (config->card && cf_open(state, config->card)) ||
+	    (config->sound && codec_open(state, config->sound))) {
+		psim_free(p);
+		return NULL;
+	}
+	ARMul_SelectProcessor(state, ARM600);
+	ARMul_SetCPSR(state, USER32MODE);
+	psim_reset(p);
+	return p;
+}
+
+void
+psim_free(psim_t *p)
+{
+	ARMul_State *state;
+
+	if (!p)
+		return;
+	state = p->state;
+	lcd_close(state);
+	uart_close(state);
+	uart_log(state, 0);
+	codec_close(state);
+	cf_close(state);
+	script_close(state);
+	ARMul_CoProExit(state);
+	mem_free(state);
+	free(state->Events);
+	free(state);
+	free(p);
+}
+
+int
+psim_load_rom(psim_t *p, const void *rom, long size)
+{
+	mem_load_rom(p->state, 0, rom, size);
+	return 0;
+}
+
+int
+psim_load_rom_file(psim_t *p, const char *filename)
+{
+	return mem_load_rom_file(p->state, 0, filename);
+}
+
+void
+psim_share_rom(psim_t *p, const void *rom, long size)
+{
+	mem_share_rom(p->state, 0, rom, size);
+}
+
+void
+psim_reset(psim_t *p)
+{
+	ARMul_State *state = p->state;
+
+	ARMul_Reset(state);
+	ARMul_SetPC(state, 0);
+	state->NextInstr = RESUME;	/* treat as PC change */
+}
+
+
+static int
+psim_why(int why)
+{
+	switch (why) {
+	case RUN_CYCLES:
+		return PSIM_CYCLES;
+	case RUN_QUIT:
+		return PSIM_QUIT;
+	case RUN_SCRIPT_END:
+		return PSIM_SCRIPT_END;
+	case RUN_MET:
+		return PSIM_MET;
+	default:
+		return PSIM_STOPPED;
+	}
+}
+
+int
+psim_run(psim_t *p, unsigned long long cycles)
+{
+	return psim_why(run_for(p->state, cycles == PSIM_FOREVER ?
+					  RUN_FOREVER : cycles));
+}
+
+static int
+psim_until(psim_t *p, run_until_t *until, unsigned long long cycles)
+{
+	return psim_why(run_until(p->state, until, cycles == PSIM_FOREVER ?
+						   RUN_FOREVER : cycles));
+}
+
+int
+psim_run_until_pc(psim_t *p, unsigned long pc, unsigned long long cycles)
+{
+	run_until_t until = { .what = RUN_UNTIL_PC, .addr = pc };
+
+	return psim_until(p, &until, cycles);
+}
+
+int
+psim_run_until_uart(psim_t *p, const char *text, unsigned long long cycles)
+{
+	run_until_t until = { .what = RUN_UNTIL_UART,
+			      .text = text, .len = strlen(text) };
+
+	return psim_until(p, &until, cycles);
+}
+
+int
+psim_run_until_mem(psim_t *p, unsigned long addr, unsigned long value,
+		   unsigned long mask, unsigned long long cycles)
+{
+	run_until_t until = { .what = RUN_UNTIL_MEM, .addr = addr,
+			      .value = value & mask, .mask = mask };
+
+	return psim_until(p, &until, cycles);
+}
+
+int
+psim_run_until_hash(psim_t *p, unsigned long long hash,
+		    unsigned long long cycles)
+{
+	run_until_t until = { .what = RUN_UNTIL_HASH, .hash = hash };
+
+	return psim_until(p, &until, cycles);
+}
+
+int
+psim_run_until_idle(psim_t *p, unsigned long long cycles)
+{
+	run_until_t until = { .what = RUN_UNTIL_IDLE };
+
+	return psim_until(p, &until, cycles);
+}
+
+int
+psim_status(psim_t *p)
+{
+	return p->state->script.status;
+}
+
+unsigned long long
+psim_cycles(psim_t *p)
+{
+	return ARMul_Time(p->state);
+}
+
+unsigned long long
+psim_instructions(psim_t *p)
+{
+	return p->state->NumInstrs;
+}
+
+
+/* Whole words go straight through; the ends of a run that isn't
+   aligned are read, changed and written back, as the CPU's byte
+   stores are.  The cache is virtually addressed, so a write flushes
+   it rather than look for the lines it changed. */
+
+void
+psim_read(psim_t *p, unsigned long addr, void *buf, long len)
+{
+	unsigned char *dst = buf;
+
+	while (len > 0) {
+		ARMword w = mem_read_word(p->state, addr & ~3UL);
+		int n;
+
+		for (n = addr & 3; n < 4 && len > 0; n++, len--, addr++)
+			*dst++ = w >> (n * 8);
+	}
+}
+
+void
+psim_write(psim_t *p, unsigned long addr, const void *buf, long len)
+{
+	const unsigned char *src = buf;
+
+	while (len > 0) {
+		ARMword base = addr & ~3UL, w = 0;
+		int n;
+
+		if ((addr & 3) || len < 4)
+			w = mem_read_word(p->state, base);
+		for (n = addr & 3; n < 4 && len > 0; n++, len--, addr++)
+			w = (w & ~(0xffUL << (n * 8))) | ((ARMword)*src++ << (n * 8));
+		mem_write_word(p->state, base, w);
+	}
+	mmu_cache_invalidate(p->state);
+	mmu_tlb_invalidate_all(p->state);
+}
+
+
+int
+psim_uart_send(psim_t *p, const void *data, int len)
+{
+	return uart_inject(p->state, data, len);
+}
+
+int
+psim_key(psim_t *p, int code, int down)
+{
+	if (code < 0 || code > 63)
+		return -1;
+	if (down)
+		keyboard[code >> 3] |= 1 << (code & 7);
+	else
+		keyboard[code >> 3] &= ~(1 << (code & 7));
+	return 0;
+}
+
+void
+psim_pen(psim_t *p, int down, int x, int y)
+{
+	ssi_pen(p->state, down, x, y);
+}
+
+const unsigned char *
+psim_uart_output(psim_t *p, long *len)
+{
+	*len = p->state->uart.log_len;
+	return p->state->uart.log;
+}
+
+void
+psim_uart_clear(psim_t *p)
+{
+	p->state->uart.log_len = 0;
+}
+
+
+int
+psim_screen_size(psim_t *p, int *width, int *height)
+{
+	ARMul_State *state = p->state;
+
+	if (shot_fb_size(state) < 0)
+		return -1;
+	*width = state->lcd.width;
+	*height = state->lcd.height;
+	return 0;
+}
+
+int
+psim_screen(psim_t *p, unsigned char *rgb)
+{
+	ARMul_State *state = p->state;
+	long size = shot_fb_size(state);
+	unsigned char *fb;
+
+	if (size < 0)
+		return -1;
+	fb = malloc(size);
+	if (!fb)
+		return -1;
+	shot_read_fb(state, fb);
+	shot_render(fb, state->lcd.width, state->lcd.height, state->lcd.depth,
+		    state->io.pallsw, state->io.palmsw, rgb);
+	free(fb);
+	return 0;
+}
+
+unsigned long long
+psim_frame_hash(psim_t *p)
+{
+	return shot_hash(p->state);
+}
+
+
+int
+psim_load_script(psim_t *p, const char *filename)
+{
+	if (script_open(p->state, filename))
+		return -1;
+	p->state->script.at_end = SCRIPT_END_STOP;
+	return 0;
+}
+
+int
+psim_save_snapshot(psim_t *p, const char *filename)
+{
+	return snap_save(p->state, filename);
+}
+
+int
+psim_load_snapshot(psim_t *p, const char *filename)
+{
+	return snap_load(p->state, filename);
+}
+
+struct ARMul_State *
+psim_state(psim_t *p)
+{
+	return p->state;
+}
@@ -0,0 +1,167 @@
+/*
+    psimulator.h - The emulator as a library.
+    ARMulator extensions for the ARM7100 family.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _PSIMULATOR_H_
+#define _PSIMULATOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* libpsimulator runs a Series 5 in the caller's process.  A machine is
+   made with psim_new(), given a ROM, and then run a slice of guest
+   cycles at a time with psim_run(); between slices the caller can look
+   at and change memory, hand it input, and read back the screen and
+   what it sent on the UART.  Everything happens on the calling thread
+   except the UART's I/O, if it is given a host endpoint, and the
+   display's, if it has one; psim_free() stops both.
+
+	psim_t *p = psim_new(NULL);
+
+	psim_load_rom(p, rom, rom_size);
+	psim_uart_send(p, "hello\r", 6);
+	while (psim_run(p, 18432000) == PSIM_CYCLES)
+		if (psim_frame_hash(p) == wanted)
+			break;
+	psim_free(p);
+
+   Addresses are physical, and go through the memory map as the CPU's
+   accesses would, so I/O registers have their side effects.  Times
+   are in guest cycles, PSIM_CLOCK of them a second by default.
+
+   The emulator still has some state outside the machine: the keyboard
+   matrix, the X display and the LCD recording.  Machines can be made
+   and run one after another, or taken in turns, but not run at once
+   on different threads; they share keys, and only one may have the
+   display or record. */
+
+#define PSIM_CLOCK	18432000	/* default guest cycles a second */
+#define PSIM_FOREVER	(~0ULL)		/* cycles for psim_run(): no limit */
+
+/* Why psim_run() came back */
+#define PSIM_CYCLES	0		/* the cycles went by */
+#define PSIM_QUIT	1		/* asked to quit: see psim_status() */
+#define PSIM_SCRIPT_END	2		/* the script ran out of commands */
+#define PSIM_STOPPED	3		/* the CPU stopped by itself */
+#define PSIM_MET	4		/* a psim_run_until_*() came true */
+
+typedef struct psim_t psim_t;
+
+typedef struct psim_config_t {
+	unsigned long	cpu_clock;	/* Hz, or 0 for PSIM_CLOCK */
+	int		display;	/* show the LCD in an X window */
+	int		realtime;	/* run no faster than real time */
+	int		deterministic;	/* the RTC counts guest time */
+	const char *	uart;		/* host endpoint (armuart.h), or NULL */
+	int		uart_fast;	/* ignore the bit rate */
+	const char *	card;		/* CompactFlash image, or NULL */
+	int		card_scratch;	/* card writes stay in memory */
+	const char *	sound;		/* WAV file for the codec, or NULL */
+	int		verbose;
+} psim_config_t;
+
+
+/* A machine with no ROM yet, reset.  config may be NULL for the
+   defaults: headless, as fast as it goes, no card, and the UART going
+   only to psim_uart_output().  NULL if there is no memory for it, or
+   an endpoint, the card or the sound file can't be opened, which is
+   said on stderr. */
+psim_t *	psim_new(const psim_config_t *config);
+void		psim_free(psim_t *p);
+
+/* The boot ROM, copied, before the first psim_run().  It stays
+   through psim_reset().  psim_share_rom() uses the caller's copy
+   instead, so machines can share one: it must be word aligned and
+   outlast them, and a read-only mapping of the file will do. */
+int		psim_load_rom(psim_t *p, const void *rom, long size);
+int		psim_load_rom_file(psim_t *p, const char *filename);
+void		psim_share_rom(psim_t *p, const void *rom, long size);
+void		psim_reset(psim_t *p);
+
+/* Run until cycles have gone by, or the run stops for one of the
+   other PSIM_* reasons; each of those is reported once, and running
+   again carries on.  A script's snapshots are saved on the way. */
+int		psim_run(psim_t *p, unsigned long long cycles);
+int		psim_status(psim_t *p);		/* after PSIM_QUIT */
+unsigned long long psim_cycles(psim_t *p);
+unsigned long long psim_instructions(psim_t *p);
+
+/* As psim_run(), but coming back with PSIM_MET as soon as the guest
+   is at pc, has sent text on the UART, has (word & mask) == value at
+   addr, shows a screen with this frame hash, or has gone idle.  They
+   are looked at each time a block of straight-line code starts, so pc
+   must be a branch target, a return address or a vector, and the run
+   stops before it (see armrun.h). */
+int		psim_run_until_pc(psim_t *p, unsigned long pc,
+				  unsigned long long cycles);
+int		psim_run_until_uart(psim_t *p, const char *text,
+				    unsigned long long cycles);
+int		psim_run_until_mem(psim_t *p, unsigned long addr,
+				   unsigned long value, unsigned long mask,
+				   unsigned long long cycles);
+int		psim_run_until_hash(psim_t *p, unsigned long long hash,
+				    unsigned long long cycles);
+int		psim_run_until_idle(psim_t *p, unsigned long long cycles);
+
+/* Guest memory, at any alignment.  Writes the CPU couldn't make, to
+   the ROM say, go nowhere.  The cache and TLB are flushed after a
+   write, as the guest would after changing code or page tables. */
+void		psim_read(psim_t *p, unsigned long addr, void *buf, long len);
+void		psim_write(psim_t *p, unsigned long addr, const void *buf,
+			   long len);
+
+/* Input.  psim_uart_send() queues bytes for the guest to receive at
+   the line's rate, and returns how many it took; the queue holds a
+   few hundred.  Key codes index the keyboard matrix, 0 to 63 (see
+   xkeycodes.h); pen positions are in LCD pixels. */
+int		psim_uart_send(psim_t *p, const void *data, int len);
+int		psim_key(psim_t *p, int code, int down);
+void		psim_pen(psim_t *p, int down, int x, int y);
+
+/* Output.  Everything the guest has sent on the UART since the start
+   or psim_uart_clear(); the pointer lasts until the next psim_run(). */
+const unsigned char *psim_uart_output(psim_t *p, long *len);
+void		psim_uart_clear(psim_t *p);
+
+/* The screen as the LCD shows it: 3 bytes of RGB a pixel, row by row.
+   Both are -1 until the guest sets up the LCD, and psim_screen() is
+   also -1 if there is no memory to read it with. */
+int		psim_screen_size(psim_t *p, int *width, int *height);
+int		psim_screen(psim_t *p, unsigned char *rgb);
+unsigned long long psim_frame_hash(psim_t *p);
+
+/* Timed input from a script (see armscript.h), and snapshots of the
+   whole machine (see armsnap.h).  A script that runs out of commands
+   stops psim_run() with PSIM_SCRIPT_END.  A snapshot loads into a
+   machine fresh from psim_new(), with its ROM and before the first
+   psim_run(); make another one to load into rather than reuse one. */
+int		psim_load_script(psim_t *p, const char *filename);
+int		psim_save_snapshot(psim_t *p, const char *filename);
+int		psim_load_snapshot(psim_t *p, const char *filename);
+
+/* For front ends that go further, with the arm*.h interfaces. */
+struct ARMul_State *psim_state(psim_t *p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _PSIMULATOR_H_ */
@@ -3,37 +3,128 @@
 #include <signal.h>
 #include <getopt.h>
 #include <termios.h>
+#include <unistd.h>
+#include <limits.h>
 #include "armdefs.h"
-#include "armemu.h"
+#include "armrec.h"
+#include "psimulator.h"
 
-static int big_endian = 0;
+static psim_t *machine = NULL;
 struct ARMul_State *state = 0;
-int stop_simulator = 0;
 struct termios old, tmp;
+static pid_t term_owner = 0;
+static int headless = 0;
+static unsigned long cpu_clock = CPU_CLOCK;
+static int realtime = 0;
+static int deterministic = 0;
+static char *uart_spec = "stdio";
+static int uart_fast = 0;
+static char *cf_image = NULL;
+static char *wav_file = NULL;
+static char *script_file = NULL;
+static char *shot_file = NULL;
+static char *rec_filename = NULL;
+static char *snap_file = NULL;
+static char *ckpt_prefix = NULL;
+static double ckpt_seconds = 5;
+static char *replay_file = NULL;
+static int replay_mode = REPLAY_OFF;
+static int reverse = 0;
+static char **tests = NULL;
+static int ntests = 0;
+static int jobs = 0;
+static int test_timeout = 0;
 
 
 void usage(void)
 {
   printf("Psion Series 5 emulator\n");
-  printf("Usage: psion [-v]\n");
+  printf("Usage: psion [-v] [-n] [-c MHz] [-r] [-d] [-u endpoint] [-F] [-C card.img] [-A sound.wav] [-s script] [-S screenshot.{ppm,png}] [-R recording] [-L snapshot] [-K prefix] [-k seconds] [-I input.log | -P input.log] [-b] [-j jobs] [-T seconds] [test.scr...]\n");
+  printf("  -c    guest CPU clock in MHz (default %g); timers follow it\n",
+	 CPU_CLOCK / 1e6);
+  printf("  -r    run no faster than real time\n");
+  printf("  -d    deterministic: the RTC counts guest time from 2000-01-01\n");
+  printf("  -u    connect the UART to stdio (default), pty, unix:PATH or file:PATH\n");
+  printf("  -F    move UART data as fast as the guest takes it, ignoring the bit rate\n");
+  printf("  -n    run headless, without an X display\n");
+  printf("  -C    insert a CompactFlash card backed by this disk image\n");
+  printf("  -A    write the codec's sound output to this WAV file\n");
+  printf("  -s    feed the guest timed input from a script (see armscript.h)\n");
+  printf("  -S    save the LCD on exit and print its frame hash\n");
+  printf("  -R    record LCD changes (see psimulator-recdecode)\n");
+  printf("  -L    start from a snapshot saved by a script; its clock and -d apply\n");
+  printf("  -K    checkpoint to PREFIX.NNNN.snap, numbered on from any there, as deltas\n");
+  printf("  -k    guest seconds between checkpoints (default 5)\n");
+  printf("  -I    record the UART, keys, pen and host clock to an input log\n");
+  printf("  -P    replay an input log, headless, ignoring the host (see armreplay.h)\n");
+  printf("  -b    keep history, for a script to run back through (see armreverse.h)\n");
+  printf("  -j    with test scripts, run this many at once (default: one per CPU)\n");
+  printf("  -T    with test scripts, fail any still running after this many seconds\n");
+  printf("Given test scripts, boot with -s or -L, then fork a copy of the booted\n");
+  printf("machine for each test (see armfork.h).  Needs -n; not with -A, -R, -S or -b.\n");
   exit(0);
 }
 
+/* Restore the original terminal settings, in the process that changed
+   them: forked tests exit while the parent is still using it. */
+static void
+restore_terminal(void)
+{
+  if (getpid() == term_owner)
+    tcsetattr(0, TCSANOW, &old);
+}
+
+/* Finish the output files and exit with the script's status. */
+static void
+finish(void)
+{
+  if (!fork_child())
+    dump_dram(state);
+  uart_drain(state);
+  codec_close(state);
+  rec_close(state);
+  replay_close(state);
+  if (shot_file && state) {
+    if (shot_save(state, shot_file))
+      fprintf(stderr, "Couldn't save screenshot to %s\n", shot_file);
+    printf("Frame hash: %016llx\n", shot_hash(state));
+  }
+  fork_report(state);
+  exit(state ? state->script.status : 0);
+}
+
 void term_handler( int sig )
-{FILE *f;
+{
   printf("Got signal %d, exiting\n", sig);
-  dump_dram(state);
-  /* Restore the original terminal settings */    
-  tcsetattr(0, TCSANOW, &old);
-  exit(0);
+  finish();
+}
+
+/* Run until the end, forking the tests once the boot script is done
+   (see armrun.c for the stops in between). */
+static void
+run(void)
+{
+  for (;;) {
+    int why = psim_run(machine, PSIM_FOREVER);
+
+    if (why == PSIM_QUIT)
+      finish();
+    else if (why == PSIM_SCRIPT_END && ntests)
+      /* booted: only the children come back */
+      fork_tests(state, tests, ntests, jobs, test_timeout);
+    else if (why != PSIM_SCRIPT_END)
+      return;
+  }
 }
 
 int
 main (int ac, char **av)
-{int i,verbose;
+{int i,verbose = 0;
+ double mhz;
  struct sigaction  act;
+ psim_config_t config = { 0 };
 
-    while ((i = getopt (ac, av, "v")) != EOF) 
+    while ((i = getopt (ac, av, "vnc:rdu:FC:A:s:S:R:L:K:k:I:P:bj:T:")) != EOF) 
     switch (i)
     {
       case 'v':
@@ -42,9 +133,100 @@ main (int ac, char **av)
 	   or debugging information, just summaries.  */
 	verbose = 1;
 	break;
+      case 'n':
+	headless = 1;
+	break;
+      case 'c':
+	mhz = atof(optarg);
+	/* before converting: out of range, that is undefined */
+	if (!(mhz >= 1 && mhz <= ULONG_MAX / 1e6)) {
+	  fprintf(stderr, "CPU clock must be from 1 to %lu MHz\n",
+		  ULONG_MAX / 1000000);
+	  exit(1);
+	}
+	cpu_clock = mhz * 1e6;
+	break;
+      case 'r':
+	realtime = 1;
+	break;
+      case 'd':
+	deterministic = 1;
+	break;
+      case 'u':
+	uart_spec = optarg;
+	break;
+      case 'F':
+	uart_fast = 1;
+	break;
+      case 'C':
+	cf_image = optarg;
+	break;
+      case 'A':
+	wav_file = optarg;
+	break;
+      case 's':
+	script_file = optarg;
+	break;
+      case 'S':
+	shot_file = optarg;
+	break;
+      case 'R':
+	rec_filename = optarg;
+	break;
+      case 'L':
+	snap_file = optarg;
+	break;
+      case 'K':
+	ckpt_prefix = optarg;
+	break;
+      case 'k':
+	ckpt_seconds = atof(optarg);
+	if (ckpt_seconds <= 0) {
+	  fprintf(stderr, "Checkpoints must be a positive time apart\n");
+	  exit(1);
+	}
+	break;
+      case 'I':
+	replay_file = optarg;
+	replay_mode = REPLAY_RECORD;
+	break;
+      case 'P':
+	replay_file = optarg;
+	replay_mode = REPLAY_PLAY;
+	/* the log stands in for the display */
+	headless = 1;
+	break;
+      case 'b':
+	reverse = 1;
+	break;
+      case 'j':
+	jobs = atoi(optarg);
+	break;
+      case 'T':
+	test_timeout = atoi(optarg);
+	break;
       default:
 	usage ();
     }
+    tests = av + optind;
+    ntests = ac - optind;
+    if (ntests) {
+      if (!headless || wav_file || rec_filename || shot_file || ckpt_prefix ||
+	  replay_file || reverse) {
+	fprintf(stderr, "Test scripts need -n, and can't be used with -A, -R, -S, -K, -I, -P or -b\n");
+	exit(1);
+      }
+      if (!script_file && !snap_file) {
+	fprintf(stderr, "Test scripts need a boot script (-s) or a snapshot (-L)\n");
+	exit(1);
+      }
+      if (!jobs)
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (reverse && replay_file) {
+      fprintf(stderr, "-b keeps its own input log, so can't be used with -I or -P\n");
+      exit(1);
+    }
 
     /* Set the terminal for non-blocking per-character (not per-line) input, no echo */
     tcgetattr(0, &old);
@@ -55,6 +237,8 @@ main (int ac, char **av)
     tmp.c_cc[VMIN] = 0;
     tmp.c_cc[VTIME] = 0;
     tcsetattr(0, TCSANOW, &tmp);
+    term_owner = getpid();
+    atexit(restore_terminal);
 
     /* first of all set SIGTERM signal handler */
     act.sa_handler = term_handler;
@@ -62,16 +246,42 @@ main (int ac, char **av)
     sigaction(SIGTERM, &act, NULL);
     sigaction(SIGINT, &act, NULL);
 
-    ARMul_EmulateInit();
-    state = ARMul_NewState ();
-    state->bigendSig = big_endian ? HIGH : LOW;
-    ARMul_CoProInit(state); 
-    state->verbose = verbose;
-    ARMul_SelectProcessor(state, ARM600);
-    ARMul_SetCPSR(state, USER32MODE);
-    ARMul_Reset(state);
-    ARMul_SetPC (state, 0);
-    state->NextInstr = RESUME; /* treat as PC change */
-    state->Reg[15] = ARMul_DoProg (state);
+    config.cpu_clock = cpu_clock;
+    config.display = !headless;
+    config.realtime = realtime;
+    config.deterministic = deterministic;
+    config.uart = uart_spec;
+    config.uart_fast = uart_fast;
+    config.card = cf_image;
+    /* forked tests share the card copy-on-write, like DRAM */
+    config.card_scratch = ntests > 0;
+    config.sound = wav_file;
+    config.verbose = verbose;
+    machine = psim_new(&config);
+    if (!machine)
+      exit(1);
+    state = psim_state(machine);
+    uart_log(state, 0);
+    if (psim_load_rom_file(machine, ROM_FILE))
+      exit(1);
+    state->reverse.enabled = reverse;	/* for script_open() to check */
+    if (snap_file && snap_load(state, snap_file))
+      exit(1);
+    if (ckpt_prefix)
+      snap_checkpoints(state, ckpt_prefix, ckpt_seconds);
+    if (replay_file && replay_open(state, replay_file, replay_mode))
+      exit(1);
+    if (rec_filename && rec_open(state, rec_filename))
+      exit(1);
+    if (script_file && script_open(state, script_file))
+      exit(1);
+    /* the first checkpoint has the script in it */
+    if (reverse && reverse_open(state))
+      exit(1);
+    if (ntests && script_file)
+      state->script.at_end = SCRIPT_END_STOP;
+    else if (ntests)
+      fork_tests(state, tests, ntests, jobs, test_timeout);
+    run();
     exit(0);
 }
@@ -0,0 +1,170 @@
+/*
+    recdecode.c - Render an LCD recording made with psimulator -R
+    to a numbered sequence of PPM or PNG images.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <getopt.h>
+
+#include "armdefs.h"
+#include "armrec.h"
+
+
+static FILE *in;
+
+static int
+get_le(unsigned long long *v, int bytes)
+{
+	int shift, c;
+
+	*v = 0;
+	for (shift = 0; shift < bytes * 8; shift += 8) {
+		if ((c = getc(in)) == EOF)
+			return -1;
+		*v |= (unsigned long long)c << shift;
+	}
+	return 0;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: psimulator-recdecode [-p] [-l] recording prefix\n");
+	printf("  -p    write PNG instead of PPM\n");
+	printf("  -l    list frames without writing images\n");
+	exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+	unsigned char magic[8], *fb = NULL, *rgb = NULL;
+	unsigned long long v, cycles;
+	int width = 0, height = 0, depth = 0, png = 0, list = 0, i;
+	long line_bytes = 0, frames = 0;
+	char *prefix;
+	char name[1024];
+
+	while ((i = getopt(ac, av, "pl")) != EOF)
+		switch (i) {
+		case 'p':
+			png = 1;
+			break;
+		case 'l':
+			list = 1;
+			break;
+		default:
+			usage();
+		}
+	if (ac - optind != 2 - list)
+		usage();
+	in = fopen(av[optind], "rb");
+	if (!in) {
+		perror(av[optind]);
+		return 1;
+	}
+	prefix = av[optind + 1];
+	if (fread(magic, 1, 8, in) != 8 || memcmp(magic, REC_MAGIC, 8)) {
+		fprintf(stderr, "%s: not a psimulator recording\n", av[optind]);
+		return 1;
+	}
+
+	for (;;) {
+		int type = getc(in);
+
+		if (type == EOF)
+			break;
+		switch (type) {
+		case REC_GEOMETRY:
+			if (get_le(&v, 2)) goto truncated;
+			width = v;
+			if (get_le(&v, 2)) goto truncated;
+			height = v;
+			if (get_le(&v, 1)) goto truncated;
+			depth = v;
+			line_bytes = (long)width * depth / 8;
+			free(fb);
+			free(rgb);
+			fb = calloc(line_bytes, height);
+			rgb = malloc((size_t)width * height * 3);
+			if (!fb || !rgb) {
+				fprintf(stderr, "Out of memory\n");
+				return 1;
+			}
+			break;
+
+		case REC_FRAME:
+		{
+			unsigned long long pallsw, palmsw, nlines, y;
+			FILE *out;
+
+			if (!fb) {
+				fprintf(stderr, "Frame before geometry\n");
+				return 1;
+			}
+			if (get_le(&cycles, 8) || get_le(&pallsw, 4) ||
+			    get_le(&palmsw, 4) || get_le(&nlines, 2))
+				goto truncated;
+			while (nlines--) {
+				if (get_le(&y, 2))
+					goto truncated;
+				if (y >= (unsigned)height) {
+					fprintf(stderr, "Bad scanline %llu\n", y);
+					return 1;
+				}
+				if (fread(fb + y * line_bytes, 1, line_bytes, in) != line_bytes)
+					goto truncated;
+			}
+			frames++;
+			if (list) {
+				printf("%6ld %14llu %016llx\n", frames, cycles,
+				       shot_hash_raw(fb, width, height, depth, pallsw, palmsw));
+				break;
+			}
+			shot_render(fb, width, height, depth, pallsw, palmsw, rgb);
+			snprintf(name, sizeof(name), "%s%06ld.%s", prefix, frames,
+				 png ? "png" : "ppm");
+			out = fopen(name, "wb");
+			if (!out) {
+				perror(name);
+				return 1;
+			}
+			if (png)
+				shot_write_png(out, rgb, width, height);
+			else
+				shot_write_ppm(out, rgb, width, height);
+			fclose(out);
+			break;
+		}
+
+		case REC_OFF:
+			if (get_le(&cycles, 8)) goto truncated;
+			if (list)
+				printf("%6s %14llu LCD off\n", "", cycles);
+			break;
+
+		default:
+			fprintf(stderr, "Unknown record type %d\n", type);
+			return 1;
+		}
+	}
+	return 0;
+
+truncated:
+	fprintf(stderr, "Recording is truncated after %ld frames\n", frames);
+	return 1;
+}
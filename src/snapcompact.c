@@ -0,0 +1,310 @@
+/*
+    snapcompact.c - Turn a delta snapshot made with psimulator -K
+    into a full one, so the chain of bases behind it can be deleted.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <string.h>
+#include <getopt.h>
+
+#include "armdefs.h"
+
+
+typedef struct section_t {
+	char		tag[5];
+	unsigned long	len;
+	unsigned char *	data;
+} section_t;
+
+/* DRAM as it stands at the newest snapshot, in file byte order */
+static unsigned char	dram[DRAM_PAGES * SNAP_PAGE];
+static char		have[DRAM_PAGES];	/* newer files win */
+
+static unsigned long long
+get_le(const unsigned char *p, int bytes)
+{
+	unsigned long long v = 0;
+	int i;
+
+	for (i = bytes - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void
+put_le(unsigned char *p, unsigned long long v, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; i++, v >>= 8)
+		p[i] = v;
+}
+
+/* All of a snapshot's sections, up to its "END " */
+static section_t *
+read_snap(const char *name, int *nsec)
+{
+	section_t *sec = NULL;
+	unsigned char h[12];
+	FILE *f = fopen(name, "rb");
+
+	if (!f) {
+		perror(name);
+		exit(1);
+	}
+	if (fread(h, 1, 12, f) != 12 || memcmp(h, SNAP_MAGIC, 8)) {
+		fprintf(stderr, "%s: not a snapshot\n", name);
+		exit(1);
+	}
+	if (get_le(h + 8, 4) < 1 || get_le(h + 8, 4) > SNAP_VERSION) {
+		fprintf(stderr, "%s: snapshot version %llu, this reads %d\n",
+			name, get_le(h + 8, 4), SNAP_VERSION);
+		exit(1);
+	}
+	for (*nsec = 0; ; (*nsec)++) {
+		section_t *s;
+
+		sec = realloc(sec, (*nsec + 1) * sizeof(*sec));
+		if (!sec) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		s = &sec[*nsec];
+		if (fread(h, 1, 8, f) != 8)
+			goto truncated;
+		memcpy(s->tag, h, 4);
+		s->tag[4] = 0;
+		s->len = get_le(h + 4, 4);
+		s->data = malloc(s->len ? s->len : 1);
+		if (!s->data) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		if (fread(s->data, 1, s->len, f) != s->len)
+			goto truncated;
+		if (!strcmp(s->tag, "END ")) {
+			(*nsec)++;
+			break;
+		}
+	}
+	fclose(f);
+	return sec;
+
+truncated:
+	fprintf(stderr, "%s: snapshot is truncated\n", name);
+	exit(1);
+}
+
+static void
+free_snap(section_t *sec, int nsec)
+{
+	int i;
+
+	for (i = 0; i < nsec; i++)
+		free(sec[i].data);
+	free(sec);
+}
+
+static section_t *
+find(section_t *sec, int nsec, const char *tag)
+{
+	int i;
+
+	for (i = 0; i < nsec; i++)
+		if (!strcmp(sec[i].tag, tag))
+			return &sec[i];
+	return NULL;
+}
+
+/* Take the pages a DRAM or DDRM section has that no newer file had. */
+static void
+take_pages(const char *name, const section_t *s)
+{
+	unsigned long pos, page;
+
+	for (pos = 0; pos + 4 + SNAP_PAGE <= s->len; pos += 4 + SNAP_PAGE) {
+		page = get_le(s->data + pos, 4);
+		if (page >= DRAM_PAGES) {
+			fprintf(stderr, "%s: page %lu is outside DRAM\n",
+				name, page);
+			exit(1);
+		}
+		if (!have[page]) {
+			memcpy(dram + page * SNAP_PAGE, s->data + pos + 4,
+			       SNAP_PAGE);
+			have[page] = 1;
+		}
+	}
+}
+
+static int
+page_is_zero(const unsigned char *p)
+{
+	int i;
+
+	for (i = 0; i < SNAP_PAGE; i++)
+		if (p[i])
+			return 0;
+	return 1;
+}
+
+static int
+write_section(FILE *f, const char *tag, const unsigned char *data,
+	      unsigned long len)
+{
+	unsigned char h[8];
+
+	memcpy(h, tag, 4);
+	put_le(h + 4, len, 4);
+	return fwrite(h, 1, 8, f) != 8 ||
+		(len && fwrite(data, 1, len, f) != len);
+}
+
+/* The newest file's sections but with all of DRAM, and no base. */
+static int
+write_snap(FILE *f, section_t *sec, int nsec)
+{
+	unsigned char h[12], *p, *pages;
+	long page, n = 0;
+	int i, err = 0;
+
+	for (page = 0; page < DRAM_PAGES; page++)
+		if (!page_is_zero(dram + page * SNAP_PAGE))
+			n++;
+	pages = malloc(n * (4 + SNAP_PAGE) + 1);
+	if (!pages) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	for (p = pages, page = 0; page < DRAM_PAGES; page++)
+		if (!page_is_zero(dram + page * SNAP_PAGE)) {
+			put_le(p, page, 4);
+			memcpy(p + 4, dram + page * SNAP_PAGE, SNAP_PAGE);
+			p += 4 + SNAP_PAGE;
+		}
+
+	memcpy(h, SNAP_MAGIC, 8);
+	put_le(h + 8, SNAP_VERSION, 4);
+	err |= fwrite(h, 1, 12, f) != 12;
+	for (i = 0; i < nsec; i++) {
+		if (!strcmp(sec[i].tag, "BASE"))
+			continue;
+		if (!strcmp(sec[i].tag, "DRAM") || !strcmp(sec[i].tag, "DDRM"))
+			err |= write_section(f, "DRAM", pages, p - pages);
+		else
+			err |= write_section(f, sec[i].tag, sec[i].data,
+					     sec[i].len);
+	}
+	free(pages);
+	return err;
+}
+
+static void
+usage(void)
+{
+	printf("Usage: psimulator-snapcompact [-v] snapshot [output]\n");
+	printf("  Writes snapshot, with the chain of deltas behind it merged in,\n");
+	printf("  as a full snapshot to output, or over itself.  It keeps its ID,\n");
+	printf("  so deltas saved on it still load.\n");
+	printf("  -v    list the chain\n");
+	exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+	section_t *newest, *sec, *s;
+	int nnewest, nsec, verbose = 0, depth, i;
+	unsigned long long want = 0, id;
+	char *name, *out, *tmp, *ref;
+	FILE *f;
+
+	while ((i = getopt(ac, av, "v")) != EOF)
+		switch (i) {
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	if (ac - optind < 1 || ac - optind > 2)
+		usage();
+	name = av[optind];
+	out = ac - optind == 2 ? av[optind + 1] : name;
+
+	newest = sec = read_snap(name, &nnewest);
+	nsec = nnewest;
+	for (depth = 0; ; depth++) {
+		s = find(sec, nsec, "ID  ");
+		id = s && s->len >= 8 ? get_le(s->data, 8) : 0;
+		if (depth && id != want) {
+			fprintf(stderr, "%s: not the snapshot its successor "
+				"was saved against\n", name);
+			return 1;
+		}
+		if (verbose)
+			printf("%s %016llx\n", name, id);
+		if ((s = find(sec, nsec, "DDRM")) || (s = find(sec, nsec, "DRAM")))
+			take_pages(name, s);
+		s = find(sec, nsec, "BASE");
+		if (!s)
+			break;
+		if (s->len < 12 || get_le(s->data + 8, 4) > s->len - 12) {
+			fprintf(stderr, "%s: snapshot is damaged\n", name);
+			return 1;
+		}
+		if (depth >= CHAIN_MAX) {
+			fprintf(stderr, "%s: the chain goes on too long\n", name);
+			return 1;
+		}
+		want = get_le(s->data, 8);
+		ref = malloc(s->len - 11);
+		if (!ref) {
+			fprintf( stderr, "Armulator: can't allocate memory\n");
+			exit( -1 );
+		}
+		memcpy(ref, s->data + 12, s->len - 12);
+		ref[get_le(s->data + 8, 4)] = 0;
+		name = snap_base_path(ref, name);
+		free(ref);
+		if (sec != newest)
+			free_snap(sec, nsec);
+		sec = read_snap(name, &nsec);
+	}
+	if (sec != newest)
+		free_snap(sec, nsec);
+
+	/* written aside and renamed, as out may be the snapshot itself */
+	tmp = malloc(strlen(out) + 5);
+	if (!tmp) {
+		fprintf( stderr, "Armulator: can't allocate memory\n");
+		exit( -1 );
+	}
+	sprintf(tmp, "%s.tmp", out);
+	f = fopen(tmp, "wb");
+	if (!f) {
+		perror(tmp);
+		return 1;
+	}
+	if (write_snap(f, newest, nnewest) | fclose(f) || rename(tmp, out)) {
+		perror(out);
+		remove(tmp);
+		return 1;
+	}
+	if (verbose)
+		printf("%s: %d deltas merged\n", out, depth);
+	return 0;
+}